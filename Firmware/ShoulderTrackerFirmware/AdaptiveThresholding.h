@@ -1,59 +1,24 @@
 #include <Arduino.h>
 
-#include <iterator.h>
 /** ShoulderTracking device firmware
  * 
  * Copyright Vincent Crocher - Unimelb - 2016, 2020
  * License MIT license
  */
-#include <vector.h>
-#include <serstream.h>
+#include "StaticContainers.h"
 
 //#define DEBUG
 //#define MEMORY_DEBUG
 
 #ifdef MEMORY_DEBUG
-  typedef struct __freelist {
-    size_t sz;
-    struct __freelist *nx;
-  } FREELIST;
-   
-  extern FREELIST *__flp;
-  extern char *__brkval;
-  
-  size_t getMemoryUsed()
-  {
-    size_t used;
-    FREELIST *fp;
-   
-  // __brkval=0 if nothing has been allocated yet
-   
-    if(__brkval==0)
-      return 0;
-   
-  // __brkval moves up from __malloc_heap_start to
-  // __malloc_heap_end as memory is used
-   
-    used=__brkval-__malloc_heap_start;
-   
-  // memory free'd by you is collected in the free list and
-  // compacted with adjacent blocks. This, combined with malloc's
-  // intelligent picking of candidate blocks drastically reduces
-  // heap fragmentation. Anyway, since blocks in the free list
-  // are available to you at no cost we need to take them off.
-   
-    for(fp=__flp;fp;fp=fp->nx)
-      used-=fp->sz+sizeof(size_t);
-   
-    return used;
-  }
-  
+  //No heap in use (static containers only): free memory is the gap between
+  //the end of the static variables and the stack
+  extern char __heap_start;
+
   size_t getFreeMemory()
   {
-    return (size_t)AVR_STACK_POINTER_REG-
-           (size_t)__malloc_margin-
-           (size_t)__malloc_heap_start-
-           getMemoryUsed();
+    char top;
+    return &top - &__heap_start;
   }
 #endif
 
@@ -61,8 +26,9 @@
 unsigned char uchar_min(unsigned char a, unsigned char b){return (a<=b ? a:b);}
 unsigned char uchar_max(unsigned char a, unsigned char b){return (a>=b ? a:b);}
 
-const long int TimePerStoragePtms = 500;
-#define NB_PTS 200 // (For TimePerStoragePtms=1000: 300 => 5min, 150 =>2min30s) WARNING: check memory capacity
+const long int TimePerStoragePtms = 500; //Max value computed over this window
+const unsigned char StorageDecimation = 2; //One window out of StorageDecimation is stored
+#define NB_PTS 100 // (For TimePerStoragePtms=500 and StorageDecimation=2: 100 => 1min40s) WARNING: check memory capacity (3 bytes per point and per instance, see memory_report.sh)
 
 
 //###################################################################################
@@ -74,21 +40,19 @@ class AdaptiveThresholding
 
   public:
     typedef unsigned int ValuesType; //Types of values stored by the class (will afect precision together with scale factor)
-    std::vector<ValuesType> Ordered;
-    std::vector<unsigned char> OrderedOrder;
+    StaticVector<ValuesType, NB_PTS> Ordered; //Stored values, sorted
+    StaticRing<unsigned char, NB_PTS> OrderedOrder; //Positions in Ordered of the stored values, oldest first
     unsigned long int StorageT;
     
     float ScalingFactor;
     
     unsigned int tmpNbVal;
+    unsigned char tmpWindow; //Windows since the last stored one
     double tmpMax;//tmpAvg;
 
-    //Constructor: reserve vectors memory and init values
+    //Constructor: init values
     AdaptiveThresholding(float scale=1)
     {
-        Ordered.reserve(NB_PTS);
-        OrderedOrder.reserve(NB_PTS);
-        
         ScalingFactor=scale;
 		
         Init();
@@ -117,6 +81,7 @@ class AdaptiveThresholding
       
         StorageT=micros();
         tmpNbVal=0;
+        tmpWindow=0;
         //tmpAvg=0;
         tmpMax=0;
     }
@@ -155,7 +120,13 @@ class AdaptiveThresholding
          /*Debug
          Serial.print(millis());Serial.print("ms, ");Serial.print(tmpNbVal);Serial.print("sp, ");Serial.println(tmpAvg);*/
          //Insert((ValuesType) tmpAvg);
-         Insert((ValuesType) tmpMax);
+         //Store one window max out of StorageDecimation: same distribution (and thresholds)
+         //as storing all of them, over the same time span with less points
+         if(++tmpWindow>=StorageDecimation)
+         {
+           tmpWindow=0;
+           Insert((ValuesType) tmpMax);
+         }
          
          
          //Reset orig time
@@ -190,7 +161,7 @@ class AdaptiveThresholding
           Serial.print(Ordered[OrderedOrder[0]]);
           Serial.print(")  ");
         #endif
-        Ordered.erase(Ordered.begin()+OrderedOrder[0]);
+        Ordered.erase(OrderedOrder[0]);
         
         //Update indexes values: all the ones above the deleted one are decreased by one
         for(int i=1; i<OrderedOrder.size(); i++)
@@ -200,7 +171,7 @@ class AdaptiveThresholding
         }
         
         //Remove its index from the ordering order list
-        OrderedOrder.erase(OrderedOrder.begin());
+        OrderedOrder.pop_front();
       }
       
       //Insert the most recent value in the list (sorted, using dichotomy):
@@ -236,10 +207,7 @@ class AdaptiveThresholding
       #endif
   
       //insert element at the position just found
-      std::vector<ValuesType>::iterator it;
-      it = Ordered.begin();
-      it+=pos;
-      Ordered.insert(it, newVal);
+      Ordered.insert(pos, newVal);
       
       //Keep track of its position
       OrderedOrder.push_back(pos);
@@ -262,7 +230,14 @@ class AdaptiveThresholding
     // percentage
     float GetThreshold(int percent)
     {
+      //Nothing stored yet: no threshold (minimal one applies)
+      if(Ordered.size()==0)
+        return 0;
       int idx=percent*Ordered.size()/100;
+      if(idx<0)
+        idx=0;
+      if(idx>(int)Ordered.size()-1)
+        idx=Ordered.size()-1;
       //Use the values around to smooth the threshold when possible
       float thresh;
       /*if(idx<Ordered.size())
@@ -289,6 +264,26 @@ class AdaptiveThresholding
       return Ordered.size();
     }
 
+    //Get nb values evenly spread over the sorted stored values (quantiles, lowest first)
+    //Return false if nothing stored yet (only the initial values)
+    bool GetQuantiles(ValuesType *q, int nb)
+    {
+      if(Ordered.size()<=2)
+        return false;
+
+      for(int k=0; k<nb; k++)
+        q[k]=Ordered[(unsigned long int)k*(Ordered.size()-1)/(nb-1)];
+      return true;
+    }
+
+    //Warm start: restart from a previous summary of the stored values (see GetQuantiles)
+    void Seed(ValuesType *q, int nb)
+    {
+      Reset(ScalingFactor);
+      for(int k=0; k<nb; k++)
+        Insert(q[k]);
+    }
+
 };
 //-----------------------------------------------------------------------------------
 //-----------------------------------------------------------------------------------
@@ -0,0 +1,178 @@
+/** ShoulderTracking device firmware
+ *
+ * Copyright Vincent Crocher - Unimelb - 2016, 2020
+ * License MIT license
+ */
+#include <Arduino.h>
+
+#define CMD_QUEUE_SIZE 4 //Parsed commands waiting to be executed
+#define CMD_MAX_PARAMS 3 //Parameter bytes kept in the queue: longer payloads (CDW, CDC) go in a single shared buffer
+#define CMD_MAX_PAYLOAD THRESH_PROFILE_SIZE //Longest payload
+#define CMD_TIMEOUT_MS 200 //Incomplete command dropped after this time
+#define CMD_ERROR 0 //Command id of a parsing error, Param[0] is the error code (see ShoulderTrackerFirmware.ino header)
+
+typedef struct
+{
+  char Id; //Command letter (x of CDx), or CMD_ERROR
+  uint8_t Param[CMD_MAX_PARAMS];
+} Command;
+
+
+//###################################################################################
+//                            COMMAND PARSER CLASS
+//###################################################################################
+// Incremental (non blocking) parser of the CDx commands and their parameters: Poll()
+// consumes the received bytes as they come and queues the complete commands.
+// Bytes are never discarded: when the queue (or the payload buffer) is full they are
+// left in the serial RX buffer until the commands before them have been executed.
+class CommandParser
+{
+  public:
+    CommandParser()
+    {
+      Pos=0;
+      PayloadBusy=false;
+      Resyncing=false;
+    }
+
+    //Nb of parameter bytes following the command letter (-1 if unknown command)
+    static int ParamSize(char id)
+    {
+      switch(id)
+      {
+        case 'Q': case 'P': case 'R': case 'T': case 'S': case 'D':
+        case 'J': case 'G': case 'X': case 'B':
+          return 0;
+        case 'M':
+        case 'U':
+          return 1;
+        case 'O':
+          return 2;
+        case 'V':
+          return 3;
+        case 'W':
+          return THRESH_PROFILE_SIZE;
+        case 'C':
+          return MAG_CALIB_SIZE;
+        default:
+          return -1;
+      }
+    }
+
+    //Consume the received bytes: call once per loop
+    void Poll()
+    {
+      //Incomplete command for too long: drop it
+      if(Pos>0 && millis()-StartTime>CMD_TIMEOUT_MS)
+      {
+        Pos=0;
+        PushError(3);
+      }
+
+      while(Serial.available()>0 && !Queue.full())
+      {
+        //Payload of the previous one not used yet: wait
+        if(Pos==3 && ParamSize(Current.Id)>CMD_MAX_PARAMS && PayloadBusy)
+          return;
+
+        uint8_t c=Serial.peek();
+        switch(Pos)
+        {
+          case 0:
+            if(c=='C')
+            {
+              Pos=1;
+              StartTime=millis();
+              Resyncing=false;
+            }
+            else if(!Resyncing)
+            {
+              //Garbage: one error per run of invalid bytes
+              Resyncing=true;
+              PushError(1);
+            }
+            break;
+          case 1:
+            if(c=='D')
+            {
+              Pos=2;
+            }
+            else
+            {
+              Pos=0;
+              Resyncing=true;
+              PushError(1);
+              continue; //Byte not consumed: may be the start of a command
+            }
+            break;
+          case 2:
+            Current.Id=c;
+            NbParams=ParamSize(c);
+            if(NbParams<0)
+            {
+              Pos=0;
+              PushError(2);
+            }
+            else
+            {
+              Pos=3;
+            }
+            break;
+          default:
+            if(NbParams>CMD_MAX_PARAMS)
+              Payload[Pos-3]=c;
+            else
+              Current.Param[Pos-3]=c;
+            Pos++;
+            break;
+        }
+        Serial.read();
+
+        //Complete
+        if(Pos>=3 && Pos-3==NbParams)
+        {
+          if(NbParams>CMD_MAX_PARAMS)
+            PayloadBusy=true;
+          Queue.push_back(Current);
+          Pos=0;
+        }
+      }
+    }
+
+    bool Available() {return Queue.size()>0;}
+    Command& Front() {return Queue.front();}
+    //Payload of the front command (CDW, CDC)
+    uint8_t* GetPayload() {return Payload;}
+
+    //Front command executed
+    void Pop()
+    {
+      if(Queue.size()==0)
+        return;
+      if(ParamSize(Queue.front().Id)>CMD_MAX_PARAMS)
+        PayloadBusy=false;
+      Queue.pop_front();
+    }
+
+  private:
+    void PushError(uint8_t code)
+    {
+      Command err;
+      err.Id=CMD_ERROR;
+      err.Param[0]=code;
+      Queue.push_back(err);
+    }
+
+    StaticRing<Command, CMD_QUEUE_SIZE> Queue;
+    uint8_t Payload[CMD_MAX_PAYLOAD];
+    bool PayloadBusy;
+
+    //Command being parsed: Pos is the nb of bytes received (CDx then parameters)
+    Command Current;
+    int Pos, NbParams;
+    unsigned long int StartTime;
+    bool Resyncing;
+};
+//-----------------------------------------------------------------------------------
+//-----------------------------------------------------------------------------------
+//-----------------------------------------------------------------------------------
@@ -0,0 +1,22 @@
+/** ShoulderTracking device firmware
+ *
+ * Copyright Vincent Crocher - Unimelb - 2016, 2020
+ * License MIT license
+ *
+ * EEPROM (1KB on ATmega328P) map.
+ */
+
+//Magnetometer calibration: m_min, m_max (written by CalibrateMag sketch)
+#define EE_MAG_CALIB_ADDR 0
+#define EE_MAG_CALIB_SIZE 12
+//Magnetometer ellipsoid calibration (fitted by the host software), see MagCalibration.h
+#define EE_MAG_ELLIPSOID_ADDR 12
+#define EE_MAG_ELLIPSOID_SIZE MAG_CALIB_SIZE
+
+//Adaptive thresholds checkpoints: THRESH_NB_SLOTS records per mode (wear leveling), see ThresholdStore.h
+#define EE_THRESH_ADDR 64
+#define EE_THRESH_SIZE (2*THRESH_NB_SLOTS*THRESH_RECORD_SIZE)
+
+//Offline session buffer: ring of OFFLINE_RECORD_SIZE records up to the end of the EEPROM, see OfflineBuffer.h
+#define EE_OFFLINE_ADDR 384
+#define EE_OFFLINE_SIZE (E2END+1-EE_OFFLINE_ADDR)
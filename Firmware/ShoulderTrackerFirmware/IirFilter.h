@@ -0,0 +1,82 @@
+/** ShoulderTracking device firmware
+ *
+ * Copyright Vincent Crocher - Unimelb - 2016, 2020
+ * License MIT license
+ *
+ * Generic IIR filter, with no Arduino dependency: also used by the host software
+ * (see Software/tools/IirFilterBench.cpp).
+ */
+#ifndef IIRFILTER_H
+#define IIRFILTER_H
+
+//Filter coefficients, normalised (a[0] must be 1). Declare them constexpr so that
+//the filter loop is unrolled with the coefficients as constants:
+//  constexpr IirCoeffs<1> MyCoeffs={{b0, b1}, {1.0f, a1}};
+template<int Order>
+struct IirCoeffs
+{
+  float b[Order+1];
+  float a[Order+1];
+};
+
+
+//###################################################################################
+//                              IIR FILTER CLASS
+//###################################################################################
+// y[n] = sum_k(b[k]*x[n-k]) - sum_k>0(a[k]*y[n-k])
+// Past inputs/outputs are shifted at each sample (nothing to shift for order 1).
+template<int Order, const IirCoeffs<Order> &C>
+class IirFilter
+{
+  static_assert(Order>0, "IIR filter order must be >0");
+  static_assert(C.a[0]==1.0f, "IIR filter coefficients must be normalised (a[0]=1)");
+
+  public:
+    IirFilter()
+    {
+      Reset();
+    }
+
+    void Reset(float v=0)
+    {
+      for(int k=0; k<Order; k++)
+      {
+        X[k]=v;
+        Y[k]=v;
+      }
+    }
+
+    //Filter a new sample and return the filtered value
+    float Filter(float xn)
+    {
+      float yn=C.b[0]*xn;
+      for(int k=1; k<=Order; k++)
+        yn+=C.b[k]*X[k-1];
+      for(int k=1; k<=Order; k++)
+        yn-=C.a[k]*Y[k-1];
+
+      for(int k=Order-1; k>0; k--)
+      {
+        X[k]=X[k-1];
+        Y[k]=Y[k-1];
+      }
+      X[0]=xn;
+      Y[0]=yn;
+
+      return yn;
+    }
+
+    //Last filtered value
+    float Value()
+    {
+      return Y[0];
+    }
+
+  private:
+    float X[Order], Y[Order]; //x[n-1-k] and y[n-1-k] at k
+};
+//-----------------------------------------------------------------------------------
+//-----------------------------------------------------------------------------------
+//-----------------------------------------------------------------------------------
+
+#endif
@@ -0,0 +1,96 @@
+/** ShoulderTracking device firmware
+ *
+ * Copyright Vincent Crocher - Unimelb - 2016, 2020
+ * License MIT license
+ */
+#include <Arduino.h>
+#include <EEPROM.h>
+
+//Calibration (as exchanged with the host, CDC, and stored in EEPROM): 'E', hard iron offsets
+//(3 x int16), soft iron matrix (3x3 int16 Q12, row major), checksum. All LSB first.
+#define MAG_CALIB_SIZE (1+3*2+9*2+1)
+#define MAG_CALIB_Q 12
+#define MAG_CALIB_STREAM_DECIMATION 2 //Raw samples streamed every 2 loops (50Hz) in calibration mode
+
+#include "EepromMap.h"
+
+
+//###################################################################################
+//                         MAGNETOMETER CALIBRATION CLASS
+//###################################################################################
+// Ellipsoid (hard and soft iron) correction of the raw magnetometer values:
+// m_corrected = W.(m_raw-offset). W and offset are fitted on the host from raw samples
+// streamed in calibration mode (CDM). Without ellipsoid calibration, falls back to the
+// min/max (hard iron only) values of the CalibrateMag sketch (W identity).
+class MagCalibration
+{
+  public:
+    MagCalibration()
+    {
+      SetHardIron(0, 0, 0);
+    }
+
+    //Hard iron only correction (W identity)
+    void SetHardIron(int16_t ox, int16_t oy, int16_t oz)
+    {
+      Offset[0]=ox;
+      Offset[1]=oy;
+      Offset[2]=oz;
+      for(int i=0; i<3; i++)
+        for(int j=0; j<3; j++)
+          W[i][j]=(i==j)?(1<<MAG_CALIB_Q):0;
+    }
+
+    bool Check(const uint8_t *calib)
+    {
+      uint8_t sum=0;
+      for(int i=0; i<MAG_CALIB_SIZE-1; i++)
+        sum+=calib[i];
+      return calib[0]=='E' && calib[MAG_CALIB_SIZE-1]==(uint8_t)~sum;
+    }
+
+    //Apply a (checked) calibration
+    void Set(const uint8_t *calib)
+    {
+      const uint8_t *b=calib+1;
+      for(int i=0; i<3; i++, b+=2)
+        Offset[i]=b[0] | (b[1]<<8);
+      for(int i=0; i<3; i++)
+        for(int j=0; j<3; j++, b+=2)
+          W[i][j]=b[0] | (b[1]<<8);
+    }
+
+    //Blocking (~90ms): only on host request
+    void Save(const uint8_t *calib)
+    {
+      for(int i=0; i<MAG_CALIB_SIZE; i++)
+        EEPROM.update(EE_MAG_ELLIPSOID_ADDR+i, calib[i]);
+    }
+
+    //Apply the ellipsoid calibration stored in EEPROM, if any
+    bool Load()
+    {
+      uint8_t calib[MAG_CALIB_SIZE];
+      for(int i=0; i<MAG_CALIB_SIZE; i++)
+        calib[i]=EEPROM.read(EE_MAG_ELLIPSOID_ADDR+i);
+      if(!Check(calib))
+        return false;
+      Set(calib);
+      return true;
+    }
+
+    //Corrected values (same scale as raw ones)
+    void Apply(int16_t mx, int16_t my, int16_t mz, int32_t *out)
+    {
+      int32_t m[3]={(int32_t)mx-Offset[0], (int32_t)my-Offset[1], (int32_t)mz-Offset[2]};
+      for(int i=0; i<3; i++)
+        out[i]=((int32_t)W[i][0]*m[0] + (int32_t)W[i][1]*m[1] + (int32_t)W[i][2]*m[2])>>MAG_CALIB_Q;
+    }
+
+  private:
+    int16_t Offset[3];
+    int16_t W[3][3];
+};
+//-----------------------------------------------------------------------------------
+//-----------------------------------------------------------------------------------
+//-----------------------------------------------------------------------------------
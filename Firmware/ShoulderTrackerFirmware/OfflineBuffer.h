@@ -0,0 +1,152 @@
+/** ShoulderTracking device firmware
+ *
+ * Copyright Vincent Crocher - Unimelb - 2016, 2020
+ * License MIT license
+ */
+#include <Arduino.h>
+#include <EEPROM.h>
+
+#define OFFLINE_PERIOD_MS 1000 //One record per second: the record sequence nb is the device time in s
+//Record: sequence nb (uint16, LSB first), flags (see OFFLINE_FLAG_*), angle1 and angle2 (int8, deg),
+//max linear velocity (uint8, cm.s-1) and max angular velocity (uint8, deg.s-1) over the period
+#define OFFLINE_RECORD_SIZE 7
+#define OFFLINE_FLAG_DYNAMIC 0x01
+#define OFFLINE_FLAG_TESTING 0x02
+#define OFFLINE_FLAG_FEEDBACK 0x04 //Feedback was given during the period
+#define OFFLINE_DUMP_MAX 8 //Max nb of records per CDO reply (must fit in the TX queue)
+
+#include "EepromMap.h"
+
+#define OFFLINE_NB_RECORDS (EE_OFFLINE_SIZE/OFFLINE_RECORD_SIZE)
+
+
+//###################################################################################
+//                            OFFLINE BUFFER CLASS
+//###################################################################################
+// Ring buffer of decimated values in EEPROM (~90s at 1 record/s) so that the host can
+// fill the holes of its log after a link drop (CDO). Records are written one byte per
+// call to Pump() as for the ThresholdStore (never blocks the loop). Only the records of
+// the current power cycle are kept track of (in RAM): nothing is read back at startup.
+// Wear: each EEPROM byte is rewritten every ~90s of running time, i.e. 100k cycles
+// after ~2500h of use.
+class OfflineBuffer
+{
+  public:
+    OfflineBuffer()
+    {
+      Head=0;
+      Nb=0;
+      NbWritten=0;
+      NbToWrite=0;
+      NbSamples=0;
+      NbDropped=0;
+    }
+
+    //Add a (running) loop values: a record is started each time seq changes
+    void Store(uint16_t seq, uint8_t flags, int angle1, int angle2, float lin_vel, float ang_vel)
+    {
+      if(NbSamples>0 && seq!=Seq)
+        StartRecord();
+
+      if(NbSamples==0)
+      {
+        Seq=seq;
+        Flags=0;
+        MaxLinVel=0;
+        MaxAngVel=0;
+      }
+      NbSamples++;
+      Flags|=flags;
+      Angle[0]=constrain(angle1, -127, 127);
+      Angle[1]=constrain(angle2, -127, 127);
+      if(lin_vel>MaxLinVel)
+        MaxLinVel=lin_vel;
+      if(ang_vel>MaxAngVel)
+        MaxAngVel=ang_vel;
+    }
+
+    //Write the next byte of the pending record, if any. Call once per loop.
+    //Return true if a byte was written.
+    bool Pump()
+    {
+      if(NbWritten>=NbToWrite)
+        return false;
+
+      EEPROM.update(RecordAddr(Head)+NbWritten, Record[NbWritten]);
+      NbWritten++;
+      //Record complete: now available
+      if(NbWritten==NbToWrite)
+      {
+        Head=(Head+1)%OFFLINE_NB_RECORDS;
+        Nb++;
+      }
+      return true;
+    }
+
+    //Copy up to max_nb records (oldest first) with a sequence nb after from_seq.
+    //Return the nb of records copied.
+    int Get(uint16_t from_seq, uint8_t *records, int max_nb)
+    {
+      int nb=0;
+      for(int i=0; i<Nb && nb<max_nb; i++)
+      {
+        int addr=RecordAddr((Head+OFFLINE_NB_RECORDS-Nb+i)%OFFLINE_NB_RECORDS);
+        uint16_t seq=EEPROM.read(addr) | (EEPROM.read(addr+1)<<8);
+        //Sequence nb wraps around: compare differences
+        if((int16_t)(seq-from_seq)>0)
+        {
+          for(int k=0; k<OFFLINE_RECORD_SIZE; k++)
+            records[nb*OFFLINE_RECORD_SIZE+k]=EEPROM.read(addr+k);
+          nb++;
+        }
+      }
+      return nb;
+    }
+
+    unsigned int NbDropped; //Records not stored because the EEPROM was still busy
+
+  private:
+    //Close the current period: build its record and queue it for writing
+    void StartRecord()
+    {
+      NbSamples=0;
+      if(NbWritten<NbToWrite)
+      {
+        NbDropped++;
+        return;
+      }
+
+      Record[0]=lowByte(Seq);
+      Record[1]=highByte(Seq);
+      Record[2]=Flags;
+      Record[3]=(int8_t)Angle[0];
+      Record[4]=(int8_t)Angle[1];
+      Record[5]=(MaxLinVel*100>255)?255:(uint8_t)(MaxLinVel*100);
+      Record[6]=(MaxAngVel>255)?255:(uint8_t)MaxAngVel;
+      //Oldest record is being overwritten
+      if(Nb==OFFLINE_NB_RECORDS)
+        Nb--;
+      NbWritten=0;
+      NbToWrite=OFFLINE_RECORD_SIZE;
+    }
+
+    int RecordAddr(int idx)
+    {
+      return EE_OFFLINE_ADDR+idx*OFFLINE_RECORD_SIZE;
+    }
+
+    //Ring buffer: Head is the next record to write, Nb the nb of valid records before it
+    int Head, Nb;
+    uint8_t Record[OFFLINE_RECORD_SIZE];
+    uint8_t NbWritten, NbToWrite;
+
+    //Period being accumulated
+    uint16_t Seq;
+    uint8_t Flags;
+    int Angle[2];
+    float MaxLinVel, MaxAngVel;
+    unsigned int NbSamples;
+};
+//-----------------------------------------------------------------------------------
+//-----------------------------------------------------------------------------------
+//-----------------------------------------------------------------------------------
@@ -0,0 +1,128 @@
+/** ShoulderTracking device firmware
+ *
+ * Copyright Vincent Crocher - Unimelb - 2016, 2020
+ * License MIT license
+ */
+#include <Arduino.h>
+
+#define FUSION //Gyro/accelero/magneto fusion for the trunk angles (comment to use raw atan2 and magnetometer heading)
+
+//All angles are fixed point degrees Q8 (1deg = 256) in int32
+#define DEG_2_Q8 256
+#define Q8_180 (180L*DEG_2_Q8)
+#define Q8_360 (360L*DEG_2_Q8)
+
+//Complementary filter gains, as right shifts: correction of 1/2^K of the error at each update
+//=> time constant of 2^K updates (0.64s for the accelero at 100Hz, 1.28s for the magneto at 10Hz)
+#define FUSION_ACC_SHIFT 6
+#define FUSION_MAG_SHIFT 4
+
+//Gyro raw (8.75mdps/LSB at default 245dps full scale, both L3G and LSM6) x dt(us) to Q8 degrees:
+//8.75e-3 * 1e-6 * 256 = 2.24e-6 = ~150/2^26, applied as ((raw*dt)>>10)*150>>16 to stay in int32
+#define GYRO_DT_2_Q8_MUL 150
+#define FUSION_MAX_DT_US 50000 //Longer loops (e.g. after a blocking command) are clamped
+
+
+//Wrap a Q8 angle in [-180, 180[
+int32_t WrapQ8(int32_t a)
+{
+  //Usual case tested first: the loops are otherwise compiled to a 32-bit division at each call
+  if(a>=-Q8_180 && a<Q8_180)
+    return a;
+  while(a>=Q8_180)
+    a-=Q8_360;
+  while(a<-Q8_180)
+    a+=Q8_360;
+  return a;
+}
+
+//Fixed point atan2 in Q8 degrees (max error ~0.25deg): one division, no float.
+//atan(r) ~= 45r + 15.64r(1-|r|) for |r|<=1 (r in Q15 here).
+int32_t Atan2Q8(int32_t y, int32_t x)
+{
+  if(x==0 && y==0)
+    return 0;
+
+  int32_t ax=(x<0)?-x:x;
+  int32_t ay=(y<0)?-y:y;
+  int32_t r, a;
+  if(ay<=ax)
+  {
+    r=(ay<<15)/ax; //Q15, [0, 1]
+    a=(11520L*r + 4004L*((r*(32768L-r))>>15))>>15; //45*256=11520, 15.64*256=4004
+  }
+  else
+  {
+    r=(ax<<15)/ay;
+    a=90L*DEG_2_Q8 - ((11520L*r + 4004L*((r*(32768L-r))>>15))>>15);
+  }
+
+  //Quadrant
+  if(x<0)
+    a=Q8_180-a;
+  if(y<0)
+    a=-a;
+  return a;
+}
+
+
+//###################################################################################
+//                            ORIENTATION FILTER CLASS
+//###################################################################################
+// Complementary filter in fixed point for the two trunk angles used in STATIC mode:
+// -coronal angle (rotation around y): gyro integration corrected by the accelerometers angle
+// -heading (rotation around vertical): tilt compensated gyro integration corrected by the
+//  magnetometer heading, which is only computed at the magnetometer rate (see MAG_DECIMATION).
+// Conventions: g and a are in the same sensor frame (same chip on the LSM6, aligned board
+// axes assumed for the V1 L3G/LSM303 pair), a being the specific force (+1g up at rest):
+// with coronal=atan2(ax,-az), da/dt=-w x a gives d(coronal)/dt=+gy, and -g.a/|a| is the rate
+// around the down axis, positive in the sense the magnetometer heading increases.
+// Cost (16MHz AVR): Update() takes ~2030 cycles (~127us, 2008 to 2055 over 2000 realistic
+// samples), counted in an instruction level simulation of the -Os build (libgcc mul/div
+// routines), a third of it in the Atan2Q8 division. A wrap over more than one turn adds one
+// division (~4700 cycles worst case). PROF_ANGLES (CDX) gives the on device figure, which
+// also includes GetAngleAcc()/GetAngleMag() and the decimated CorrectHeading().
+class OrientationFilter
+{
+  public:
+    OrientationFilter()
+    {
+      Reset(0, 0);
+    }
+
+    void Reset(int32_t coronal_q8, int32_t heading_q8)
+    {
+      Coronal=coronal_q8;
+      Heading=WrapQ8(heading_q8);
+    }
+
+    //Gyro propagation and accelerometer correction. g and a are raw sensor values.
+    void Update(int16_t gx, int16_t gy, int16_t gz, int16_t ax, int16_t ay, int16_t az, unsigned long int dt_us)
+    {
+      int32_t dt=(dt_us>FUSION_MAX_DT_US)?FUSION_MAX_DT_US:dt_us;
+
+      //Coronal: rotation around y
+      Coronal+=((((int32_t)gy*dt)>>10)*GYRO_DT_2_Q8_MUL)>>16;
+      Coronal+=WrapQ8(Atan2Q8(ax, -az)-Coronal)>>FUSION_ACC_SHIFT;
+
+      //Heading: rotation around the vertical (down) axis, i.e. -g.a/|a| with |a|~1g=2^14 LSB
+      int32_t g_down=-((((int32_t)gx*ax)>>14) + (((int32_t)gy*ay)>>14) + (((int32_t)gz*az)>>14));
+      Heading=WrapQ8(Heading + (((g_down*dt)>>10)*GYRO_DT_2_Q8_MUL>>16));
+    }
+
+    //Magnetometer heading correction (in degrees), at the magnetometer rate
+    void CorrectHeading(float mag_heading)
+    {
+      int32_t err=WrapQ8((int32_t)(mag_heading*DEG_2_Q8)-Heading);
+      Heading=WrapQ8(Heading+(err>>FUSION_MAG_SHIFT));
+    }
+
+    float GetCoronal() {return Coronal/(float)DEG_2_Q8;}
+    float GetHeading() {return Heading/(float)DEG_2_Q8;}
+
+  private:
+    int32_t Coronal, Heading;
+};
+//-----------------------------------------------------------------------------------
+//-----------------------------------------------------------------------------------
+//-----------------------------------------------------------------------------------
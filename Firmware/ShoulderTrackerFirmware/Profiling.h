@@ -0,0 +1,85 @@
+/** ShoulderTracking device firmware
+ *
+ * Copyright Vincent Crocher - Unimelb - 2016, 2020
+ * License MIT license
+ */
+#include <Arduino.h>
+
+#define PROFILE //Loop stages timing (comment to remove the overhead: ~10us per loop)
+
+//Loop stages being timed (order is the one of the CDX record, keep host in sync)
+enum PROFILE_STAGE {PROF_IMU, PROF_ANGLES, PROF_VELOCITIES, PROF_BACKGROUND, PROF_THRESHOLD, PROF_FEEDBACK, PROF_TX, PROF_LOOP, PROF_NB_STAGES};
+
+
+//###################################################################################
+//                            PROFILER CLASS
+//###################################################################################
+// Accumulate min/avg/max duration (in us, 4us resolution on 16MHz AVR) of each loop stage.
+// Usage: Start() then Stop(stage) at the end of the stage. Stop() restarts the
+// timer so consecutive stages can be chained.
+class LoopProfiler
+{
+  public:
+    LoopProfiler()
+    {
+      Reset();
+    }
+
+    void Reset()
+    {
+      for(int i=0; i<PROF_NB_STAGES; i++)
+      {
+        Min[i]=65535;
+        Max[i]=0;
+        Sum[i]=0;
+        Nb[i]=0;
+      }
+    }
+
+    void Start()
+    {
+      #ifdef PROFILE
+        T0=micros();
+      #endif
+    }
+
+    void Stop(PROFILE_STAGE s)
+    {
+      #ifdef PROFILE
+        unsigned long int now=micros();
+        Add(s, now-T0);
+        T0=now;
+      #endif
+    }
+
+    //Add an externally measured duration
+    void Add(PROFILE_STAGE s, unsigned long int dt_us)
+    {
+      unsigned int dt=(dt_us>65535)?65535:dt_us;
+      if(dt<Min[s])
+        Min[s]=dt;
+      if(dt>Max[s])
+        Max[s]=dt;
+      //16-bit count: halve the accumulation when full (average unchanged)
+      if(Nb[s]==65535)
+      {
+        Sum[s]/=2;
+        Nb[s]/=2;
+      }
+      Sum[s]+=dt;
+      Nb[s]++;
+    }
+
+    unsigned int GetMin(int s) {return Nb[s]>0?Min[s]:0;}
+    unsigned int GetMax(int s) {return Max[s];}
+    unsigned int GetAvg(int s) {return Nb[s]>0?Sum[s]/Nb[s]:0;}
+
+  private:
+    unsigned int Min[PROF_NB_STAGES], Max[PROF_NB_STAGES];
+    unsigned long int Sum[PROF_NB_STAGES];
+    unsigned int Nb[PROF_NB_STAGES];
+    unsigned long int T0;
+};
+//-----------------------------------------------------------------------------------
+//-----------------------------------------------------------------------------------
+//-----------------------------------------------------------------------------------
@@ -11,10 +11,32 @@
  *		-CDT: Test mode (log, no feedback).
  *		-CDS: Switch to STATIC mode (feedback on log are angles).
  *		-CDD: Switch to DYNAMIC mode (feedback on angular velocity).
+ *		-CDJ: Loop jitter report. Response: OKJ followed by binary (LSB first) nb of loops (uint32), nb of overruns (uint32),
+ *		      max loop period in us (uint16, saturated at 65535), nb of dropped TX frames (uint16), max TX queue fill in bytes (uint16),
+ *		      loop active (not sleeping) time in 1/1000 (uint16) and CRLF.
+ *		-CDG: Get adaptive thresholds profile (of current mode). Response: OKG followed by the profile (see ThresholdStore.h) and CRLF, or E3 if nothing learnt yet.
+ *		-CDW: Write adaptive thresholds profile: followed by the profile bytes. Applied now if of the current mode and saved in EEPROM. Response: OKW or E3 if invalid.
+ *		-CDO: Offline records dump: followed by a sequence nb (uint16, LSB first). Response: OKO followed by the nb of records (uint8, max 8)
+ *		      then 8 records (see OfflineBuffer.h, only the first nb are valid) with a sequence nb (device time in s) after the given one,
+ *		      oldest first, and CRLF (fixed length reply).
+ *		      Repeat with the last received sequence nb until less than 8 records are returned.
+ *		-CDM: Magnetometer calibration mode: followed by 1 (start) or 0 (stop) (uint8). Response: OKM. When started (at 80Hz magnetometer rate),
+ *		      raw magnetometer values are streamed in frames of the form MC followed by x, y, z (3 x int16, LSB first) and CRLF (also when paused).
+ *		-CDC: Write magnetometer calibration: followed by the calibration bytes (see MagCalibration.h). Applied and saved in EEPROM. Response: OKC or E3 if invalid.
+ *		-CDV: Set parameter: followed by the parameter id (uint8, see PARAMETER) and value (int16, LSB first). Response: OKV followed by
+ *		      the id (uint8) and the applied value (int16, after range limitation) and CRLF, or E3 if unknown parameter.
+ *		-CDU: Get parameter: followed by the parameter id (uint8). Response: OKU followed by id (uint8) and value (int16) and CRLF, or E3.
+ *		-CDX: Loop profile. Response: OKX followed by the nb of stages (uint8) then for each stage (see PROFILE_STAGE)
+ *		      min, avg and max duration in us (3 x uint16, LSB first) and CRLF. Counters are reset after each query.
  *   Response in the form OKxy with x=[S/D] the current/applied mode and y=[R/T/P] the current state.
+ *   Commands are parsed as they are received (see CommandParser.h) and executed in order, one per loop. Errors: E1 invalid
+ *   bytes (not CD), E2 unknown command, E3 invalid parameters or incomplete command (timeout).
  *	* Log: when not in pause, in simple logging (not binary) device will continously send a trame of the following values:
  * 			[S/D][R/T]time,angle1,angle2,velocity1,velocity2,threshold1,threshold2\n\r
  *		ex:	ST12.32,32.2,6.3,36.1,6.5 in STATIC mode, testing. time is time since initiation in seconds. Angles are in degrees, velocities in deg.s-1 and m.s-1.
+ *	  In binary logging: [S/D][R/T] time in ms (uint32), angles (2 x int8), velocities x1000 (2 x uint16), thresholds x100 (2 x uint16) and CRLF,
+ *	  every LogDecimation loops. With a batch size >1 (CDV), batch frames instead: [s/d][R/T] time in ms of the last sample (uint32),
+ *	  nb of samples (uint8), for each sample angles and velocities (as above), thresholds of the last sample and CRLF.
  *		
  *
  */
@@ -27,8 +49,15 @@
 #define V2_ALTIMUv10 //For use with AltIMU-10 v5: https://www.pololu.com/product/2739
 
 #include "AdaptiveThresholding.h"
-#include "StaticParam.h"
 #include "Filter.h"
+#include "StaticParam.h"
+#include "TxQueue.h"
+#include "Profiling.h"
+#include "Orientation.h"
+#include "ThresholdStore.h"
+#include "OfflineBuffer.h"
+#include "MagCalibration.h"
+#include "CommandParser.h"
 
 //#define MUTE //Sound is annoying when debugging...
 #define LOG //Send values over serial
@@ -37,10 +66,28 @@
 
 unsigned long int t, Dt;
 
+//Loop timing
+const unsigned long int period_us=10000; //Fixed update rate of 100Hz
+const unsigned long int overrun_us=period_us+period_us/10; //A loop longer than this is counted as an overrun
+unsigned long int NbLoops=0, NbOverruns=0, MaxDt=0;
+
+//All serial output goes through this queue so that the loop never blocks on TX
+TxQueue Tx;
+LoopProfiler Profiler;
+
+//Sensor fusion: heading correction is only computed at the magnetometer rate (10Hz by default)
+#define MAG_DECIMATION 10
+OrientationFilter Orientation;
+unsigned char MagDecimationCount=0;
+
+//Magnetometer calibration and raw values streaming (calibration mode)
+MagCalibration MagCal;
+bool MagStreaming=false;
+unsigned char MagStreamCount=0;
+
 Static_param Static;
 Dynamic_param Dynamic;
 MODE Mode;
-Filter hp_filter;
 
 #ifdef V1_IMU02A
 L3G gyro; //Gyroscopes
@@ -52,7 +99,14 @@ LSM6 gyro; //Gyroscopes and accelerometers
 LIS3MDL compass; //Magnetometers
 #endif
 
-int Sensitivity=85; //0-100%: the higher the less sensitive
+//Measured values (computed depending on the mode, see ModePipeline)
+int CoronalPlaneAngle=0, TransversePlaneAngle=0;
+float LinearVelocity=0, AngularVelocity=0;
+#define BACKGROUND_DECIMATION 10 //Background tasks run every 10 loops (10Hz)
+unsigned char BackgroundCount=0;
+unsigned long int BackgroundDt=0; //Time since the last background tasks run (us)
+
+int Sensitivity=85; //0-99%: the higher the less sensitive
 AdaptiveThresholding AdaptThresh[2];
 float MinimalThresh[2]; //Minimal values: threshold c'ant be lower than these: see InitDynamic / InitStatic for values
 
@@ -63,6 +117,37 @@ bool Testing;
 unsigned long int LastActivityInS = 0;
 unsigned long int MaxInactivityBeforeSleepInS = 15*60; //Time of inactivity before device goes to sleep forever (in S)
 
+//Duty cycling
+#define DUTY_CYCLING //Sleep (IDLE mode) between samples instead of spinning
+const unsigned long int min_sleep_us=1500; //No sleep when less remains (wake up is on timer0 tick, every ~1ms)
+unsigned long int LowActivityDelayInS = 60; //Time of inactivity before switching the IMU to reduced rate (in S)
+bool ReducedRate=false;
+unsigned long int SleepUs=0, TotalUs=0; //For loop active ratio
+
+//Commands from the host and parameters which can be set (CDV/CDU)
+CommandParser Commands;
+enum PARAMETER {PARAM_SENSITIVITY, PARAM_MIN_THRESH_1, PARAM_MIN_THRESH_2, PARAM_LOG_DECIMATION, PARAM_SLEEP_DELAY, PARAM_BATCH_SIZE, PARAM_NB};
+unsigned char LogDecimation=1; //Send one log frame every LogDecimation loops
+unsigned char LogCount=0;
+
+//Batch frames: several samples per frame, less bytes per sample (set by the host when the link degrades)
+#define MAX_BATCH_SIZE 4 //2+4+1+4*(1+1+2+2)+2*2+2=37 bytes: must fit in the TX queue
+typedef struct
+{
+  int Angle[2];
+  unsigned int Vel[2]; //x1000
+} BatchSample;
+BatchSample Batch[MAX_BATCH_SIZE];
+unsigned char BatchSize=1, BatchNb=0;
+
+//Adaptive thresholds persistence
+ThresholdStore ThreshStore;
+unsigned long int CheckpointPeriodInS = 5*60; //Periodic save of the thresholds while running (in S)
+unsigned long int LastCheckpointInS = 0;
+
+//Decimated values kept in EEPROM for the host to recover link drops
+OfflineBuffer Offline;
+
 
 //###################################################################################
 //                              ACTION FUNCTIONS 
@@ -140,42 +225,78 @@ void Beep()
 //###################################################################################
 void GoToSleep()
 {
+  //Save thresholds
+  ThreshStore.Checkpoint(Mode, AdaptThresh);
+  ThreshStore.Flush();
+  //Send what is left before sleeping
+  Tx.Drain();
   //Sleep forever
   LowPower.powerDown(SLEEP_FOREVER, ADC_OFF, BOD_OFF);
 }
-//-----------------------------------------------------------------------------------
-//-----------------------------------------------------------------------------------
-//-----------------------------------------------------------------------------------
 
-
-//###################################################################################
-//                             FILTERING FUNCTIONS 
-//###################################################################################
-float filt(Dynamic_param *d, float x)
+//Wait for the end of the current period: send queued bytes and sleep in between.
+//IDLE mode is used as it is the only one waking up on timer0 (millis/micros), USART and
+//keeping PWM timers running (feedback). The ADC noise reduction mode stops timer0.
+void WaitNextPeriod()
 {
-  for(int k=0; k<FILT_ORDER_LP-1; k++)
-  {
-    d->v[k]=d->v[k+1];
-    d->vf[k]=d->vf[k+1];
+  unsigned long int elapsed;
+  while((elapsed=micros()-t)<period_us) { //delayMicroseconds doesn't work...
+    Tx.Pump();
+    #ifdef DUTY_CYCLING
+      if(period_us-elapsed>min_sleep_us)
+      {
+        unsigned long int t_sleep=micros();
+        LowPower.idle(SLEEP_FOREVER, ADC_OFF, TIMER2_ON, TIMER1_OFF, TIMER0_ON, SPI_OFF, USART0_ON, TWI_ON);
+        SleepUs+=micros()-t_sleep;
+      }
+    #endif
   }
-  d->v[FILT_ORDER_LP-1]=x;
-  d->vf[FILT_ORDER_LP-1]=0;
-  
-  for(int k=0; k<FILT_ORDER_LP; k++)
-    d->vf[FILT_ORDER_LP-1]+=FILT_COEFS_b[k]*d->v[FILT_ORDER_LP-k-1];
- 
-  for(int k=1; k<FILT_ORDER_LP; k++)
-    d->vf[FILT_ORDER_LP-1]-=FILT_COEFS_a[k]*d->vf[FILT_ORDER_LP-k-1];
+}
+
+//Reduce the IMU output data rates (and power) when paused or not moving, back to default otherwise
+void SetReducedRate(bool reduced)
+{
+  #ifdef V2_ALTIMUv10
+    if(reduced)
+    {
+      gyro.writeReg(LSM6::CTRL1_XL, 0x30); //52Hz, +-2g
+      gyro.writeReg(LSM6::CTRL2_G, 0x30); //52Hz, 245dps
+      gyro.writeReg(LSM6::CTRL6_C, 0x10); //Accelerometer high performance mode off
+      gyro.writeReg(LSM6::CTRL7_G, 0x80); //Gyro high performance mode off
+      compass.writeReg(LIS3MDL::CTRL_REG1, 0x10); //X/Y low power mode, 10Hz
+      compass.writeReg(LIS3MDL::CTRL_REG4, 0x00); //Z low power mode
+    }
+    else
+    {
+      //As per enableDefault()
+      gyro.writeReg(LSM6::CTRL6_C, 0x00);
+      gyro.writeReg(LSM6::CTRL7_G, 0x00);
+      gyro.writeReg(LSM6::CTRL1_XL, 0x80);
+      gyro.writeReg(LSM6::CTRL2_G, 0x80);
+      compass.writeReg(LIS3MDL::CTRL_REG1, 0x70);
+      compass.writeReg(LIS3MDL::CTRL_REG4, 0x0C);
+    }
+  #endif
+  //V1 (MinIMU-9 v3): left at default rates
+  ReducedRate=reduced;
+}
 
-  return d->vf[FILT_ORDER_LP-1];
+//Calibration mode: stream raw magnetometer values (at a higher rate to collect samples quickly)
+void SetMagStreaming(bool on)
+{
+  SetReducedRate(false);
+  #ifdef V2_ALTIMUv10
+    if(on)
+      compass.writeReg(LIS3MDL::CTRL_REG1, 0x7C); //Ultra high performance, 80Hz
+  #endif
+  MagStreaming=on;
+  MagStreamCount=0;
 }
 //-----------------------------------------------------------------------------------
 //-----------------------------------------------------------------------------------
 //-----------------------------------------------------------------------------------
 
 
-
-
 //###################################################################################
 //                         SENSOR PROCESSING FUNCTIONS 
 //###################################################################################
@@ -194,8 +315,12 @@ float GetAngleAcc(Static_param *s)
 		s->A[2]=gyro.a.z;
 	#endif
 
-  //Angle between X and Y projections of gravity
-  return atan2(s->A[0], -s->A[2])*180/PI;
+  #ifdef FUSION
+    return Orientation.GetCoronal();
+  #else
+    //Angle between X and Y projections of gravity
+    return atan2(s->A[0], -s->A[2])*180/PI;
+  #endif
 }
 
 float GetHeading(Static_param *s)
@@ -206,12 +331,10 @@ float GetHeading(Static_param *s)
 	#ifdef V2_ALTIMUv10 //
 		//Compute heading based on accelerometer and magnetometer values
 		//(heading not directly provided by library (no accelero))
-		LIS3MDL::vector<int32_t> temp_m = {compass.m.x, compass.m.y, compass.m.z};
-
-		// subtract offset (average of min and max) from magnetometer readings
-		temp_m.x -= ((int32_t)m_min.x + m_max.x) / 2;
-		temp_m.y -= ((int32_t)m_min.y + m_max.y) / 2;
-		temp_m.z -= ((int32_t)m_min.z + m_max.z) / 2;
+		// calibrated magnetometer readings (hard and soft iron, see MagCalibration)
+		int32_t m_cal[3];
+		MagCal.Apply(compass.m.x, compass.m.y, compass.m.z, m_cal);
+		LIS3MDL::vector<int32_t> temp_m = {m_cal[0], m_cal[1], m_cal[2]};
 
 		// compute E and N
 		LIS3MDL::vector<float> E;
@@ -233,13 +356,37 @@ float GetHeading(Static_param *s)
 //Horizontal angle from magnetometer
 float GetAngleMag(Static_param *s)
 {
-	return GetHeading(s)-s->MAngleRef;
+  #ifdef FUSION
+    return WrapQ8((int32_t)((Orientation.GetHeading()-s->MAngleRef)*DEG_2_Q8))/(float)DEG_2_Q8;
+  #else
+    return GetHeading(s)-s->MAngleRef;
+  #endif
+}
+
+//Sensor fusion update (gyro integration, accelero and magneto corrections): call once per loop
+void UpdateOrientation()
+{
+  #ifdef FUSION
+    #ifdef V1_IMU02A
+      Orientation.Update(gyro.g.x, gyro.g.y, gyro.g.z, compass.a.x, compass.a.y, compass.a.z, Dt);
+    #endif
+    #ifdef V2_ALTIMUv10
+      Orientation.Update(gyro.g.x, gyro.g.y, gyro.g.z, gyro.a.x, gyro.a.y, gyro.a.z, Dt);
+    #endif
+
+    MagDecimationCount++;
+    if(MagDecimationCount>=MAG_DECIMATION)
+    {
+      Orientation.CorrectHeading(GetHeading(&Static));
+      MagDecimationCount=0;
+    }
+  #endif
 }
 
 
 
-//Linear velocity: integrate and filter acceleration
-float GetLinVel(Dynamic_param *d)
+//Linear velocity: integrate and filter acceleration (dt: time since the previous call)
+float GetLinVel(Dynamic_param *d, unsigned long int dt)
 {
 	float a[3];
 	#ifdef V1_IMU02A
@@ -264,9 +411,9 @@ float GetLinVel(Dynamic_param *d)
 
 	//and compute linear velocity
 	//d->v_c += (d->A[0]+(d->A[1]-d->A[0])/2.)*Dt/1000000.; //Integration w/ conversion from us to s
-	d->v_c += ((d->A[0]+4*d->A[1]+d->A[0])/2.)/6 * 2*Dt/1000000.; //Integration w/ conversion from us to s
+	d->v_c += ((d->A[0]+4*d->A[1]+d->A[0])/2.)/6 * 2*dt/1000000.; //Integration w/ conversion from us to s
 	//Serial.print(10000*V);Serial.print(" , ");
-  float v=filt(d, d->v_c);
+  float v=d->VelFilter.Filter(d->v_c);
 	return abs(v);//WARNING: need to be in two lines as Arduino has a crappy abs() function implementation
 }
 
@@ -275,6 +422,80 @@ float GetAngVel()
 {
   return sqrt(gyro.g.x*GYRO_2_DPS*gyro.g.x*GYRO_2_DPS+gyro.g.y*GYRO_2_DPS*gyro.g.y*GYRO_2_DPS+gyro.g.z*GYRO_2_DPS*gyro.g.z*GYRO_2_DPS);
 }
+
+//Angles without fusion (accelerometer and magnetometer only): for the log in DYNAMIC mode
+void GetRawAngles(int *coronal, int *transverse)
+{
+  #ifdef V1_IMU02A
+    *coronal=Atan2Q8(compass.a.x, -compass.a.z)/DEG_2_Q8;
+  #endif
+  #ifdef V2_ALTIMUv10
+    *coronal=Atan2Q8(gyro.a.x, -gyro.a.z)/DEG_2_Q8;
+  #endif
+  *transverse=WrapQ8((int32_t)((GetHeading(&Static)-Static.MAngleRef)*DEG_2_Q8))/DEG_2_Q8;
+}
+//-----------------------------------------------------------------------------------
+//-----------------------------------------------------------------------------------
+//-----------------------------------------------------------------------------------
+
+
+
+//###################################################################################
+//                                PIPELINE FUNCTIONS 
+//###################################################################################
+//Each loop, only the processing needed by the current mode feedback is done (ModePipeline[Mode]).
+//The values of the other mode (log only) and the activity detection are updated by the
+//background tasks at a lower rate (BACKGROUND_DECIMATION). Saved time goes to sleep (WaitNextPeriod).
+
+//STATIC: trunk angles (sensor fusion needs every sample)
+void ProcessStatic()
+{
+  UpdateOrientation();
+  CoronalPlaneAngle=(int)GetAngleAcc(&Static);
+  TransversePlaneAngle=(int)GetAngleMag(&Static);
+  Profiler.Stop(PROF_ANGLES);
+}
+
+//DYNAMIC: velocities (linear velocity integration and filter need every sample)
+void ProcessDynamic()
+{
+  LinearVelocity=GetLinVel(&Dynamic, Dt);
+  AngularVelocity=GetAngVel();
+  Profiler.Stop(PROF_VELOCITIES);
+}
+
+typedef void (*PipelineFunction)();
+const PipelineFunction ModePipeline[2]={ProcessStatic, ProcessDynamic}; //Indexed by MODE
+
+//Activity detection and other mode values (for the log: linear velocity integrated at the background
+//rate in STATIC mode, coarser than in DYNAMIC mode)
+void BackgroundTasks()
+{
+  if(Mode==STATIC)
+  {
+    AngularVelocity=GetAngVel();
+    LinearVelocity=GetLinVel(&Dynamic, BackgroundDt);
+  }
+  else
+  {
+    GetRawAngles(&CoronalPlaneAngle, &TransversePlaneAngle);
+  }
+
+  //Check if some movement or inactive (gyro based, above noise level)
+  if( AngularVelocity>0.04 )
+  {
+    LastActivityInS = millis()/1000.;
+  }
+
+  //Reduced IMU rate when paused or not moving
+  bool low_activity=(Pause && !MagStreaming) || ((millis()/1000.) - LastActivityInS > LowActivityDelayInS);
+  if(low_activity!=ReducedRate)
+  {
+    SetReducedRate(low_activity);
+  }
+
+  Profiler.Stop(PROF_BACKGROUND);
+}
 //-----------------------------------------------------------------------------------
 //-----------------------------------------------------------------------------------
 //-----------------------------------------------------------------------------------
@@ -291,6 +512,9 @@ void Init()
   compass.enableDefault();
   gyro.init();
   gyro.enableDefault();
+  ReducedRate=false;
+  if(MagStreaming)
+    SetMagStreaming(true);
   
 	switch(Mode)
 	{
@@ -317,18 +541,27 @@ void InitStatic()
   //ensure we have in a safe quadrant (switch sign of reference vector to do so)
   Static.HeadingSign=1;//default
   Static.MAngleRef=0;
-  if(fabs(GetAngleMag(&Static)>90))
+  if(fabs(GetHeading(&Static))>90)
   {
     Static.HeadingSign=-1;
   }
-  Static.MAngleRef=GetAngleMag(&Static);
+  Static.MAngleRef=GetHeading(&Static);
+
+  //Start fusion from the current (raw) angles
+  #ifdef V1_IMU02A
+    Orientation.Reset(Atan2Q8(compass.a.x, -compass.a.z), Static.MAngleRef*DEG_2_Q8);
+  #endif
+  #ifdef V2_ALTIMUv10
+    Orientation.Reset(Atan2Q8(gyro.a.x, -gyro.a.z), Static.MAngleRef*DEG_2_Q8);
+  #endif
 
 	//Init threshold arbitrarily to 20
 	Static.AngleThresh=20;
 
-	//Reinit adaptive threshold
+	//Reinit adaptive threshold and restart from the last saved ones if any
 	AdaptThresh[0].Reset(1);
 	AdaptThresh[1].Reset(1);
+	ThreshStore.Restore(STATIC, AdaptThresh);
 
 	//Reset minimal threshold values
 	MinimalThresh[0]=10.;//Ensure above noise level
@@ -346,9 +579,14 @@ void InitDynamic()
 
 	Bip();
 
-	//Reinit adaptive threshold
+	//Reinit adaptive threshold and restart from the last saved ones if any
 	AdaptThresh[0].Reset(10);
 	AdaptThresh[1].Reset(10);
+	ThreshStore.Restore(DYNAMIC, AdaptThresh);
+
+	//Restart velocity integration (only at the background rate in STATIC mode)
+	Dynamic.v_c=0;
+	Dynamic.VelFilter.Reset();
 
 	//Reset minimal threshold values
 	MinimalThresh[0]=0.3;//Ensure above noise level
@@ -364,13 +602,74 @@ void InitDynamic()
 
 
 
+//###################################################################################
+//                              PARAMETERS FUNCTIONS 
+//###################################################################################
+//Set a parameter (value in the units of the log: minimal thresholds x100) within its valid range
+//Minimal thresholds are the ones of the current mode (until next mode change)
+bool SetParameter(unsigned char id, int value)
+{
+  switch(id)
+  {
+    case PARAM_SENSITIVITY:
+      Sensitivity=constrain(value, 0, 99); //Percentile of the stored values
+      return true;
+    case PARAM_MIN_THRESH_1:
+    case PARAM_MIN_THRESH_2:
+      MinimalThresh[id-PARAM_MIN_THRESH_1]=max(value, 0)/100.;
+      return true;
+    case PARAM_LOG_DECIMATION:
+      LogDecimation=constrain(value, 1, 100);
+      return true;
+    case PARAM_SLEEP_DELAY:
+      MaxInactivityBeforeSleepInS=constrain(value, 60, 32767);
+      return true;
+    case PARAM_BATCH_SIZE:
+      BatchSize=constrain(value, 1, MAX_BATCH_SIZE);
+      BatchNb=0;
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool GetParameter(unsigned char id, int *value)
+{
+  switch(id)
+  {
+    case PARAM_SENSITIVITY:
+      *value=Sensitivity;
+      return true;
+    case PARAM_MIN_THRESH_1:
+    case PARAM_MIN_THRESH_2:
+      *value=MinimalThresh[id-PARAM_MIN_THRESH_1]*100;
+      return true;
+    case PARAM_LOG_DECIMATION:
+      *value=LogDecimation;
+      return true;
+    case PARAM_SLEEP_DELAY:
+      *value=MaxInactivityBeforeSleepInS;
+      return true;
+    case PARAM_BATCH_SIZE:
+      *value=BatchSize;
+      return true;
+    default:
+      return false;
+  }
+}
+//-----------------------------------------------------------------------------------
+//-----------------------------------------------------------------------------------
+//-----------------------------------------------------------------------------------
+
+
+
 //###################################################################################
 //                                PRINTING FUNCTIONS 
 //###################################################################################
 void PrintUInt8(unsigned int val)
 {
   char val8 = (abs(val)>255)?255:abs(val);
-  Serial.write(val8);
+  Tx.write(val8);
 }
 
 void PrintInt8(int val)
@@ -380,14 +679,14 @@ void PrintInt8(int val)
     val8 = (abs(val)>127)?127:abs(val);
   else
     val8 = (abs(val)>127)?-127:val;
-  Serial.write(val8);
+  Tx.write(val8);
 }
 
 void PrintUInt16(unsigned int val)
 {
   word val16 = (abs(val)>65535)?65535:abs(val);
-  Serial.write(lowByte(val16));
-  Serial.write(highByte(val16));
+  Tx.write(lowByte(val16));
+  Tx.write(highByte(val16));
 }
 
 void PrintInt16(int val)
@@ -398,8 +697,8 @@ void PrintInt16(int val)
   else
     val16 = (abs(val)>32767)?-32767:val;
   
-  Serial.write(lowByte(val16));
-  Serial.write(highByte(val16));
+  Tx.write(lowByte(val16));
+  Tx.write(highByte(val16));
 }
 
 void PrintUInt32(unsigned long int val)
@@ -433,8 +732,11 @@ void setup()
   EEPROM.get(eeAddress, m_max);
   if(m_min.x==0 || m_max.x==0)
   {
-    Serial.println("No magnetometer calibration found!");
+    Serial.println(F("No magnetometer calibration found!"));
   }
+  //Offset: average of min and max, unless a full (ellipsoid) calibration is available
+  MagCal.SetHardIron(((int32_t)m_min.x + m_max.x) / 2, ((int32_t)m_min.y + m_max.y) / 2, ((int32_t)m_min.z + m_max.z) / 2);
+  MagCal.Load();
 	#endif
 
 	//Action pins
@@ -463,34 +765,45 @@ void setup()
 void loop()
 {
   //Update values from IMU
+  Profiler.Start();
 	compass.read();
 	gyro.read();
-  //Fixed update rate of 100Hz
-  const unsigned long int period_us=10000;
-  while((micros()-t)<period_us) { //delayMicroseconds doesn't work...
-    ;
-  }
+  Profiler.Stop(PROF_IMU);
+  //Fixed update rate of 100Hz: use the remaining time to send queued bytes and sleep
+  WaitNextPeriod();
   Dt=micros()-t;
   t=micros();
+  Profiler.Start();
+
+  //Loop jitter accounting
+  NbLoops++;
+  if(Dt>overrun_us)
+    NbOverruns++;
+  if(Dt>MaxDt)
+    MaxDt=Dt;
+  TotalUs+=Dt;
+  if(TotalUs>0x7FFFFFFF) //Keep the ratio, avoid overflow
+  {
+    TotalUs/=2;
+    SleepUs/=2;
+  }
 
 	//Processing and values depend on the mode
 	float current_val[2]={0,0};
 	char header_letters[2]={'0','0'};
 	char logBeep='0', ErrorFlag='0';
 
-  //Retrieve values from sensors
-  int CoronalPlaneAngle=(int)GetAngleAcc(&Static);
-  int TransversePlaneAngle=(int)GetAngleMag(&Static);
-  float LinearVelocity=GetLinVel(&Dynamic);
-  float AngularVelocity=GetAngVel();
-  float diff[2], thresh[2];
-
-  //Check if some movement or inactive (gyro based, above noise level)
-  if( AngularVelocity>0.04 )
+  //Retrieve values from sensors: mode processing every loop, the rest in background
+  ModePipeline[Mode]();
+  BackgroundDt+=Dt;
+  if(++BackgroundCount>=BACKGROUND_DECIMATION)
   {
-    LastActivityInS = millis()/1000.;
+    BackgroundCount=0;
+    BackgroundTasks();
+    BackgroundDt=0;
   }
-  
+  float diff[2], thresh[2];
+
 	switch(Mode)
 	{
 		case STATIC:
@@ -515,12 +828,21 @@ void loop()
 			header_letters[1]='T';
 
 		//Add values in the stored list
+		Profiler.Start();
 		AdaptThresh[0].Store(current_val[0]);
 		AdaptThresh[1].Store(current_val[1]);
 	
 		//Apply feedback if needed
 		thresh[0]=fmax(AdaptThresh[0].GetThreshold(Sensitivity), MinimalThresh[0]);
 		thresh[1]=fmax(AdaptThresh[1].GetThreshold(Sensitivity), MinimalThresh[1]);
+		Profiler.Stop(PROF_THRESHOLD);
+
+		//Periodic save (written progressively, see ThreshStore.Pump())
+		if( (millis()/1000.) - LastCheckpointInS > CheckpointPeriodInS )
+		{
+			ThreshStore.Checkpoint(Mode, AdaptThresh);
+			LastCheckpointInS = millis()/1000.;
+		}
 		diff[0]=(current_val[0]-thresh[0])/thresh[0];
 		diff[1]=(current_val[1]-thresh[1])/thresh[1];
 		float m_diff=fmax(diff[0], diff[1]);
@@ -537,6 +859,11 @@ void loop()
 			Vibrate(0);
 			analogWrite(BeepPin, 0);
 		}
+		Profiler.Stop(PROF_FEEDBACK);
+
+		//Decimated record (in case of link drop)
+		uint8_t flags=(Mode==DYNAMIC?OFFLINE_FLAG_DYNAMIC:0)|(Testing?OFFLINE_FLAG_TESTING:0)|(logBeep==1?OFFLINE_FLAG_FEEDBACK:0);
+		Offline.Store(millis()/OFFLINE_PERIOD_MS, flags, CoronalPlaneAngle, TransversePlaneAngle, LinearVelocity, AngularVelocity);
 	}
 	else
 	{
@@ -551,119 +878,309 @@ void loop()
 
 	//Send values over serial
 	#ifdef LOG
-	if(!Pause)
+	if(!Pause && ++LogCount>=LogDecimation)
 	{
-		Serial.print(header_letters[0]);
-    Serial.print(header_letters[1]);
+    LogCount=0;
+    Profiler.Start();
     #ifdef BINARY_LOG
-      PrintUInt32(millis());
-      PrintInt8(CoronalPlaneAngle);
-      PrintInt8(TransversePlaneAngle);
-      PrintUInt16((int)(LinearVelocity*1000));
-      PrintUInt16((int)(AngularVelocity*1000));
-      PrintUInt16((int)(thresh[0]*100));
-      PrintUInt16((int)(thresh[1]*100));
-      Serial.println("");
+    if(BatchSize<=1)
+    {
+      //Whole frame (2+4+1+1+4*2+2 bytes) or nothing
+      if(Tx.BeginFrame(18))
+      {
+        Tx.print(header_letters[0]);
+        Tx.print(header_letters[1]);
+        PrintUInt32(millis());
+        PrintInt8(CoronalPlaneAngle);
+        PrintInt8(TransversePlaneAngle);
+        PrintUInt16((int)(LinearVelocity*1000));
+        PrintUInt16((int)(AngularVelocity*1000));
+        PrintUInt16((int)(thresh[0]*100));
+        PrintUInt16((int)(thresh[1]*100));
+        Tx.println();
+      }
+      Tx.EndFrame();
+    }
+    else
+    {
+      //Accumulate and send a batch frame when full
+      Batch[BatchNb].Angle[0]=CoronalPlaneAngle;
+      Batch[BatchNb].Angle[1]=TransversePlaneAngle;
+      Batch[BatchNb].Vel[0]=(int)(LinearVelocity*1000);
+      Batch[BatchNb].Vel[1]=(int)(AngularVelocity*1000);
+      BatchNb++;
+      if(BatchNb>=BatchSize)
+      {
+        if(Tx.BeginFrame(2+4+1+BatchNb*6+2*2+2))
+        {
+          Tx.print((char)(header_letters[0]-'A'+'a'));
+          Tx.print(header_letters[1]);
+          PrintUInt32(millis());
+          PrintUInt8(BatchNb);
+          for(int i=0; i<BatchNb; i++)
+          {
+            PrintInt8(Batch[i].Angle[0]);
+            PrintInt8(Batch[i].Angle[1]);
+            PrintUInt16(Batch[i].Vel[0]);
+            PrintUInt16(Batch[i].Vel[1]);
+          }
+          PrintUInt16((int)(thresh[0]*100));
+          PrintUInt16((int)(thresh[1]*100));
+          Tx.println();
+        }
+        Tx.EndFrame();
+        BatchNb=0;
+      }
+    }
     #else
-      Serial.print((float)(millis()/1000.), 3);
-  		Serial.print(',');
-  		Serial.print(CoronalPlaneAngle);
-  		Serial.print(',');
-  		Serial.print(TransversePlaneAngle);
-  		Serial.print(',');
-      Serial.print(LinearVelocity, 3);
-      Serial.print(',');
-      Serial.print(AngularVelocity, 3);
-      Serial.print(',');
-  		Serial.print(thresh[0], 3);
-  		Serial.print(',');
-  		Serial.println(thresh[1], 3);
+      Tx.print(header_letters[0]);
+      Tx.print(header_letters[1]);
+      Tx.print((float)(millis()/1000.), 3);
+  		Tx.print(',');
+  		Tx.print(CoronalPlaneAngle);
+  		Tx.print(',');
+  		Tx.print(TransversePlaneAngle);
+  		Tx.print(',');
+      Tx.print(LinearVelocity, 3);
+      Tx.print(',');
+      Tx.print(AngularVelocity, 3);
+      Tx.print(',');
+  		Tx.print(thresh[0], 3);
+  		Tx.print(',');
+  		Tx.println(thresh[1], 3);
       if(CoronalPlaneAngle>255 || TransversePlaneAngle>255 || LinearVelocity>65 || AngularVelocity>65)
-        Serial.println("WARNING");
+        Tx.println(F("WARNING"));
     #endif
+    Profiler.Stop(PROF_TX);
 	}
 
-	//Check for serial message: run/pause
-	//each message has the format: CDx with x=R (run) or x=P (pause)
-	if(Serial.available()>2)
+	//Calibration mode: raw magnetometer values
+	if(MagStreaming && ++MagStreamCount>=MAG_CALIB_STREAM_DECIMATION)
 	{
-		char msg[3];
-		msg[0]=Serial.read();
-		msg[1]=Serial.read();
-		msg[2]=Serial.read();
+		MagStreamCount=0;
+		if(Tx.BeginFrame(2+3*2+2))
+		{
+			Tx.print(F("MC"));
+			PrintInt16(compass.m.x);
+			PrintInt16(compass.m.y);
+			PrintInt16(compass.m.z);
+			Tx.println();
+		}
+		Tx.EndFrame();
+	}
 
-		if(msg[0]=='C' && msg[1]=='D')
+	//Serial commands: parse what has been received (never blocks) and execute one per loop
+	//each message has the format: CDx followed by x parameters if any (see CommandParser::ParamSize())
+	Commands.Poll();
+	if(Commands.Available())
+	{
+		Command &cmd=Commands.Front();
+		switch(cmd.Id)
 		{
-			switch(msg[2])
+			//Parsing error
+			case CMD_ERROR:
+				Tx.Reserve(1+3+2);
+				Tx.print('E');
+				Tx.println(cmd.Param[0]);
+				break;
+			//Device check query
+			case 'Q':
+				Tx.Reserve(4+2);
+				Tx.println(F("OKST"));
+				break;
+			case 'P':
+				if(!Pause)
+					ThreshStore.Checkpoint(Mode, AdaptThresh);
+				Testing=false;
+				Pause=true;
+				Tx.Reserve(3+2);
+				Tx.print(F("OK"));
+				Tx.print(header_letters[0]);
+				Tx.println('P');
+				break;
+			case 'R':
+				Testing=false;
+				Pause=false;
+				Tx.Reserve(3+2);
+				Tx.print(F("OK"));
+				Tx.print(header_letters[0]);
+				Tx.println('R');
+				break;
+			case 'T':
+				Pause=false;
+				Testing=true;
+				Tx.Reserve(3+2);
+				Tx.print(F("OK"));
+				Tx.print(header_letters[0]);
+				Tx.println('T');
+				break;
+			case 'S':
+				ThreshStore.Checkpoint(Mode, AdaptThresh);
+				Mode=STATIC;
+				Tx.Reserve(3+2);
+				Tx.print(F("OK"));
+				Tx.print('S');
+				Tx.println(header_letters[1]);
+				Init();
+				break;
+			case 'D':
+				ThreshStore.Checkpoint(Mode, AdaptThresh);
+				Mode=DYNAMIC;
+				Tx.Reserve(3+2);
+				Tx.print(F("OK"));
+				Tx.print('D');
+				Tx.println(header_letters[1]);
+				Init();
+				break;
+			case 'J'://Loop jitter report
+				Tx.Reserve(3+4+4+2+2+2+2+2);
+				Tx.print(F("OKJ"));
+				PrintUInt32(NbLoops);
+				PrintUInt32(NbOverruns);
+				PrintUInt16(min(MaxDt, 65535UL));
+				PrintUInt16(Tx.NbDroppedFrames);
+				PrintUInt16(Tx.MaxFill);
+				PrintUInt16(TotalUs>0 ? 1000-SleepUs/(TotalUs/1000+1) : 1000);
+				Tx.println();
+				NbLoops=0;
+				SleepUs=0;
+				TotalUs=0;
+				NbOverruns=0;
+				MaxDt=0;
+				Tx.ResetCounters();
+				break;
+			case 'G'://Get thresholds profile
 			{
-				//Device check query
-				case 'Q':
-					Serial.println("OKST");
-					break;
-				case 'P':
-					Testing=false;
-					Pause=true;
-					Serial.print("OK");
-					Serial.print(header_letters[0]);
-					Serial.println('P');
-					break;
-				case 'R':
-					Testing=false;
-					Pause=false;
-					Serial.print("OK");
-					Serial.print(header_letters[0]);
-					Serial.println('R');
-					break;
-				case 'T':
-					Pause=false;
-					Testing=true;
-					Serial.print("OK");
-					Serial.print(header_letters[0]);
-					Serial.println('T');
-					break;
-				case 'S':
-					Mode=STATIC;
-					Serial.print("OK");
-					Serial.print('S');
-					Serial.println(header_letters[1]);
-					Init();
-					break;
-				case 'D':
-					Mode=DYNAMIC;
-					Serial.print("OK");
-					Serial.print('D');
-					Serial.println(header_letters[1]);
-					Init();
-					break;
-        case 'B'://Buzz test
-          Vibrate(0.5);
-          delay(500);
-          Vibrate(0);
-          delay(500);
-          Vibrate(0.8);
-          delay(500);
-          Vibrate(0);
-          Serial.print("OK");
-          Serial.println("B");
-          break;
-				default:
-					Serial.println("E2");
+				uint8_t profile[THRESH_PROFILE_SIZE];
+				if(ThreshStore.GetProfile(Mode, AdaptThresh, profile))
+				{
+					Tx.Reserve(3+THRESH_PROFILE_SIZE+2);
+					Tx.print(F("OKG"));
+					Tx.write(profile, THRESH_PROFILE_SIZE);
+					Tx.println();
+				}
+				else
+				{
+					Tx.Reserve(2+2);
+					Tx.println(F("E3"));
+				}
+				break;
 			}
+			case 'W'://Write thresholds profile
+			{
+				uint8_t *profile=Commands.GetPayload();
+				if(ThreshStore.CheckProfile(profile))
+				{
+					if(profile[0]==Mode)
+						ThreshStore.ApplyProfile(profile, AdaptThresh);
+					ThreshStore.Save(profile);
+					Tx.Reserve(3+2);
+					Tx.println(F("OKW"));
+				}
+				else
+				{
+					Tx.Reserve(2+2);
+					Tx.println(F("E3"));
+				}
+				break;
+			}
+			case 'O'://Offline records dump
+			{
+				uint8_t records[OFFLINE_DUMP_MAX*OFFLINE_RECORD_SIZE];
+				memset(records, 0, sizeof(records));
+				int nb=Offline.Get(cmd.Param[0] | (cmd.Param[1]<<8), records, OFFLINE_DUMP_MAX);
+				Tx.Reserve(3+1+sizeof(records)+2);
+				Tx.print(F("OKO"));
+				PrintUInt8(nb);
+				Tx.write(records, sizeof(records));
+				Tx.println();
+				break;
+			}
+			case 'M'://Magnetometer calibration mode
+				SetMagStreaming(cmd.Param[0]==1);
+				Tx.Reserve(3+2);
+				Tx.println(F("OKM"));
+				break;
+			case 'C'://Write magnetometer calibration
+			{
+				uint8_t *calib=Commands.GetPayload();
+				if(MagCal.Check(calib))
+				{
+					MagCal.Set(calib);
+					MagCal.Save(calib);
+					Tx.Reserve(3+2);
+					Tx.println(F("OKC"));
+				}
+				else
+				{
+					Tx.Reserve(2+2);
+					Tx.println(F("E3"));
+				}
+				break;
+			}
+			case 'V'://Set parameter
+			case 'U'://Get parameter
+			{
+				int value;
+				bool ok=(cmd.Id=='V') ? SetParameter(cmd.Param[0], (int16_t)(cmd.Param[1] | (cmd.Param[2]<<8))) : true;
+				if(ok && GetParameter(cmd.Param[0], &value))
+				{
+					Tx.Reserve(3+1+2+2);
+					Tx.print(F("OK"));
+					Tx.print(cmd.Id);
+					PrintUInt8(cmd.Param[0]);
+					PrintInt16(value);
+					Tx.println();
+				}
+				else
+				{
+					Tx.Reserve(2+2);
+					Tx.println(F("E3"));
+				}
+				break;
+			}
+			case 'X'://Loop profile
+				Tx.Reserve(3+1+PROF_NB_STAGES*3*2+2);
+				Tx.print(F("OKX"));
+				PrintUInt8(PROF_NB_STAGES);
+				for(int i=0; i<PROF_NB_STAGES; i++)
+				{
+					PrintUInt16(Profiler.GetMin(i));
+					PrintUInt16(Profiler.GetAvg(i));
+					PrintUInt16(Profiler.GetMax(i));
+				}
+				Tx.println();
+				Profiler.Reset();
+				break;
+      case 'B'://Buzz test
+        Vibrate(0.5);
+        delay(500);
+        Vibrate(0);
+        delay(500);
+        Vibrate(0.8);
+        delay(500);
+        Vibrate(0);
+        Tx.Reserve(3+2);
+        Tx.print(F("OK"));
+        Tx.println(F("B"));
+        break;
+			default:
+				Tx.Reserve(2+2);
+				Tx.println(F("E2"));
 		}
-		else
-		{
-			//Error
-			Serial.println("E1");
-		}
-		//Flush serial buffer
-    Serial.flush();
-		while(Serial.available()>0)
-			Serial.read();
+		Commands.Pop();
 
     LastActivityInS = millis()/1000.;
 	}
 	#endif
 
+  //Pending EEPROM writes (thresholds save first, then offline records): one byte per loop
+  if(!ThreshStore.Pump())
+    Offline.Pump();
+
+  //Loop processing time (after the wait, IMU read excluded)
+  Profiler.Add(PROF_LOOP, micros()-t);
+
   //Goes to sleep if inactive for too long
   if( (millis()/1000.) - LastActivityInS > MaxInactivityBeforeSleepInS )
   {
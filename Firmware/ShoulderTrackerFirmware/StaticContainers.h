@@ -0,0 +1,117 @@
+/** ShoulderTracking device firmware
+ *
+ * Copyright Vincent Crocher - Unimelb - 2016, 2020
+ * License MIT license
+ *
+ * Fixed capacity containers, statically allocated (no heap use on the AVR).
+ * Capacity is a template parameter: memory use is known at compile time.
+ * Out of capacity/range operations are ignored (and return false when possible).
+ */
+
+
+//###################################################################################
+//                            STATIC VECTOR CLASS
+//###################################################################################
+template<typename T, unsigned int N>
+class StaticVector
+{
+  public:
+    StaticVector()
+    {
+      Size=0;
+    }
+
+    unsigned int size() {return Size;}
+    unsigned int capacity() {return N;}
+    bool full() {return Size>=N;}
+    void clear() {Size=0;}
+
+    T& operator[](unsigned int i) {return Data[i];}
+
+    bool push_back(const T &v)
+    {
+      if(Size>=N)
+        return false;
+      Data[Size++]=v;
+      return true;
+    }
+
+    //Insert v at position pos (shift the next ones)
+    bool insert(unsigned int pos, const T &v)
+    {
+      if(Size>=N || pos>Size)
+        return false;
+      for(unsigned int i=Size; i>pos; i--)
+        Data[i]=Data[i-1];
+      Data[pos]=v;
+      Size++;
+      return true;
+    }
+
+    //Remove element at position pos (shift the next ones)
+    void erase(unsigned int pos)
+    {
+      if(pos>=Size)
+        return;
+      for(unsigned int i=pos; i<Size-1; i++)
+        Data[i]=Data[i+1];
+      Size--;
+    }
+
+  private:
+    T Data[N];
+    unsigned int Size;
+};
+//-----------------------------------------------------------------------------------
+//-----------------------------------------------------------------------------------
+//-----------------------------------------------------------------------------------
+
+
+
+//###################################################################################
+//                            STATIC RING CLASS
+//###################################################################################
+// FIFO: push_back() at the end, pop_front() in O(1), [i] relative to the oldest element.
+template<typename T, unsigned int N>
+class StaticRing
+{
+  public:
+    StaticRing()
+    {
+      clear();
+    }
+
+    unsigned int size() {return Size;}
+    unsigned int capacity() {return N;}
+    bool full() {return Size>=N;}
+    void clear() {Head=0; Size=0;}
+
+    T& operator[](unsigned int i) {return Data[Wrap(Head+i)];}
+    T& front() {return Data[Head];}
+
+    bool push_back(const T &v)
+    {
+      if(Size>=N)
+        return false;
+      Data[Wrap(Head+Size)]=v;
+      Size++;
+      return true;
+    }
+
+    void pop_front()
+    {
+      if(Size==0)
+        return;
+      Head=Wrap(Head+1);
+      Size--;
+    }
+
+  private:
+    unsigned int Wrap(unsigned int i) {return (i>=N)?i-N:i;}
+
+    T Data[N];
+    unsigned int Head, Size;
+};
+//-----------------------------------------------------------------------------------
+//-----------------------------------------------------------------------------------
+//-----------------------------------------------------------------------------------
@@ -32,10 +32,6 @@ LIS3MDL::vector<int16_t> m_max = { +2742,  +2178,  +3343};//default values in ca
 #endif
 
 
-#define FILT_ORDER_LP 2
-const float FILT_COEFS_a[FILT_ORDER_LP]={1.0000, -0.5095};
-const float FILT_COEFS_b[FILT_ORDER_LP]={0.2452, 0.2452};
-
 enum MODE {STATIC, DYNAMIC};
 
 typedef struct
@@ -51,5 +47,5 @@ typedef struct
 {
   float A[2];
   float v_c;
-  float v[FILT_ORDER_LP], vf[FILT_ORDER_LP];
+  VelocityLowPassFilter VelFilter;
 }Dynamic_param;
@@ -0,0 +1,205 @@
+/** ShoulderTracking device firmware
+ *
+ * Copyright Vincent Crocher - Unimelb - 2016, 2020
+ * License MIT license
+ */
+#include <Arduino.h>
+#include <EEPROM.h>
+
+#define THRESH_NB_QUANTILES 12 //Nb of values kept per threshold (quantiles of the stored values)
+//Profile (as exchanged with the host, CDG/CDW): mode, 2x THRESH_NB_QUANTILES uint16 (LSB first), checksum
+#define THRESH_PROFILE_SIZE (1+2*THRESH_NB_QUANTILES*2+1)
+//EEPROM record: sequence nb then profile
+#define THRESH_RECORD_SIZE (1+THRESH_PROFILE_SIZE)
+#define THRESH_NB_SLOTS 3 //Records per mode (written in turn: wear leveling)
+
+#include "EepromMap.h"
+
+
+//###################################################################################
+//                            THRESHOLD STORE CLASS
+//###################################################################################
+// Checkpoint a compact summary (quantiles) of the adaptive thresholds history to EEPROM
+// and restore it on init (warm start). Records are written one byte per call to Pump()
+// (one EEPROM write, ~3.3ms, completes between two loops: never blocks) in the next
+// slot of the mode, the checksum being written last: an interrupted write leaves the
+// previous record valid. A single record is pending at a time (see Save()).
+class ThresholdStore
+{
+  public:
+    ThresholdStore()
+    {
+      NbWritten=0;
+      NbToWrite=0;
+    }
+
+    //Summary of the two thresholds of mode into profile buffer (THRESH_PROFILE_SIZE)
+    //Return false if nothing learnt yet
+    bool GetProfile(MODE mode, AdaptiveThresholding *at, uint8_t *profile)
+    {
+      AdaptiveThresholding::ValuesType q[THRESH_NB_QUANTILES];
+      profile[0]=mode;
+      for(int i=0; i<2; i++)
+      {
+        if(!at[i].GetQuantiles(q, THRESH_NB_QUANTILES))
+          return false;
+        for(int k=0; k<THRESH_NB_QUANTILES; k++)
+        {
+          profile[1+(i*THRESH_NB_QUANTILES+k)*2]=lowByte(q[k]);
+          profile[1+(i*THRESH_NB_QUANTILES+k)*2+1]=highByte(q[k]);
+        }
+      }
+      profile[THRESH_PROFILE_SIZE-1]=Checksum(profile, THRESH_PROFILE_SIZE-1);
+      return true;
+    }
+
+    //Check a profile (e.g. received from host)
+    bool CheckProfile(const uint8_t *profile)
+    {
+      return (profile[0]==STATIC || profile[0]==DYNAMIC) && profile[THRESH_PROFILE_SIZE-1]==Checksum(profile, THRESH_PROFILE_SIZE-1);
+    }
+
+    //Seed the thresholds with the profile values
+    void ApplyProfile(const uint8_t *profile, AdaptiveThresholding *at)
+    {
+      AdaptiveThresholding::ValuesType q[THRESH_NB_QUANTILES];
+      for(int i=0; i<2; i++)
+      {
+        for(int k=0; k<THRESH_NB_QUANTILES; k++)
+          q[k]=profile[1+(i*THRESH_NB_QUANTILES+k)*2] + (profile[1+(i*THRESH_NB_QUANTILES+k)*2+1]<<8);
+        at[i].Seed(q, THRESH_NB_QUANTILES);
+      }
+    }
+
+    //Start writing the current thresholds of mode to EEPROM (if anything learnt)
+    void Checkpoint(MODE mode, AdaptiveThresholding *at)
+    {
+      uint8_t profile[THRESH_PROFILE_SIZE];
+      if(GetProfile(mode, at, profile))
+        Save(profile);
+    }
+
+    //Start writing a (valid) profile to the next slot of its mode
+    void Save(const uint8_t *profile)
+    {
+      MODE mode=(MODE)profile[0];
+
+      //Pending record of the same mode: outdated, replaced (rewritten from its start, same slot)
+      if(Pending(mode))
+      {
+        memcpy(Record+1, profile, THRESH_PROFILE_SIZE);
+        NbWritten=0;
+        return;
+      }
+      //Of the other mode (only on a mode change): finish it first (blocking, one record at most)
+      Flush();
+
+      int newest=FindNewest(mode);
+      uint8_t seq=0;
+      int slot=0;
+      if(newest>=0)
+      {
+        seq=EEPROM.read(SlotAddr(mode, newest))+1;
+        slot=(newest+1)%THRESH_NB_SLOTS;
+      }
+
+      Record[0]=seq;
+      memcpy(Record+1, profile, THRESH_PROFILE_SIZE);
+      WriteAddr=SlotAddr(mode, slot);
+      NbWritten=0;
+      NbToWrite=THRESH_RECORD_SIZE;
+    }
+
+    //Write the next byte of the pending record, if any. Call once per loop.
+    //Return true if a byte was written.
+    bool Pump()
+    {
+      if(NbWritten>=NbToWrite)
+        return false;
+
+      EEPROM.update(WriteAddr+NbWritten, Record[NbWritten]);
+      NbWritten++;
+      return true;
+    }
+
+    //Write the pending record now (blocking)
+    void Flush()
+    {
+      while(NbWritten<NbToWrite)
+        Pump();
+    }
+
+    //Seed the thresholds of mode with the newest valid record (the pending one if any,
+    //e.g. checkpointed just before a reinit). Return false if none.
+    bool Restore(MODE mode, AdaptiveThresholding *at)
+    {
+      if(Pending(mode))
+      {
+        ApplyProfile(Record+1, at);
+        return true;
+      }
+
+      int newest=FindNewest(mode);
+      if(newest<0)
+        return false;
+
+      uint8_t record[THRESH_RECORD_SIZE];
+      ReadRecord(mode, newest, record);
+      ApplyProfile(record+1, at);
+      return true;
+    }
+
+  private:
+    //Record of mode being written
+    bool Pending(MODE mode)
+    {
+      return NbWritten<NbToWrite && Record[1]==mode;
+    }
+
+    uint8_t Checksum(const uint8_t *buf, int nb)
+    {
+      uint8_t sum=0;
+      for(int i=0; i<nb; i++)
+        sum+=buf[i];
+      return ~sum; //Not 0 for a blank (all 0) record
+    }
+
+    int SlotAddr(MODE mode, int slot)
+    {
+      return EE_THRESH_ADDR+(mode*THRESH_NB_SLOTS+slot)*THRESH_RECORD_SIZE;
+    }
+
+    void ReadRecord(MODE mode, int slot, uint8_t *record)
+    {
+      for(int i=0; i<THRESH_RECORD_SIZE; i++)
+        record[i]=EEPROM.read(SlotAddr(mode, slot)+i);
+    }
+
+    //Slot of the most recent valid record of mode (-1 if none)
+    int FindNewest(MODE mode)
+    {
+      int newest=-1;
+      uint8_t newest_seq=0;
+      uint8_t record[THRESH_RECORD_SIZE];
+      for(int s=0; s<THRESH_NB_SLOTS; s++)
+      {
+        ReadRecord(mode, s, record);
+        if(record[1]!=mode || !CheckProfile(record+1))
+          continue;
+        //Sequence nb wraps around: compare differences
+        if(newest<0 || (int8_t)(record[0]-newest_seq)>0)
+        {
+          newest=s;
+          newest_seq=record[0];
+        }
+      }
+      return newest;
+    }
+
+    uint8_t Record[THRESH_RECORD_SIZE];
+    int WriteAddr;
+    uint8_t NbWritten, NbToWrite;
+};
+//-----------------------------------------------------------------------------------
+//-----------------------------------------------------------------------------------
+//-----------------------------------------------------------------------------------
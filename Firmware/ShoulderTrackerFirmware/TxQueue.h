@@ -0,0 +1,124 @@
+/** ShoulderTracking device firmware
+ *
+ * Copyright Vincent Crocher - Unimelb - 2016, 2020
+ * License MIT license
+ */
+#include <Arduino.h>
+
+#define TX_QUEUE_SIZE 64 //Bytes. MUST be a power of 2 (index masking). ~3 binary frames.
+
+
+//###################################################################################
+//                            TX QUEUE CLASS
+//###################################################################################
+// Software ring buffer in front of the hardware serial TX buffer:
+// everything printed goes in the queue (never blocks) and Pump() moves
+// as many bytes as the UART can take without blocking.
+// Drop policy: a frame (BeginFrame()/EndFrame()) is either fully queued or fully
+// dropped (no partial frames on the link). Bytes written outside of a frame are
+// dropped individually when the queue is full.
+class TxQueue : public Print
+{
+  public:
+    TxQueue()
+    {
+      Head=0;
+      Tail=0;
+      InFrame=false;
+      DroppingFrame=false;
+      ResetCounters();
+    }
+
+    void ResetCounters()
+    {
+      NbDroppedFrames=0;
+      NbDroppedBytes=0;
+      MaxFill=0;
+    }
+
+    //Nb of bytes waiting in the queue
+    unsigned int Count() {return (Head-Tail)&(TX_QUEUE_SIZE-1);}
+    //Free space (one slot is kept empty to distinguish full from empty)
+    unsigned int Free() {return TX_QUEUE_SIZE-1-Count();}
+
+    //Start a frame of len bytes: return false (and drop the whole frame) if it doesn't fit
+    bool BeginFrame(unsigned int len)
+    {
+      InFrame=true;
+      DroppingFrame=(len>Free());
+      if(DroppingFrame)
+        NbDroppedFrames++;
+      return !DroppingFrame;
+    }
+
+    void EndFrame()
+    {
+      InFrame=false;
+      DroppingFrame=false;
+    }
+
+    //Print interface: queue one byte
+    size_t write(uint8_t c)
+    {
+      if(InFrame && DroppingFrame)
+        return 0;
+
+      if(Free()==0)
+      {
+        NbDroppedBytes++;
+        return 0;
+      }
+
+      Buffer[Head]=c;
+      Head=(Head+1)&(TX_QUEUE_SIZE-1);
+
+      unsigned int fill=Count();
+      if(fill>MaxFill)
+        MaxFill=fill;
+      return 1;
+    }
+    using Print::write;
+
+    //Move queued bytes to the hardware serial buffer (interrupt driven) without blocking
+    void Pump()
+    {
+      int room=Serial.availableForWrite();
+      while(Count()>0 && room>0)
+      {
+        Serial.write(Buffer[Tail]);
+        Tail=(Tail+1)&(TX_QUEUE_SIZE-1);
+        room--;
+      }
+    }
+
+    //Wait (pumping) until len bytes are free: for replies which should not be dropped.
+    //Blocking for at most the time to send the queue content (~35ms at 19200bps).
+    //len is capped to the queue capacity (waits for an empty queue): replies MUST fit in it.
+    void Reserve(unsigned int len)
+    {
+      if(len>TX_QUEUE_SIZE-1)
+        len=TX_QUEUE_SIZE-1;
+      while(Free()<len)
+        Pump();
+    }
+
+    //Blocking: only to use when the loop timing doesn't matter (e.g. before sleeping)
+    void Drain()
+    {
+      while(Count()>0)
+        Pump();
+      Serial.flush();
+    }
+
+    unsigned int NbDroppedFrames;
+    unsigned int NbDroppedBytes;
+    unsigned int MaxFill;
+
+  private:
+    uint8_t Buffer[TX_QUEUE_SIZE];
+    unsigned int Head, Tail;
+    bool InFrame, DroppingFrame;
+};
+//-----------------------------------------------------------------------------------
+//-----------------------------------------------------------------------------------
+//-----------------------------------------------------------------------------------
@@ -0,0 +1,34 @@
+#!/bin/sh
+# ShoulderTracker firmware build-time memory map
+#
+# Build the firmware and report static RAM (SRAM) use, headroom and the largest
+# RAM/flash symbols. No heap is used by the firmware: static RAM + stack must fit in SRAM.
+#
+# Usage (from Firmware folder): ./memory_report.sh [fqbn]
+# Requires arduino-cli (with arduino:avr core and the libraries installed) and avr binutils (avr-size, avr-nm) in PATH.
+# Default board is the Bluno (Uno compatible, ATmega328P: 2048B SRAM, 32KB flash).
+
+FQBN=${1:-arduino:avr:uno}
+MCU=atmega328p
+SRAM=2048
+SKETCH=ShoulderTrackerFirmware
+BUILD=$(mktemp -d)
+
+arduino-cli compile --fqbn $FQBN --build-path $BUILD $SKETCH > /dev/null || exit 1
+ELF=$BUILD/$SKETCH.ino.elf
+
+echo "===== Sections ====="
+avr-size -C --mcu=$MCU $ELF
+
+DATA=$(avr-size -A $ELF | awk '$1==".data"||$1==".bss"||$1==".noinit" {s+=$2} END {print s}')
+echo "===== SRAM ====="
+echo "Static RAM (.data+.bss): $DATA bytes"
+echo "Headroom for stack and new features: $((SRAM-DATA)) bytes"
+
+echo "===== Largest RAM symbols ====="
+avr-nm -C -S -t d --size-sort -r $ELF | awk '$3 ~ /^[bBdD]$/ {printf "%6d  %s\n", $2, substr($0, index($0,$4))}' | head -20
+
+echo "===== Largest flash symbols ====="
+avr-nm -C -S -t d --size-sort -r $ELF | awk '$3 ~ /^[tT]$/ {printf "%6d  %s\n", $2, substr($0, index($0,$4))}' | head -20
+
+rm -rf $BUILD
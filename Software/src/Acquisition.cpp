@@ -0,0 +1,393 @@
+//--------------------------------------------------------------------------
+//
+//    Copyright (C) 2015-2016, 2020 Vincent Crocher, Chenchen Liao
+//    The University of Melbourne
+//
+//	  This file is part of ShoulderTrackingIMU.
+//
+//
+//---------------------------------------------------------------------------
+#include "Acquisition.h"
+#include <string.h>
+
+
+Acquisition::Acquisition()
+{
+    SerialCom=NULL;
+    Preferences=NULL;
+    InitMode=Static;
+    Intervention=false;
+    LogCompression=true; //Until preferences are read
+    LogRotateSize=0;
+    LogRotateTime=0;
+    LogPart=0;
+    LogOpenTime=0;
+    MetricsDumpTime=0;
+    LastDeviceTime=-1;
+    Filename[0]='\0';
+    logPath[0]='\0';
+}
+
+Acquisition::~Acquisition()
+{
+    CloseLog();
+}
+
+//! Read the settings from the preferences (SerialCom is set by the owner once created)
+void Acquisition::Init(Fl_Preferences *preferences, mode_type init_mode)
+{
+    Preferences=preferences;
+    InitMode=init_mode;
+
+    ReadInterventionState();
+    double log_sync;
+    Preferences->get("LogSyncInterval", log_sync, LOG_DEFAULT_SYNC_S);
+    Log.SetSyncInterval(log_sync);
+    int compress;
+    Preferences->get("LogCompression", compress, 1);
+    LogCompression=compress;
+    double rotate_mb, rotate_min;
+    Preferences->get("LogRotateMB", rotate_mb, LOG_DEFAULT_ROTATE_MB);
+    Preferences->get("LogRotateMinutes", rotate_min, LOG_DEFAULT_ROTATE_MIN);
+    LogRotateSize=(unsigned long int)(rotate_mb*1024*1024);
+    LogRotateTime=rotate_min*60;
+}
+
+void Acquisition::GenerateFilename()
+{
+    //Get log path
+    Fl_Preferences prefs(Fl_Preferences::USER, "ShoulderTrackerIMU", "logs" );
+    prefs.getUserdataPath(logPath, FL_PATH_MAX);
+    printf("Logs path: %s\n", logPath);
+
+    //Date and time
+    char timestr[80];
+    time_t rawtime;
+    tm* timeinfo;
+    time(&rawtime);
+    timeinfo = localtime(&rawtime);
+    strftime(timestr, 80, "%Y-%m-%d-%H-%M-%S\0", timeinfo);
+
+    //Add prefix and extension
+    sprintf(Filename, "STLog_%s.%s", timestr, LogCompression ? "stlz" : "stl"); //Binary: see tools/StlToCsv to convert
+}
+
+//! Read preferences to know if in intervention or baseline and set the internal IsIntervention flag (and return true if intervention)
+bool Acquisition::ReadInterventionState()
+{
+    Intervention = false;
+    int val;
+    Preferences->get("IsIntervention", val, (int)Intervention);
+    Intervention = (bool)val;
+    return Intervention;
+}
+
+//! Switch between intervention and baseline (kept in preferences)
+void Acquisition::SetIntervention(bool intervention)
+{
+    Intervention = intervention;
+    Preferences->set("IsIntervention", (int)Intervention);
+    Preferences->flush();
+}
+
+//! Retrieve the thresholds learnt by the device (current mode) and keep them in preferences
+void Acquisition::SaveThresholdProfile()
+{
+    unsigned char profile[THRESHOLD_PROFILE_SIZE];
+    if(SerialCom->GetThresholdProfile(profile))
+    {
+        //Profile first byte is the mode
+        Preferences->set(profile[0]==0 ? "ThresholdProfileS" : "ThresholdProfileD", profile, THRESHOLD_PROFILE_SIZE);
+        Preferences->flush();
+        printf("Thresholds profile saved.\n");
+    }
+}
+
+//! Push the saved thresholds profile of the current mode to the device if it has not learnt any
+//! (e.g. new or reprogrammed device). Otherwise the device restores its own from EEPROM.
+void Acquisition::RestoreThresholdProfile()
+{
+    unsigned char profile[THRESHOLD_PROFILE_SIZE];
+    if(SerialCom->GetThresholdProfile(profile))
+        return;
+
+    const char *entry = (InitMode==Static) ? "ThresholdProfileS" : "ThresholdProfileD";
+    if(Preferences->size(entry)==THRESHOLD_PROFILE_SIZE)
+    {
+        Preferences->get(entry, profile, NULL, 0, THRESHOLD_PROFILE_SIZE);
+        if(SerialCom->SetThresholdProfile(profile))
+            printf("Thresholds profile restored.\n");
+    }
+}
+
+//! First connection to the device: thresholds profile and initial streaming level
+void Acquisition::DeviceConnected()
+{
+    RestoreThresholdProfile();
+    Link.Reset();
+    const StreamingLevel &l=Link.GetStreaming();
+    SerialCom->SetStreaming(l.BatchSize, l.Decimation);
+}
+
+//! Local pause (device paused too): the values gap on play is not a link drop, nothing to recover
+void Acquisition::Paused()
+{
+    LastDeviceTime=-1;
+}
+
+//! Evaluate the link quality (call every LINK_WINDOW_S while values are received) and adapt
+//! the device streaming (batching, decimation) accordingly
+//!\return true if the streaming level changed
+bool Acquisition::UpdateStreaming()
+{
+    if(!Link.Update())
+        return false;
+
+    const StreamingLevel &l=Link.GetStreaming();
+    if(!SerialCom->SetStreaming(l.BatchSize, l.Decimation))
+    {
+        //Not acknowledged: keep the level in sync with the device, retried next window
+        Link.Revert();
+        return false;
+    }
+    printf("Link: loss %.0f%%, jitter %.2fs => level %d (%d samples/frame, 1/%d samples).\n", Link.GetLoss()*100, Link.GetJitter(), Link.GetLevel(), l.BatchSize, l.Decimation);
+    return true;
+}
+
+//! Values received from the device (while playing): recover the values missed during a link drop
+//! from the device buffer first (not after a local pause, see Paused()), then log them
+void Acquisition::AddValues(char type, char mode, char state, double t_s, float device_time, const float *vals, const float *thresh, int mouse_x, int mouse_y)
+{
+    if(LastDeviceTime>=0 && device_time-LastDeviceTime>OFFLINE_GAP_S)
+        RecoverOfflineRecords(device_time, t_s);
+    LastDeviceTime=device_time;
+
+    LogValues(type, mode, state, t_s, device_time, vals, thresh, mouse_x, mouse_y);
+}
+
+//! Log the values recorded by the device (1 per s) between the last logged value and device_time (current one, logged at t_s).
+//! Lines are in the same format as live values with O as first letter, max velocities over each second and no thresholds (0).
+void Acquisition::RecoverOfflineRecords(float device_time, double t_s)
+{
+    //Records sequence nb is the device time in s on 16b
+    unsigned long int base=(unsigned long int)LastDeviceTime;
+    unsigned int from=base&0xFFFF;
+    OfflineRecord records[OFFLINE_DUMP_MAX];
+    int nb, nb_total=0;
+    do
+    {
+        nb=SerialCom->GetOfflineRecords(from, records);
+        for(int i=0; i<nb; i++)
+        {
+            float rec_time=base+((records[i].Seq-base)&0xFFFF);
+            //Up to the live values
+            if(rec_time+1>device_time)
+            {
+                nb=0;
+                break;
+            }
+            float vals[4]={records[i].Angle[0], records[i].Angle[1], records[i].LinVel, records[i].AngVel};
+            float thresh[2]={0, 0};
+            LogValues('O', records[i].Mode, records[i].State, t_s-(device_time-rec_time), rec_time, vals, thresh, -1, -1);
+            from=records[i].Seq;
+            nb_total++;
+        }
+    }
+    while(nb==OFFLINE_DUMP_MAX);
+
+    if(nb_total>0)
+        printf("%d offline values recovered (%.1fs gap).\n", nb_total, device_time-LastDeviceTime);
+}
+
+//! New session log in the logs folder, named from the current date and time
+bool Acquisition::OpenLog()
+{
+    GenerateFilename();
+    printf("Log file: %s\n", Filename);
+    char fullname[1024+FL_PATH_MAX];
+    sprintf(fullname, "%s%s", logPath, Filename);
+    if(!OpenLog(fullname))
+    {
+        printf("Error: cannot create log file.\n");
+        return false;
+    }
+    return true;
+}
+
+//! Create the log file (binary, see SessionLog.h), first part of the session
+bool Acquisition::OpenLog(const char *filename)
+{
+    strncpy(LogFullname, filename, sizeof(LogFullname)-1);
+    LogFullname[sizeof(LogFullname)-1]='\0';
+    LogPart=1;
+    struct timeval t;
+    gettimeofday(&t, NULL);
+    Metrics.Reset(t.tv_sec+t.tv_usec/(1000.0*1000.0));
+    if(!OpenLogPart(filename))
+        return false;
+
+    //Mouse events: <log name>_mouse.csv (whole session, not rotated)
+    char name[sizeof(LogFullname)+16];
+    SessionFilename(name, "_mouse.csv");
+    MouseLog.SetCompression(false);
+    if(MouseLog.Open(name))
+        MouseLog.Printf("t (s),x,y\n");
+    else
+        printf("Error: cannot create the mouse log file.\n");
+
+    //Pipeline metrics: <log name>_metrics.csv, over the session only
+    SessionFilename(name, "_metrics.csv");
+    MetricsLog.SetCompression(false);
+    if(MetricsLog.Open(name))
+        MetricsDump.WriteHeader(&MetricsLog);
+    else
+        printf("Error: cannot create the metrics file.\n");
+    MetricsDump.Reset();
+    MetricsDumpTime=t.tv_sec+t.tv_usec/(1000.0*1000.0);
+    return true;
+}
+
+//! Next part of the session log (long session): <log name>_<part nb>.<ext>
+void Acquisition::RotateLog()
+{
+    CloseLogPart();
+    LogPart++;
+    char name[sizeof(LogFullname)+16];
+    strcpy(name, LogFullname);
+    char *ext=strrchr(name, '.');
+    const char *orig_ext=strrchr(LogFullname, '.');
+    if(ext && orig_ext)
+        sprintf(ext, "_%d%s", LogPart, orig_ext);
+    else
+        sprintf(name+strlen(name), "_%d", LogPart);
+    printf("Log file: %s\n", name);
+    if(!OpenLogPart(name))
+        printf("Error: cannot create log file.\n");
+}
+
+//! Create a log file and write its header
+bool Acquisition::OpenLogPart(const char *filename)
+{
+    Log.SetCompression(LogCompression);
+    if(!Log.Open(filename))
+        return false;
+
+    struct timeval t;
+    gettimeofday(&t, NULL);
+    LogOpenTime=t.tv_sec+t.tv_usec/(1000.0*1000.0);
+    char device_id[17];
+    if(SerialCom->IsReplay())
+        sprintf(device_id, "Replay");
+    else
+        sprintf(device_id, "COM%d", SerialCom->GetPort()+1);
+    unsigned char header[SESSION_LOG_HEADER_SIZE];
+    int n=LogEncoder.EncodeHeader(InitMode==Dynamic ? 'D' : 'S', Intervention, device_id, t.tv_sec*1000000LL+t.tv_usec, header);
+    return Log.Write(header, n);
+}
+
+//! Log one line of values: type G (game), A (assessment) or O (offline record)
+void Acquisition::LogValues(char type, char mode, char state, double t_s, float device_time, const float *vals, const float *thresh, int mouse_x, int mouse_y)
+{
+    //Rotation by size and time
+    if((LogRotateSize>0 && Log.GetSize()>=LogRotateSize) || (LogRotateTime>0 && t_s-LogOpenTime>=LogRotateTime))
+        RotateLog();
+    //Pipeline metrics of the last period
+    if(t_s-MetricsDumpTime>=METRICS_DUMP_PERIOD_S)
+    {
+        MetricsDumpTime=t_s;
+        MetricsDump.Update();
+        MetricsDump.Write(&MetricsLog);
+    }
+
+    Metrics.AddValues(type, mode, state, t_s, device_time, vals, thresh);
+
+    SessionRecord rec;
+    rec.Type=type;
+    rec.Mode=mode;
+    rec.State=state;
+    rec.HostTimeUs=SessionHostTimeUs(t_s);
+    rec.DeviceTime=device_time;
+    for(int i=0; i<4; i++)
+        rec.Vals[i]=vals[i];
+    rec.Thresh[0]=thresh[0];
+    rec.Thresh[1]=thresh[1];
+    rec.Mouse[0]=mouse_x;
+    rec.Mouse[1]=mouse_y;
+
+    unsigned char bytes[2*SESSION_LOG_RECORD_SIZE];
+    int n=LogEncoder.Encode(&rec, bytes);
+    //Dropped (disk too slow): keep the encoder consistent with what is in the file
+    if(!Log.Write(bytes, n))
+        LogEncoder.Rollback();
+}
+
+//! Log mouse events (host time and position), one line each
+void Acquisition::LogMouse(const ActivityEvent *events, int nb)
+{
+    if(!MouseLog.IsOpen())
+        return;
+
+    for(int i=0; i<nb; i++)
+    {
+        MouseCsv.Begin();
+        MouseCsv.Fixed(events[i].Time);
+        MouseCsv.Int(events[i].X);
+        MouseCsv.Int(events[i].Y);
+        int n=MouseCsv.End();
+        MouseLog.Write(MouseCsv.Line(), n);
+    }
+}
+
+//! End of session: close the log files and write the session summary
+void Acquisition::CloseLog()
+{
+    if(!Log.IsOpen())
+        return;
+
+    CloseLogPart();
+    MouseLog.Close();
+    if(MetricsLog.IsOpen())
+    {
+        MetricsDump.Update();
+        MetricsDump.Write(&MetricsLog);
+        MetricsLog.Close();
+    }
+    WriteSummary();
+}
+
+//! Close the current log file (part), with its block index
+void Acquisition::CloseLogPart()
+{
+    if(!Log.IsOpen())
+        return;
+
+    int size=LogEncoder.GetIndexSize();
+    unsigned char *index=new unsigned char[size];
+    Log.Close(index, LogEncoder.EncodeIndex(index, size));
+    delete[] index;
+}
+
+//! Session metrics next to the (first part of the) log: <log name>_summary.csv
+void Acquisition::WriteSummary()
+{
+    if(Metrics.GetNbValues()==0)
+        return;
+
+    char name[sizeof(LogFullname)+16];
+    SessionFilename(name, "_summary.csv");
+    Metrics.Print();
+    if(Metrics.Write(name, InitMode==Dynamic ? 'D' : 'S', Intervention))
+        printf("Session summary: %s\n", name);
+    else
+        printf("Error: cannot create the session summary.\n");
+}
+
+//! File next to the (first part of the) log: <log name><suffix>
+void Acquisition::SessionFilename(char *name, const char *suffix)
+{
+    strcpy(name, LogFullname);
+    char *ext=strrchr(name, '.');
+    if(ext)
+        *ext='\0';
+    strcat(name, suffix);
+}
@@ -0,0 +1,94 @@
+//--------------------------------------------------------------------------
+//
+//    Copyright (C) 2015-2016, 2020 Vincent Crocher
+//    The University of Melbourne
+//
+//	  This file is part of ShoulderTrackingIMU.
+//
+//
+//---------------------------------------------------------------------------
+#ifndef ACQUISITION_H
+#define ACQUISITION_H
+
+#include <stdio.h>
+#include <sys/time.h>
+#include <time.h>
+#include <FL/Fl_Preferences.H> //To get user data path
+#include <FL/filename.H>
+
+#include "SerialWin.h"
+#include "LinkMonitor.h"
+#include "LogWriter.h"
+#include "SessionLog.h"
+#include "SessionMetrics.h"
+#include "ActivityMonitor.h"
+#include "MetricsRegistry.h"
+
+#define LOG_DEFAULT_ROTATE_MB 16. //!< Default max log part size (uncompressed, ~2h of values)
+#define LOG_DEFAULT_ROTATE_MIN 60. //!< Default log part duration
+#define OFFLINE_GAP_S 2.0 //!< Device time gap between two logged values from which the device offline buffer is queried
+
+
+//! Device acquisition session, without any GUI element (no widget, no FLTK timer): shared
+//! by the GUI (MainWindow) and the headless mode (see Headless.h). Session log file(s),
+//! link quality and streaming level, device offline records, thresholds profiles and
+//! session metrics (summary written next to the log when closed), user (mouse) events and
+//! acquisition pipeline metrics (<log>_metrics.csv, every METRICS_DUMP_PERIOD_S).
+//! Settings are read from the application preferences.
+class Acquisition
+{
+    public:
+        Acquisition();
+        ~Acquisition();
+
+        void Init(Fl_Preferences *preferences, mode_type init_mode);
+
+        void GenerateFilename();
+        bool ReadInterventionState();
+        void SetIntervention(bool intervention);
+        void SaveThresholdProfile();
+        void RestoreThresholdProfile();
+        void DeviceConnected();
+        void Paused();
+        bool UpdateStreaming();
+
+        void AddValues(char type, char mode, char state, double t_s, float device_time, const float *vals, const float *thresh, int mouse_x, int mouse_y);
+        void RecoverOfflineRecords(float device_time, double t_s);
+        bool OpenLog();
+        bool OpenLog(const char *filename);
+        bool OpenLogPart(const char *filename);
+        void RotateLog();
+        void LogValues(char type, char mode, char state, double t_s, float device_time, const float *vals, const float *thresh, int mouse_x, int mouse_y);
+        void LogMouse(const ActivityEvent *events, int nb);
+        void CloseLog();
+
+    private:
+        void CloseLogPart();
+        void WriteSummary();
+        void SessionFilename(char *name, const char *suffix);
+
+    public:
+        Serial *SerialCom;
+        Fl_Preferences *Preferences;
+        LinkMonitor Link; //!< Link quality and device streaming level
+        LogWriter Log; //!< Values log file (written in background)
+        SessionLogEncoder LogEncoder; //!< Binary log format (see SessionLog.h)
+        LogWriter MouseLog; //!< Mouse events of the session (CSV, next to the log)
+        CsvWriter MouseCsv;
+        LogWriter MetricsLog; //!< Pipeline metrics of the session (CSV, next to the log)
+        MetricsReport MetricsDump;
+        double MetricsDumpTime; //!< Host time of the last metrics written (s)
+        SessionMetrics Metrics; //!< Outcome measures of the session (all log parts)
+        bool LogCompression; //!< Log in compressed chunks (.stlz)
+        char LogFullname[1024+FL_PATH_MAX]; //!< First part of the session log
+        int LogPart;
+        double LogOpenTime; //!< Host time the current part was created (s)
+        unsigned long int LogRotateSize; //!< New part beyond this size (bytes, uncompressed), 0 for none
+        double LogRotateTime; //!< New part after this time (s), 0 for none
+        char Filename[1024], logPath[FL_PATH_MAX];
+        mode_type InitMode;
+        float LastDeviceTime; //!< Device time of the last logged value (s), to detect link drops (-1 after a pause)
+        bool Intervention; //! When true, feedback will be provided during the session, otherwise (baseline period) no feedback is provided, device stays in test mode.
+};
+
+#endif // ACQUISITION_H
@@ -0,0 +1,307 @@
+//--------------------------------------------------------------------------
+//
+//    Copyright (C) 2020 Vincent Crocher
+//    The University of Melbourne
+//
+//	  This file is part of ShoulderTrackingIMU.
+//
+//
+//---------------------------------------------------------------------------
+#include "ActivityMonitor.h"
+#include <math.h>
+#include <string.h>
+#include <sys/time.h>
+#include <chrono>
+#include "MetricsRegistry.h"
+#ifdef __linux__
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/ioctl.h>
+    #include <sys/select.h>
+    #include <linux/input.h>
+#endif
+
+
+//! Monotonic clock (us)
+static long long int NowUs()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+ActivityMonitor::ActivityMonitor():Active(1), LastEventUs(0), Position(-1), NbEvents(0), NbDropped(0), Head(0), Tail(0)
+{
+    Source=NULL;
+    Listener=NULL;
+    ListenerParam=NULL;
+    WindowStartUs=0;
+    WindowNb=0;
+}
+
+ActivityMonitor::~ActivityMonitor()
+{
+    Stop();
+}
+
+//! Start monitoring the events of source (owned, deleted by Stop()): active until ACTIVITY_IDLE_S without event
+bool ActivityMonitor::Start(ActivitySource *source)
+{
+    Stop();
+    Source=source;
+    Active.store(1);
+    LastEventUs.store(NowUs());
+    if(!Source->Start(this))
+    {
+        printf("Activity: cannot start the %s source.\n", Source->GetName());
+        return false;
+    }
+    printf("Activity: %s.\n", Source->GetName());
+    return true;
+}
+
+void ActivityMonitor::Stop()
+{
+    if(Source)
+    {
+        Source->Stop();
+        delete Source;
+        Source=NULL;
+    }
+}
+
+//! One user input event (called by the source thread): counted, buffered, and resumes
+//! activity if enough events within the resume window
+void ActivityMonitor::AddEvent(int x, int y)
+{
+    long long int now=NowUs();
+    NbEvents++;
+    LastEventUs.store(now);
+    Position.store(((long long int)(unsigned int)x<<32) | (unsigned int)y);
+
+    //Buffer (dropped if full)
+    unsigned int head=Head.load(std::memory_order_relaxed);
+    unsigned int nb=head-Tail.load(std::memory_order_acquire);
+    if(nb>=ACTIVITY_BUFFER_SIZE)
+    {
+        NbDropped++;
+    }
+    else
+    {
+        struct timeval t;
+        gettimeofday(&t, NULL);
+        ActivityEvent &e=Events[head&(ACTIVITY_BUFFER_SIZE-1)];
+        e.Time=t.tv_sec + t.tv_usec / (1000.0*1000.0);
+        e.X=x;
+        e.Y=y;
+        Head.store(head+1, std::memory_order_release);
+        PipelineMetrics.Record(MetricActivityQueue, nb+1);
+    }
+
+    //Resume: ACTIVITY_RESUME_EVENTS within the window
+    if(!Active.load())
+    {
+        if(WindowNb==0 || now-WindowStartUs>ACTIVITY_RESUME_WINDOW_S*1000000)
+        {
+            WindowStartUs=now;
+            WindowNb=0;
+        }
+        WindowNb++;
+        if(WindowNb>=ACTIVITY_RESUME_EVENTS)
+        {
+            WindowNb=0;
+            SetActive(true);
+        }
+    }
+}
+
+//! Inactivity detection: to call every ACTIVITY_UPDATE_PERIOD_S
+//!\return true if just became inactive
+bool ActivityMonitor::Update()
+{
+    if(Active.load() && NowUs()-LastEventUs.load()>ACTIVITY_IDLE_S*1000000)
+        return SetActive(false);
+    return false;
+}
+
+//! Transition (from either thread, only one wins) and listener call
+bool ActivityMonitor::SetActive(bool active)
+{
+    int expected=active ? 0 : 1;
+    if(!Active.compare_exchange_strong(expected, active ? 1 : 0))
+        return false;
+    if(Listener)
+        Listener(active, ListenerParam);
+    return true;
+}
+
+//! Retrieve the buffered events, oldest first (consumer side: one thread only)
+//!\return the nb of events (up to max_nb)
+int ActivityMonitor::GetEvents(ActivityEvent *events, int max_nb)
+{
+    unsigned int head=Head.load(std::memory_order_acquire);
+    unsigned int tail=Tail.load(std::memory_order_relaxed);
+    int nb=0;
+    while(tail!=head && nb<max_nb)
+        events[nb++]=Events[(tail++)&(ACTIVITY_BUFFER_SIZE-1)];
+    Tail.store(tail, std::memory_order_release);
+    return nb;
+}
+
+//! Last pointer position (-1, -1 if none yet)
+void ActivityMonitor::GetPosition(int *x, int *y)
+{
+    long long int p=Position.load();
+    (*x)=(int)(unsigned int)(p>>32);
+    (*y)=(int)(unsigned int)(p&0xFFFFFFFF);
+}
+
+
+SyntheticActivitySource::SyntheticActivitySource(double active_s, double idle_s, double period_s):Running(false)
+{
+    ActiveTime=active_s;
+    IdleTime=idle_s;
+    Period=period_s;
+    Monitor=NULL;
+}
+
+bool SyntheticActivitySource::Start(ActivityMonitor *monitor)
+{
+    Monitor=monitor;
+    Running.store(true);
+    Thread=std::thread(&SyntheticActivitySource::Run, this);
+    return true;
+}
+
+void SyntheticActivitySource::Stop()
+{
+    Running.store(false);
+    if(Thread.joinable())
+        Thread.join();
+}
+
+void SyntheticActivitySource::Run()
+{
+    long long int start=NowUs();
+    int i=0;
+    while(Running.load())
+    {
+        double t=(NowUs()-start)/1000000.;
+        if(IdleTime<=0 || fmod(t, ActiveTime+IdleTime)<ActiveTime)
+        {
+            //Circles on a 1000x1000 screen
+            Monitor->AddEvent(500+(int)(200*cos(i*0.1)), 500+(int)(200*sin(i*0.1)));
+            i++;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds((long long int)(Period*1000000)));
+    }
+}
+
+
+#ifdef __linux__
+EvdevActivitySource::EvdevActivitySource():Running(false)
+{
+    Monitor=NULL;
+    NbFds=0;
+    X=Y=0;
+}
+
+#define EVDEV_TEST_BIT(bits, b) ((bits[(b)/(8*sizeof(long))]>>((b)%(8*sizeof(long))))&1)
+
+//! Open the pointers (relative moves or touch) and keyboards input devices
+bool EvdevActivitySource::Start(ActivityMonitor *monitor)
+{
+    Monitor=monitor;
+    NbFds=0;
+    for(int i=0; i<32 && NbFds<EVDEV_MAX_DEVICES; i++)
+    {
+        char name[32];
+        sprintf(name, "/dev/input/event%d", i);
+        int fd=open(name, O_RDONLY|O_NONBLOCK);
+        if(fd<0)
+            continue;
+
+        //Not sensors (accelerometers...) which stream continuously
+        unsigned long ev[EV_MAX/(8*sizeof(long))+1], keys[KEY_MAX/(8*sizeof(long))+1];
+        memset(ev, 0, sizeof(ev));
+        memset(keys, 0, sizeof(keys));
+        ioctl(fd, EVIOCGBIT(0, sizeof(ev)), ev);
+        ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(keys)), keys);
+        bool pointer=EVDEV_TEST_BIT(ev, EV_REL) || (EVDEV_TEST_BIT(ev, EV_ABS) && EVDEV_TEST_BIT(keys, BTN_TOUCH));
+        bool keyboard=EVDEV_TEST_BIT(keys, KEY_A);
+        if(pointer || keyboard)
+            Fds[NbFds++]=fd;
+        else
+            close(fd);
+    }
+    if(NbFds==0)
+        return false;
+
+    Running.store(true);
+    Thread=std::thread(&EvdevActivitySource::Run, this);
+    return true;
+}
+
+void EvdevActivitySource::Stop()
+{
+    Running.store(false);
+    if(Thread.joinable())
+        Thread.join();
+    for(int i=0; i<NbFds; i++)
+        close(Fds[i]);
+    NbFds=0;
+}
+
+void EvdevActivitySource::Run()
+{
+    while(Running.load())
+    {
+        fd_set fds;
+        FD_ZERO(&fds);
+        int max_fd=-1;
+        for(int i=0; i<NbFds; i++)
+        {
+            FD_SET(Fds[i], &fds);
+            if(Fds[i]>max_fd)
+                max_fd=Fds[i];
+        }
+        //Timeout to check Running
+        struct timeval timeout;
+        timeout.tv_sec=0;
+        timeout.tv_usec=200000;
+        if(select(max_fd+1, &fds, NULL, NULL, &timeout)<=0)
+            continue;
+
+        for(int i=0; i<NbFds; i++)
+        {
+            if(!FD_ISSET(Fds[i], &fds))
+                continue;
+            struct input_event events[64];
+            int n=read(Fds[i], events, sizeof(events));
+            bool input=false;
+            for(int k=0; k<n/(int)sizeof(struct input_event); k++)
+            {
+                const struct input_event &e=events[k];
+                if(e.type==EV_REL && e.code==REL_X)
+                    X+=e.value;
+                else if(e.type==EV_REL && e.code==REL_Y)
+                    Y+=e.value;
+                else if(e.type==EV_ABS && e.code==ABS_X)
+                    X=e.value;
+                else if(e.type==EV_ABS && e.code==ABS_Y)
+                    Y=e.value;
+                //One event per report (with any input)
+                if(e.type==EV_SYN && e.code==SYN_REPORT)
+                {
+                    if(input)
+                        Monitor->AddEvent(X, Y);
+                    input=false;
+                }
+                else if(e.type!=EV_SYN && e.type!=EV_MSC)
+                {
+                    input=true;
+                }
+            }
+        }
+    }
+}
+#endif
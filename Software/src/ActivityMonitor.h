@@ -0,0 +1,145 @@
+//--------------------------------------------------------------------------
+//
+//    Copyright (C) 2020 Vincent Crocher
+//    The University of Melbourne
+//
+//	  This file is part of ShoulderTrackingIMU.
+//
+//
+//---------------------------------------------------------------------------
+#ifndef ACTIVITYMONITOR_H
+#define ACTIVITYMONITOR_H
+
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+
+#define ACTIVITY_IDLE_S 5. //!< Inactive after 5s without any event...
+#define ACTIVITY_RESUME_EVENTS 2 //!< ...and active again after 2 events...
+#define ACTIVITY_RESUME_WINDOW_S 1. //!< ...within 1s (hysteresis: a single event does not resume)
+#define ACTIVITY_UPDATE_PERIOD_S 0.2 //!< Update() period: pause detection delay after ACTIVITY_IDLE_S
+#define ACTIVITY_BUFFER_SIZE 1024 //!< Events not retrieved yet (power of 2): ~10s of continuous mouse moves
+
+//! One user input event (mouse move or button)
+typedef struct
+{
+    double Time; //!< Host time (s)
+    int X, Y; //!< Pointer position (last one for keyboard events), -1 if unknown
+} ActivityEvent;
+
+class ActivityMonitor;
+
+//! Origin of the user input events: started with the monitor, calls ActivityMonitor::AddEvent()
+//! from its own thread
+class ActivitySource
+{
+    public:
+        virtual ~ActivitySource() {}
+        virtual bool Start(ActivityMonitor *monitor)=0;
+        virtual void Stop()=0;
+        virtual const char* GetName()=0;
+};
+
+//! User activity (mouse, input devices) detection, used to pause the session when the
+//! patient is not using the computer and resume it as soon as they are back.
+//! Events come from a source thread (see ActivitySource: Win32 mouse hook, Linux evdev,
+//! synthetic) and only update atomic counters and a lock-free single producer/single
+//! consumer events buffer. Transitions use a hysteresis: inactive after ACTIVITY_IDLE_S
+//! without event (detected by Update(), called periodically by the owner), active again
+//! after ACTIVITY_RESUME_EVENTS events within ACTIVITY_RESUME_WINDOW_S (detected on the
+//! event). The listener is called on each transition, from the thread detecting it: the
+//! GUI forwards it to the main loop (Fl::awake()).
+//! Events are kept with their time until retrieved by GetEvents() (e.g. logged), dropped
+//! (and counted) if the buffer is full.
+class ActivityMonitor
+{
+    public:
+        ActivityMonitor();
+        ~ActivityMonitor();
+
+        bool Start(ActivitySource *source);
+        void Stop();
+        void SetListener(void (*listener)(bool active, void *param), void *param) {Listener=listener; ListenerParam=param;}
+
+        void AddEvent(int x, int y);
+        bool Update();
+        int GetEvents(ActivityEvent *events, int max_nb);
+        void GetPosition(int *x, int *y);
+
+        bool IsActive() {return Active.load()!=0;}
+        unsigned long int GetNbEvents() {return NbEvents.load();}
+        unsigned long int GetNbDropped() {return NbDropped.load();}
+        const char* GetSourceName() {return Source ? Source->GetName() : "none";}
+
+    private:
+        bool SetActive(bool active);
+
+        ActivitySource *Source; //!< Owned
+        void (*Listener)(bool active, void *param);
+        void *ListenerParam;
+
+        std::atomic<int> Active;
+        std::atomic<long long int> LastEventUs; //!< Monotonic clock
+        std::atomic<long long int> Position; //!< Last pointer position (x and y on 32b each)
+        std::atomic<unsigned long int> NbEvents, NbDropped;
+
+        //Resume window (source thread only)
+        long long int WindowStartUs;
+        int WindowNb;
+
+        //Events buffer (producer: AddEvent(), consumer: GetEvents())
+        ActivityEvent Events[ACTIVITY_BUFFER_SIZE];
+        std::atomic<unsigned int> Head, Tail;
+};
+
+
+//! Synthetic activity: periods of activity (events every period_s) and inactivity, e.g. for
+//! replays and tests (always active with idle_s=0)
+class SyntheticActivitySource: public ActivitySource
+{
+    public:
+        SyntheticActivitySource(double active_s=1., double idle_s=0., double period_s=0.1);
+        ~SyntheticActivitySource() {Stop();}
+
+        bool Start(ActivityMonitor *monitor);
+        void Stop();
+        const char* GetName() {return "synthetic";}
+
+    private:
+        void Run();
+
+        double ActiveTime, IdleTime, Period;
+        ActivityMonitor *Monitor;
+        std::atomic<bool> Running;
+        std::thread Thread;
+};
+
+#ifdef __linux__
+#define EVDEV_MAX_DEVICES 16
+
+//! Linux input devices (evdev: /dev/input/event*, pointers and keyboards): needs read access
+//! to them (root or input group). Works without any display (headless). Pointer position is
+//! the sum of the relative moves (no screen coordinates).
+class EvdevActivitySource: public ActivitySource
+{
+    public:
+        EvdevActivitySource();
+        ~EvdevActivitySource() {Stop();}
+
+        bool Start(ActivityMonitor *monitor);
+        void Stop();
+        const char* GetName() {return "evdev";}
+
+    private:
+        void Run();
+
+        ActivityMonitor *Monitor;
+        int Fds[EVDEV_MAX_DEVICES];
+        int NbFds;
+        int X, Y;
+        std::atomic<bool> Running;
+        std::thread Thread;
+};
+#endif
+
+#endif // ACTIVITYMONITOR_H
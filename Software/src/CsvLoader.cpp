@@ -0,0 +1,210 @@
+//--------------------------------------------------------------------------
+//
+//    Copyright (C) 2020 Vincent Crocher
+//    The University of Melbourne
+//
+//	  This file is part of ShoulderTrackingIMU.
+//
+//
+//---------------------------------------------------------------------------
+#include "CsvLoader.h"
+#include <stdlib.h>
+#include <string.h>
+#if __cplusplus>=201703L
+    #include <charconv>
+#endif
+#ifdef WINDOWS
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
+//Floating point from_chars available (GCC 11, MSVC 2019)
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars>=201611L
+    #define CSV_FROM_CHARS
+#endif
+
+#define CSV_FIELD_MAX 64 //!< Longest number (strtod fallback)
+
+
+MappedFile::MappedFile()
+{
+    Data=NULL;
+    Size=0;
+    #ifdef WINDOWS
+        File=INVALID_HANDLE_VALUE;
+        Mapping=NULL;
+    #endif
+}
+
+bool MappedFile::Open(const char *filename)
+{
+    Close();
+    #ifdef WINDOWS
+        File=CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if(File==INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER size;
+        if(!GetFileSizeEx(File, &size))
+        {
+            Close();
+            return false;
+        }
+        if(size.QuadPart==0)
+        {
+            Close();
+            return true; //Empty file: nothing to map
+        }
+        Mapping=CreateFileMappingA(File, NULL, PAGE_READONLY, 0, 0, NULL);
+        if(Mapping)
+            Data=(const char*)MapViewOfFile(Mapping, FILE_MAP_READ, 0, 0, 0);
+        if(!Data)
+        {
+            Close();
+            return false;
+        }
+        Size=size.QuadPart;
+    #else
+        int fd=open(filename, O_RDONLY);
+        if(fd<0)
+            return false;
+        struct stat st;
+        if(fstat(fd, &st)!=0)
+        {
+            close(fd);
+            return false;
+        }
+        if(st.st_size>0)
+        {
+            void *data=mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(data!=MAP_FAILED)
+            {
+                madvise(data, st.st_size, MADV_SEQUENTIAL);
+                Data=(const char*)data;
+                Size=st.st_size;
+            }
+        }
+        close(fd); //Mapping stays valid
+        if(st.st_size>0 && !Data)
+            return false;
+    #endif
+    return true;
+}
+
+void MappedFile::Close()
+{
+    #ifdef WINDOWS
+        if(Data)
+            UnmapViewOfFile(Data);
+        if(Mapping)
+            CloseHandle(Mapping);
+        if(File!=INVALID_HANDLE_VALUE)
+            CloseHandle(File);
+        File=INVALID_HANDLE_VALUE;
+        Mapping=NULL;
+    #else
+        if(Data)
+            munmap((void*)Data, Size);
+    #endif
+    Data=NULL;
+    Size=0;
+}
+
+
+static inline const char* SkipBlanks(const char *p, const char *end)
+{
+    while(p<end && (*p==' ' || *p=='\t'))
+        p++;
+    return p;
+}
+
+//!Parse a number at p: return the character after it, NULL if none
+static inline const char* ParseNumber(const char *p, const char *end, double *v)
+{
+    #ifdef CSV_FROM_CHARS
+        //from_chars does not accept a leading '+' (fscanf does)
+        if(p<end && *p=='+')
+            p++;
+        std::from_chars_result r=std::from_chars(p, end, *v);
+        if(r.ec==std::errc() || r.ec==std::errc::result_out_of_range)
+            return r.ptr;
+        return NULL;
+    #else
+        //strtod needs a terminated string: the mapped file is not
+        char field[CSV_FIELD_MAX];
+        int n=0;
+        while(p+n<end && n<CSV_FIELD_MAX-1 && p[n]!=',' && p[n]!='\n' && p[n]!='\r' && p[n]!=' ' && p[n]!='\t')
+        {
+            field[n]=p[n];
+            n++;
+        }
+        field[n]='\0';
+        char *e;
+        (*v)=strtod(field, &e);
+        if(e==field)
+            return NULL;
+        return p+(e-field);
+    #endif
+}
+
+int CsvParseLine(const char *&p, const char *end, int nb_values, double *vals)
+{
+    const char *line=p;
+    const char *eol=(const char*)memchr(p, '\n', end-p);
+    p=eol ? eol+1 : end;
+    if(!eol)
+        eol=end;
+
+    const char *q=SkipBlanks(line, eol);
+    if(q==eol || (*q=='\r' && q+1==eol))
+        return 0;
+    for(int i=0; i<nb_values; i++)
+    {
+        q=ParseNumber(SkipBlanks(q, eol), eol, &vals[i]);
+        if(!q)
+            return -1;
+        if(i<nb_values-1)
+        {
+            q=SkipBlanks(q, eol);
+            if(q==eol || *q!=',')
+                return -1;
+            q++;
+        }
+    }
+    return 1;
+}
+
+const char* CsvFindData(const char *begin, const char *end, int nb_values)
+{
+    double vals[CSV_MAX_VALUES];
+    const char *p=begin;
+    while(p<end)
+    {
+        const char *line=p;
+        if(CsvParseLine(p, end, nb_values, vals)>0)
+            return line;
+    }
+    return end;
+}
+
+std::vector<const char*> CsvSplit(const char *begin, const char *end, int nb)
+{
+    std::vector<const char*> bounds;
+    bounds.push_back(begin);
+    for(int k=1; k<nb; k++)
+    {
+        const char *p=begin+(end-begin)/nb*k;
+        if(p<bounds.back())
+            continue;
+        const char *eol=(const char*)memchr(p, '\n', end-p);
+        if(!eol || eol+1>=end)
+            break;
+        if(eol+1>bounds.back())
+            bounds.push_back(eol+1);
+    }
+    bounds.push_back(end);
+    return bounds;
+}
@@ -0,0 +1,141 @@
+//--------------------------------------------------------------------------
+//
+//    Copyright (C) 2020 Vincent Crocher
+//    The University of Melbourne
+//
+//	  This file is part of ShoulderTrackingIMU.
+//
+//
+//---------------------------------------------------------------------------
+#ifndef CSVLOADER_H
+#define CSVLOADER_H
+
+#include <stddef.h>
+#include <vector>
+#include <thread>
+
+#define CSV_MAX_VALUES 32 //!< Max nb of values per line
+#define CSV_MIN_CHUNK (1<<20) //!< Smallest part of a file parsed by one thread (bytes)
+
+//! Read-only memory mapped file (whole file)
+class MappedFile
+{
+    public:
+        MappedFile();
+        ~MappedFile() {Close();}
+
+        bool Open(const char *filename);
+        void Close();
+
+        const char* GetData() {return Data;}
+        size_t GetSize() {return Size;}
+
+    private:
+        const char *Data;
+        size_t Size;
+        #ifdef WINDOWS
+            void *File, *Mapping;
+        #endif
+};
+
+
+//! Start of the first line made of nb_values comma separated numbers (i.e. after the
+//! header lines, whatever they are), end if none
+const char* CsvFindData(const char *begin, const char *end, int nb_values);
+
+//! Parse the line at p (nb_values comma separated numbers, anything after them is
+//! ignored) and move p to the start of the next line.
+//!\return 1 if parsed, 0 for a blank line, -1 for an invalid one
+int CsvParseLine(const char *&p, const char *end, int nb_values, double *vals);
+
+//! Split [begin, end[ in up to nb parts starting at a line start
+//!\return bounds (nb of parts+1 pointers)
+std::vector<const char*> CsvSplit(const char *begin, const char *end, int nb);
+
+
+//! Lines of one part of the file (one thread)
+template<typename T>
+void CsvParsePart(const char *begin, const char *end, int nb_values, size_t line_length,
+                  void (*set)(T&, const double*), std::vector<T> *out, char *complete)
+{
+    out->reserve((end-begin)/line_length+1);
+    double vals[CSV_MAX_VALUES];
+    const char *p=begin;
+    (*complete)=true;
+    while(p<end)
+    {
+        int r=CsvParseLine(p, end, nb_values, vals);
+        if(r<0)
+        {
+            (*complete)=false;
+            return;
+        }
+        if(r>0)
+        {
+            out->push_back(T());
+            set(out->back(), vals);
+        }
+    }
+}
+
+//! Load the values of a CSV file: the file is memory mapped, its header lines skipped and
+//! the data lines parsed in parallel (one part of the file per core), each line being
+//! converted by set() and appended to out. As with the previous fscanf loops, loading
+//! stops at the first invalid line after the header.
+//!\return nb of lines loaded, -1 if the file cannot be opened
+template<typename T>
+long int LoadCsvFile(const char *filename, int nb_values, std::vector<T> &out, void (*set)(T&, const double*))
+{
+    if(nb_values<1 || nb_values>CSV_MAX_VALUES)
+        return -1;
+    MappedFile file;
+    if(!file.Open(filename))
+        return -1;
+    const char *end=file.GetData()+file.GetSize();
+    const char *begin=CsvFindData(file.GetData(), end, nb_values);
+    if(begin==end)
+        return 0;
+
+    //Output pre-sized from the length of the first line
+    const char *first_end=begin;
+    while(first_end<end && *first_end!='\n')
+        first_end++;
+    size_t line_length=first_end-begin+1;
+
+    int nb_threads=std::thread::hardware_concurrency();
+    if(nb_threads<1)
+        nb_threads=1;
+    if(nb_threads>(end-begin)/CSV_MIN_CHUNK+1)
+        nb_threads=(end-begin)/CSV_MIN_CHUNK+1;
+    std::vector<const char*> bounds=CsvSplit(begin, end, nb_threads);
+    int nb_parts=bounds.size()-1;
+    std::vector< std::vector<T> > parts(nb_parts);
+    std::vector<char> complete(nb_parts);
+    std::vector<std::thread> threads;
+    for(int k=1; k<nb_parts; k++)
+        threads.push_back(std::thread(CsvParsePart<T>, bounds[k], bounds[k+1], nb_values, line_length, set, &parts[k], &complete[k]));
+    CsvParsePart<T>(bounds[0], bounds[1], nb_values, line_length, set, &parts[0], &complete[0]);
+    for(unsigned int k=0; k<threads.size(); k++)
+        threads[k].join();
+
+    //Up to the first invalid line
+    size_t nb=0;
+    int last=0;
+    for(; last<nb_parts; last++)
+    {
+        nb+=parts[last].size();
+        if(!complete[last])
+            break;
+    }
+    if(out.empty() && (nb_parts==1 || !complete[0]))
+    {
+        out.swap(parts[0]);
+        return nb;
+    }
+    out.reserve(out.size()+nb);
+    for(int k=0; k<nb_parts && k<=last; k++)
+        out.insert(out.end(), parts[k].begin(), parts[k].end());
+    return nb;
+}
+
+#endif // CSVLOADER_H
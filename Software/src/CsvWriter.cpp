@@ -0,0 +1,90 @@
+//--------------------------------------------------------------------------
+//
+//    Copyright (C) 2020 Vincent Crocher
+//    The University of Melbourne
+//
+//	  This file is part of ShoulderTrackingIMU.
+//
+//
+//---------------------------------------------------------------------------
+#include "CsvWriter.h"
+#if __cplusplus>=201703L
+    #include <charconv>
+#endif
+
+//Floating point to_chars available (GCC 11, MSVC 2019)
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars>=201611L
+    #define CSV_TO_CHARS
+#endif
+
+
+CsvWriter::CsvWriter(char separator)
+{
+    Sep=separator;
+    Begin();
+}
+
+void CsvWriter::Char(char c)
+{
+    if(Size+2>CSV_MAX_LINE)
+        return;
+    Separator();
+    Buffer[Size++]=c;
+}
+
+void CsvWriter::Int(long int v)
+{
+    if(Size+1+CSV_FIELD_MAX>CSV_MAX_LINE)
+        return;
+    Separator();
+    #ifdef CSV_TO_CHARS
+        Size=std::to_chars(Buffer+Size, Buffer+Size+CSV_FIELD_MAX, v).ptr-Buffer;
+    #else
+        int n=snprintf(Buffer+Size, CSV_FIELD_MAX, "%ld", v);
+        Size+=(n<CSV_FIELD_MAX) ? n : CSV_FIELD_MAX-1;
+    #endif
+}
+
+//!Fixed precision (as %.<precision>f)
+void CsvWriter::Fixed(double v, int precision)
+{
+    if(Size+1+CSV_FIELD_MAX>CSV_MAX_LINE)
+        return;
+    Separator();
+    #ifdef CSV_TO_CHARS
+        std::to_chars_result r=std::to_chars(Buffer+Size, Buffer+Size+CSV_FIELD_MAX, v, std::chars_format::fixed, precision);
+        if(r.ec==std::errc())
+        {
+            Size=r.ptr-Buffer;
+            return;
+        }
+    #endif
+    //Too long for a field (huge values) or no to_chars
+    int n=snprintf(Buffer+Size, CSV_FIELD_MAX, "%.*f", precision, v);
+    Size+=(n<CSV_FIELD_MAX) ? n : CSV_FIELD_MAX-1;
+}
+
+//!Shortest text reading back as the same double
+void CsvWriter::Shortest(double v)
+{
+    if(Size+1+CSV_FIELD_MAX>CSV_MAX_LINE)
+        return;
+    Separator();
+    #ifdef CSV_TO_CHARS
+        std::to_chars_result r=std::to_chars(Buffer+Size, Buffer+Size+CSV_FIELD_MAX, v);
+        if(r.ec==std::errc())
+        {
+            Size=r.ptr-Buffer;
+            return;
+        }
+    #endif
+    int n=snprintf(Buffer+Size, CSV_FIELD_MAX, "%.17g", v);
+    Size+=(n<CSV_FIELD_MAX) ? n : CSV_FIELD_MAX-1;
+}
+
+int CsvWriter::End()
+{
+    Buffer[Size++]='\n';
+    Buffer[Size]='\0';
+    return Size;
+}
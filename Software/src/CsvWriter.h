@@ -0,0 +1,47 @@
+//--------------------------------------------------------------------------
+//
+//    Copyright (C) 2020 Vincent Crocher
+//    The University of Melbourne
+//
+//	  This file is part of ShoulderTrackingIMU.
+//
+//
+//---------------------------------------------------------------------------
+#ifndef CSVWRITER_H
+#define CSVWRITER_H
+
+#include <stdio.h>
+
+#define CSV_MAX_LINE 512 //!< Line buffer size
+#define CSV_FIELD_MAX 64 //!< Longest field (beyond, the field is truncated)
+
+//! CSV line formatter: fields are appended to a reusable line buffer with std::to_chars
+//! (no locale, no format string parsing, no allocation), separators being added
+//! automatically. Fixed() gives the same text as printf("%.*f"), so that lines are
+//! identical to the fprintf ones. Falls back to snprintf if the standard library has no
+//! floating point to_chars (before GCC 11).
+class CsvWriter
+{
+    public:
+        CsvWriter(char separator=',');
+
+        void Begin() {Size=0; First=true;}
+        void Char(char c);
+        void Int(long int v);
+        void Fixed(double v, int precision=6);
+        void Shortest(double v);
+        int End(); //!< Terminate the line (\n): return its length
+
+        const char* Line() {return Buffer;}
+        int GetSize() {return Size;}
+
+    private:
+        void Separator() {if(!First) Buffer[Size++]=Sep; First=false;}
+
+        char Buffer[CSV_MAX_LINE+2]; //!< Line, \n and \0
+        int Size;
+        bool First;
+        char Sep;
+};
+
+#endif // CSVWRITER_H
@@ -8,6 +8,7 @@
 //
 //---------------------------------------------------------------------------
 #include "Data.h"
+#include "CsvLoader.h"
 
 
 void ISBtoTR(float q[5], float MatS[16], float MatE[16])
@@ -118,103 +119,55 @@ Data::~Data()
 }
 
 
-//Load csv file containing a list of joint angles (ISB)
-void Data::LoadISBFile()
+//Line converters for LoadCsvFile
+static void SetISBPosture(LimbPosture &post, const double *v)
 {
-    FILE * dataFile=fopen(Filename, "r");
-    if(dataFile)
-    {
-        float q[5];
-        int t;
-        char crap[1024];
-        //Scanf is supposed to get 6 values total
-        while( fscanf(dataFile, "%d,%f,%f,%f,%f,%f", &t, &q[0], &q[1], &q[2], &q[3], &q[4]) !=6 )
-            fscanf(dataFile, "%s", crap);
-
-        //Now get actual data
-        while( fscanf(dataFile, "%d,%f,%f,%f,%f,%f", &t, &q[0], &q[1], &q[2], &q[3], &q[4]) == 6 )
-        {
-            LimbPosture post;
-            post.t=t;
-            post.weight=1.0; //default weigt
-            for(int i=0; i<5; i++)
-                post.q[i]=q[i];
-            Postures.push_back(post);
-        }
+    post.t=(int)v[0];
+    post.weight=1.0; //default weigt
+    for(int i=0; i<5; i++)
+        post.q[i]=v[1+i];
+}
 
-        fclose(dataFile);
-    }
-    else
+static void SetQuatPosture(QuatPosture &post, const double *v)
+{
+    post.t=(int)v[0];
+    for(int i=0; i<4; i++)
     {
-        printf("Error opening: %s\n", Filename);
+        post.q1[i]=v[1+i];
+        post.q2[i]=v[5+i];
+        post.q3[i]=v[9+i];
     }
 }
 
+static void SetHeatMapPosture(LimbPosture &post, const double *v)
+{
+    post.t=0;
+    post.weight=v[5]/100.;
+    for(int i=0; i<5; i++)
+        post.q[i]=v[i];
+}
 
-//Load a csv file containing a list of three quaternions orientation
-void Data::LoadSensorsFile()
+
+//Load csv file containing a list of joint angles (ISB): t and 5 angles per line
+void Data::LoadISBFile()
 {
-    FILE * dataFile=fopen(Filename, "r");
-    if(dataFile)
-    {
-        float q1[4], q2[4], q3[4];
-        int t;
-        char crap[1024];
-        //Scanf is supposed to get 13 values total: first skip the header lines
-        while( fscanf(dataFile, "%d,%f,%f,%f,%f,%f,%f,%f,%f,%f,%f,%f,%f", &t, &q1[0], &q1[1], &q1[2], &q1[3], &q2[0], &q2[1], &q2[2], &q2[3], &q3[0], &q3[1], &q3[2], &q3[3]) != 13 )
-            fscanf(dataFile, "%s", crap);
-
-        //Now get actual data
-        while( fscanf(dataFile, "%d,%f,%f,%f,%f,%f,%f,%f,%f,%f,%f,%f,%f", &t, &q1[0], &q1[1], &q1[2], &q1[3], &q2[0], &q2[1], &q2[2], &q2[3], &q3[0], &q3[1], &q3[2], &q3[3]) == 13 )
-        {
-            QuatPosture post;
-            post.t=t;
-            for(int i=0; i<4; i++)
-            {
-                post.q1[i]=q1[i];
-                post.q2[i]=q2[i];
-                post.q3[i]=q3[i];
-            }
-            QuaternionsPostures.push_back(post);
-        }
+    if(LoadCsvFile(Filename, 6, Postures, SetISBPosture)<0)
+        printf("Error opening: %s\n", Filename);
+}
 
-        fclose(dataFile);
-    }
-    else
-    {
+
+//Load a csv file containing a list of three quaternions orientation: t and 3x4 values per line
+void Data::LoadSensorsFile()
+{
+    if(LoadCsvFile(Filename, 13, QuaternionsPostures, SetQuatPosture)<0)
         printf("Error opening: %s\n", Filename);
-    }
 }
 
-//Load csv file containing a list of joint angles (ISB)
+//Load csv file containing a list of joint angles (ISB) and their weights: 5 angles, w1 and w2 per line
 void Data::LoadHeatMapFile()
 {
-    FILE * dataFile=fopen(Filename, "r");
-    if(dataFile)
-    {
-        float q[5], w1, w2;
-        char crap[1024];
-        //Scanf is supposed to get 6 values total
-        while( fscanf(dataFile, "%f,%f,%f,%f,%f,%f,%f", &q[0], &q[1], &q[2], &q[3], &q[4], &w1, &w2) != 7 )
-            fscanf(dataFile, "%s", crap);
-
-        //Now get actual data
-        while( fscanf(dataFile, "%f,%f,%f,%f,%f,%f,%f", &q[0], &q[1], &q[2], &q[3], &q[4], &w1, &w2) == 7 )
-        {
-            LimbPosture post;
-            post.t=0;
-            post.weight=w1/100.;
-            for(int i=0; i<5; i++)
-                post.q[i]=q[i];
-            Postures.push_back(post);
-        }
-
-        fclose(dataFile);
-    }
-    else
-    {
+    if(LoadCsvFile(Filename, 7, Postures, SetHeatMapPosture)<0)
         printf("Error opening: %s\n", Filename);
-    }
 }
 
 
@@ -0,0 +1,468 @@
+//--------------------------------------------------------------------------
+//
+//    Copyright (C) 2020 Vincent Crocher
+//    The University of Melbourne
+//
+//	  This file is part of ShoulderTrackingIMU.
+//
+//
+//---------------------------------------------------------------------------
+#include "Headless.h"
+#include <signal.h>
+#include <string.h>
+#ifndef WINDOWS
+    #include <errno.h>
+    #include <unistd.h>
+    #include <fcntl.h>
+    #include <sys/select.h>
+    #include <sys/socket.h>
+    #include <sys/un.h>
+#endif
+
+
+//Set by the signal handler, handled by the loop
+static volatile sig_atomic_t StopSignal=0, RotateSignal=0, PauseSignal=0, PlaySignal=0;
+
+static void Signal_cb(int sig)
+{
+    switch(sig)
+    {
+        #ifndef WINDOWS
+        case SIGHUP:
+            RotateSignal=1;
+            break;
+        case SIGUSR1:
+            PauseSignal=1;
+            break;
+        case SIGUSR2:
+            PlaySignal=1;
+            break;
+        #endif
+        default:
+            StopSignal=1;
+            break;
+    }
+}
+
+static double Now()
+{
+    struct timeval t;
+    gettimeofday(&t, NULL);
+    return t.tv_sec + t.tv_usec / (1000.0*1000.0);
+}
+
+
+Headless::Headless(mode_type init_mode, const char *control_path, ReplaySource *replay, SerialCapture *wire)
+{
+    Play=false;
+    Paused=false;
+    ActivityEnabled=false;
+    Stop=false;
+    WasConnected=false;
+    NbMissedUpdates=0;
+    NbValues=0;
+    LastConnectTime=LastLinkTime=LastStatusTime=0;
+    ControlSocket=ControlClient=-1;
+    ControlPath[0]='\0';
+    ControlLineNb=0;
+
+    Preferences = new Fl_Preferences(Fl_Preferences::USER, "ShoulderTrackerIMU", "prefs");
+    Acq.Init(Preferences, init_mode);
+    printf("%s mode, %s.\n", init_mode==Static ? "STATIC" : "DYNAMIC", Acq.Intervention ? "intervention" : "baseline");
+
+    if(control_path && !OpenControl(control_path))
+        printf("Error: cannot create the control socket %s.\n", control_path);
+
+    //Quiet: no message box
+    SerialCom = new Serial(true, replay, wire);
+    Acq.SerialCom = SerialCom;
+}
+
+Headless::~Headless()
+{
+    Activity.Stop();
+    CloseControl();
+    Acq.CloseLog();
+    delete SerialCom;
+    delete Preferences;
+}
+
+//! Pause/play on the user activity (Linux input devices, see EvdevActivitySource)
+//!\return false if not available (no readable input device)
+bool Headless::EnableActivity()
+{
+    #ifdef __linux__
+        ActivityEnabled=Activity.Start(new EvdevActivitySource());
+    #else
+        printf("Activity: not available on this platform.\n");
+    #endif
+    return ActivityEnabled;
+}
+
+//! Acquisition loop, until SIGINT/SIGTERM or a stop command
+//!\return 0
+int Headless::Run()
+{
+    signal(SIGINT, Signal_cb);
+    signal(SIGTERM, Signal_cb);
+    #ifndef WINDOWS
+        signal(SIGHUP, Signal_cb);
+        signal(SIGUSR1, Signal_cb);
+        signal(SIGUSR2, Signal_cb);
+        signal(SIGPIPE, SIG_IGN); //Control client gone
+    #endif
+
+    LastStatusTime=Now();
+    while(!Stop)
+    {
+        HandleSignals();
+        PollControl();
+        if(Stop || SerialCom->IsReplayEnded())
+            break;
+
+        //Auto-connect and play
+        double t=Now();
+        if(!SerialCom->GetConnected() && t-LastConnectTime>=HEADLESS_CONNECT_PERIOD_S)
+        {
+            LastConnectTime=t;
+            Connect();
+        }
+        //User activity: pause when inactive, automatic play again when back
+        bool active=true;
+        if(ActivityEnabled)
+        {
+            Activity.Update();
+            active=Activity.IsActive();
+            if(Play && !active)
+            {
+                printf("Inactive: pause.\n");
+                SetPlay(false);
+            }
+            //Events while paused are not logged
+            if(!Play)
+            {
+                ActivityEvent events[ACTIVITY_BUFFER_SIZE];
+                Activity.GetEvents(events, ACTIVITY_BUFFER_SIZE);
+            }
+        }
+        if(SerialCom->GetConnected() && !Play && !Paused && active)
+            SetPlay(true);
+
+        if(Play)
+        {
+            ReadValues();
+            //Link quality evaluation (streaming level)
+            if(t-LastLinkTime>=LINK_WINDOW_S)
+            {
+                LastLinkTime=t;
+                Acq.UpdateStreaming();
+            }
+        }
+        else
+        {
+            Wait(HEADLESS_IDLE_WAIT_MS);
+        }
+
+        if(t-LastStatusTime>=HEADLESS_STATUS_PERIOD_S)
+        {
+            LastStatusTime=t;
+            char status[256];
+            Status(status, 256);
+            printf("%s\n", status);
+            fflush(stdout);
+        }
+    }
+
+    //Keep device learnt thresholds for next session, and close the log properly
+    printf("Stopping.\n");
+    if(SerialCom->GetConnected())
+    {
+        SetPlay(false);
+        Acq.SaveThresholdProfile();
+    }
+    Acq.CloseLog();
+    SerialCom->Disconnect();
+    return 0;
+}
+
+//! Try to connect to a device (quietly): set it up on first connection
+void Headless::Connect()
+{
+    if(!SerialCom->Connect(true))
+        return;
+
+    NbMissedUpdates=0;
+    SerialCom->SetMode(Acq.InitMode);
+    if(!WasConnected)
+    {
+        Acq.DeviceConnected();
+        //No feedback during baseline
+        SerialCom->SetTesting(!Acq.Intervention);
+        WasConnected=true;
+    }
+}
+
+//! Play/pause: both on device and local (logging)
+void Headless::SetPlay(bool play)
+{
+    if(!SerialCom->SetState(play))
+        return;
+
+    if(play)
+    {
+        printf("Play%s\n", SerialCom->IsTesting() ? "/Testing" : "");
+        NbMissedUpdates=0;
+        LastLinkTime=Now();
+        //If no log file opened yet
+        if(!Acq.Log.IsOpen())
+            Acq.OpenLog();
+    }
+    else
+    {
+        printf("Pause\n");
+        Acq.Paused();
+    }
+    Play=play;
+    fflush(stdout);
+}
+
+//! Read (and log) the next values: waits for them (see Serial::ReadBinary)
+void Headless::ReadValues()
+{
+    char mode, state;
+    float device_time;
+    float vals[4], thresholds[2];
+
+    if(SerialCom->ReadBinary(&mode, &state, &device_time, vals, thresholds)>=0)
+    {
+        double t_s=Now();
+        NbMissedUpdates=0;
+        Acq.Link.AddSample(device_time, t_s);
+        int mouse_x=-1, mouse_y=-1;
+        if(ActivityEnabled)
+        {
+            ActivityEvent events[ACTIVITY_BUFFER_SIZE];
+            int nb_events=Activity.GetEvents(events, ACTIVITY_BUFFER_SIZE);
+            if(nb_events>0)
+                Acq.LogMouse(events, nb_events);
+            Activity.GetPosition(&mouse_x, &mouse_y);
+        }
+        Acq.AddValues('G', mode, state, t_s, device_time, vals, thresholds, mouse_x, mouse_y);
+        NbValues++;
+    }
+    else
+    {
+        NbMissedUpdates++;
+        Acq.Link.AddError();
+        //No values for too long: close the connection, it will be reopened next loop
+        if(NbMissedUpdates>HEADLESS_MAX_MISSED)
+        {
+            printf("No values received: reconnecting.\n");
+            fflush(stdout);
+            SerialCom->Disconnect();
+            Play=false;
+            NbMissedUpdates=0;
+        }
+    }
+}
+
+//! One line status
+void Headless::Status(char *status, int size)
+{
+    const char *state=Play ? "playing" : (Paused ? "paused" : (SerialCom->GetConnected() ? (ActivityEnabled && !Activity.IsActive() ? "inactive" : "connected") : "connecting"));
+    snprintf(status, size, "%s, %s, %lu values, link level %d (loss %.0f%%), log %s part %d (%lu bytes)",
+             state, Acq.Intervention ? "intervention" : "baseline", NbValues, Acq.Link.GetLevel(), Acq.Link.GetLoss()*100,
+             Acq.Log.IsOpen() ? Acq.Filename : "none", Acq.LogPart, Acq.Log.GetSize());
+}
+
+//! Execute a control command and write its (one line) reply
+void Headless::Command(const char *cmd, char *reply, int size)
+{
+    if(strcmp(cmd, "status")==0)
+    {
+        Status(reply, size);
+    }
+    else if(strcmp(cmd, "pause")==0)
+    {
+        Paused=true;
+        if(Play)
+            SetPlay(false);
+        snprintf(reply, size, "OK");
+    }
+    else if(strcmp(cmd, "play")==0)
+    {
+        Paused=false; //Will play as soon as connected
+        snprintf(reply, size, "OK");
+    }
+    else if(strcmp(cmd, "rotate")==0)
+    {
+        if(Acq.Log.IsOpen())
+            Acq.RotateLog();
+        snprintf(reply, size, "OK");
+    }
+    else if(strcmp(cmd, "stop")==0)
+    {
+        Stop=true;
+        snprintf(reply, size, "OK");
+    }
+    else
+    {
+        snprintf(reply, size, "ERROR unknown command (status, pause, play, rotate or stop)");
+    }
+}
+
+void Headless::HandleSignals()
+{
+    if(StopSignal)
+    {
+        Stop=true;
+        StopSignal=0;
+    }
+    if(RotateSignal)
+    {
+        RotateSignal=0;
+        if(Acq.Log.IsOpen())
+            Acq.RotateLog();
+    }
+    if(PauseSignal)
+    {
+        PauseSignal=0;
+        char reply[8];
+        Command("pause", reply, 8);
+    }
+    if(PlaySignal)
+    {
+        PlaySignal=0;
+        char reply[8];
+        Command("play", reply, 8);
+    }
+}
+
+#ifndef WINDOWS
+//! Create the (Unix domain) control socket
+bool Headless::OpenControl(const char *path)
+{
+    struct sockaddr_un addr;
+    if(strlen(path)>=sizeof(addr.sun_path))
+        return false;
+
+    ControlSocket=socket(AF_UNIX, SOCK_STREAM, 0);
+    if(ControlSocket<0)
+        return false;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family=AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path); //Left by a previous run
+    if(bind(ControlSocket, (struct sockaddr*)&addr, sizeof(addr))!=0 || listen(ControlSocket, 2)!=0)
+    {
+        close(ControlSocket);
+        ControlSocket=-1;
+        return false;
+    }
+    fcntl(ControlSocket, F_SETFL, O_NONBLOCK);
+    strcpy(ControlPath, path);
+    printf("Control socket: %s\n", ControlPath);
+    return true;
+}
+
+void Headless::CloseControl()
+{
+    if(ControlClient>=0)
+        close(ControlClient);
+    if(ControlSocket>=0)
+    {
+        close(ControlSocket);
+        unlink(ControlPath);
+    }
+    ControlClient=ControlSocket=-1;
+}
+
+//! Sleep up to timeout_ms, woken up by control commands and signals
+void Headless::Wait(int timeout_ms)
+{
+    fd_set fds;
+    FD_ZERO(&fds);
+    int max_fd=-1;
+    if(ControlSocket>=0)
+    {
+        FD_SET(ControlSocket, &fds);
+        max_fd=ControlSocket;
+    }
+    if(ControlClient>=0)
+    {
+        FD_SET(ControlClient, &fds);
+        if(ControlClient>max_fd)
+            max_fd=ControlClient;
+    }
+    struct timeval timeout;
+    timeout.tv_sec=timeout_ms/1000;
+    timeout.tv_usec=(timeout_ms%1000)*1000;
+    select(max_fd+1, &fds, NULL, NULL, &timeout);
+}
+
+//! Accept a client and execute its commands (non blocking): one client at a time, a new one replaces it
+void Headless::PollControl()
+{
+    if(ControlSocket<0)
+        return;
+
+    int client=accept(ControlSocket, NULL, NULL);
+    if(client>=0)
+    {
+        if(ControlClient>=0)
+            close(ControlClient);
+        ControlClient=client;
+        ControlLineNb=0;
+        fcntl(ControlClient, F_SETFL, O_NONBLOCK);
+    }
+    if(ControlClient<0)
+        return;
+
+    char buffer[256];
+    int n=read(ControlClient, buffer, 256);
+    if(n==0 || (n<0 && errno!=EAGAIN && errno!=EWOULDBLOCK))
+    {
+        close(ControlClient);
+        ControlClient=-1;
+        return;
+    }
+    for(int i=0; i<n; i++)
+    {
+        if(buffer[i]=='\n' || buffer[i]=='\r')
+        {
+            if(ControlLineNb==0)
+                continue;
+            ControlLine[ControlLineNb]='\0';
+            ControlLineNb=0;
+            char reply[256];
+            Command(ControlLine, reply, 255);
+            strcat(reply, "\n");
+            if(write(ControlClient, reply, strlen(reply))<0)
+                break;
+        }
+        else if(ControlLineNb<HEADLESS_CONTROL_MAX_LINE-1)
+        {
+            ControlLine[ControlLineNb++]=buffer[i];
+        }
+    }
+}
+#else
+//! No control socket on Windows: signals only (Ctrl+C)
+bool Headless::OpenControl(const char *)
+{
+    return false;
+}
+
+void Headless::CloseControl()
+{
+}
+
+void Headless::Wait(int timeout_ms)
+{
+    Sleep(timeout_ms);
+}
+
+void Headless::PollControl()
+{
+}
+#endif
@@ -0,0 +1,81 @@
+//--------------------------------------------------------------------------
+//
+//    Copyright (C) 2020 Vincent Crocher
+//    The University of Melbourne
+//
+//	  This file is part of ShoulderTrackingIMU.
+//
+//
+//---------------------------------------------------------------------------
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <stdio.h>
+#include <FL/Fl_Preferences.H>
+
+#include "Acquisition.h"
+
+#define HEADLESS_CONNECT_PERIOD_S 0.5 //!< Connection attempts period (as the GUI auto-connect)
+#define HEADLESS_MAX_MISSED 30 //!< Consecutive failed reads (~1s) before reconnecting
+#define HEADLESS_IDLE_WAIT_MS 200 //!< Sleep between two loops when not streaming (control socket still served)
+#define HEADLESS_STATUS_PERIOD_S 600 //!< Status line printed every 10min
+#define HEADLESS_CONTROL_MAX_LINE 64 //!< Longest control command
+
+
+//! Acquisition without GUI (--headless), e.g. on a small always-on Linux box next to the
+//! patient: connects to the device, streams, and logs as the patient GUI does (auto-connect,
+//! play as soon as connected, thresholds profiles, adaptive streaming, log rotation) in a
+//! plain loop: no FLTK event loop, window or mouse hook. The loop is paced by the device:
+//! ReadBinary() sleeps until values come (<=~30ms), and sleeps HEADLESS_IDLE_WAIT_MS
+//! otherwise. Controlled by:
+//!  - signals: SIGINT/SIGTERM stop (log closed properly), SIGHUP starts a new log part,
+//!    SIGUSR1 pauses and SIGUSR2 resumes the acquisition.
+//!  - an optional local control socket (Unix domain, not on Windows): one command per line
+//!    (status, pause, play, rotate, stop), one reply line each, e.g.
+//!    echo status | nc -U /tmp/shouldertracker.sock
+//! Settings (intervention, log options, thresholds profiles) are the GUI preferences.
+//! With a replay (--replay), stops at the end of the recording.
+//! Optionally (--activity, Linux input devices), pauses while the patient is not using the
+//! computer and plays again as soon as they are back, as the GUI does with the mouse.
+class Headless
+{
+    public:
+        Headless(mode_type init_mode, const char *control_path=NULL, ReplaySource *replay=NULL, SerialCapture *wire=NULL);
+        ~Headless();
+
+        bool EnableActivity();
+        int Run();
+
+    private:
+        void Connect();
+        void SetPlay(bool play);
+        void ReadValues();
+        void Status(char *status, int size);
+        void Command(const char *cmd, char *reply, int size);
+        void HandleSignals();
+        bool OpenControl(const char *path);
+        void CloseControl();
+        void Wait(int timeout_ms);
+        void PollControl();
+
+        Fl_Preferences *Preferences;
+        Serial *SerialCom;
+        Acquisition Acq;
+        ActivityMonitor Activity; //!< User activity (if enabled): automatic pause/play
+        bool ActivityEnabled;
+        bool Play; //!< Values being received and logged
+        bool Paused; //!< Pause requested (signal or control): no automatic play
+        bool Stop;
+        bool WasConnected;
+        int NbMissedUpdates;
+        unsigned long int NbValues;
+        double LastConnectTime, LastLinkTime, LastStatusTime;
+
+        //Control socket: listening one and (single) client connection
+        int ControlSocket, ControlClient;
+        char ControlPath[108];
+        char ControlLine[HEADLESS_CONTROL_MAX_LINE];
+        int ControlLineNb;
+};
+
+#endif // HEADLESS_H
@@ -0,0 +1,106 @@
+//--------------------------------------------------------------------------
+//
+//    Copyright (C) 2020 Vincent Crocher
+//    The University of Melbourne
+//
+//	  This file is part of ShoulderTrackingIMU.
+//
+//
+//---------------------------------------------------------------------------
+#include "LinkMonitor.h"
+
+//Full rate single sample frames first, then batching (less frames for the same data), then decimation
+const StreamingLevel LinkMonitor::Levels[LinkMonitor::NbLevels]={{1, 1}, {4, 1}, {4, 2}, {4, 4}};
+
+
+LinkMonitor::LinkMonitor()
+{
+    Reset();
+}
+
+//!Back to full rate (level 0)
+void LinkMonitor::Reset()
+{
+    Level=PreviousLevel=0;
+    NbGoodWindows=0;
+    Loss=0;
+    Jitter=0;
+    ResetWindow();
+}
+
+void LinkMonitor::ResetWindow()
+{
+    NbSamples=0;
+    NbErrors=0;
+}
+
+//!Add a received sample: device time (s) and host reception time (s)
+void LinkMonitor::AddSample(float device_time, double pc_time)
+{
+    double offset=pc_time-device_time;
+    if(NbSamples==0)
+    {
+        FirstDeviceTime=device_time;
+        MinOffset=offset;
+        MaxOffset=offset;
+    }
+    else
+    {
+        if(offset<MinOffset)
+            MinOffset=offset;
+        if(offset>MaxOffset)
+            MaxOffset=offset;
+    }
+    LastDeviceTime=device_time;
+    NbSamples++;
+}
+
+//!Evaluate the current window and change level if required: call every LINK_WINDOW_S
+//!\return true if the level has changed
+bool LinkMonitor::Update()
+{
+    //Not enough samples to judge (pause, device changing mode...)
+    if(NbSamples<LINK_MIN_SAMPLES)
+    {
+        ResetWindow();
+        return false;
+    }
+
+    //Expected nb of samples between first and last received ones at the current level
+    float period=DEVICE_LOOP_PERIOD_S*Levels[Level].Decimation;
+    float expected=(LastDeviceTime-FirstDeviceTime)/period+1;
+    Loss=(expected>NbSamples)?1-NbSamples/expected:0;
+    Jitter=MaxOffset-MinOffset;
+
+    PreviousLevel=Level;
+    if(Loss>LINK_DOWN_LOSS || NbErrors>LINK_DOWN_ERRORS || Jitter>LINK_DOWN_JITTER_S)
+    {
+        NbGoodWindows=0;
+        if(Level<NbLevels-1)
+            Level++;
+    }
+    else if(Loss<LINK_UP_LOSS && NbErrors==0 && Jitter<LINK_UP_JITTER_S)
+    {
+        NbGoodWindows++;
+        if(NbGoodWindows>=LINK_UP_NB_WINDOWS && Level>0)
+        {
+            Level--;
+            NbGoodWindows=0;
+        }
+    }
+    else
+    {
+        NbGoodWindows=0;
+    }
+
+    ResetWindow();
+    return Level!=PreviousLevel;
+}
+
+//!Back to the level before the last Update() (device did not apply the change): the next window evaluation retries it
+void LinkMonitor::Revert()
+{
+    if(Level<PreviousLevel) //Step up not applied: retry at the next good window
+        NbGoodWindows=LINK_UP_NB_WINDOWS-1;
+    Level=PreviousLevel;
+}
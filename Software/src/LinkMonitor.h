@@ -0,0 +1,68 @@
+//--------------------------------------------------------------------------
+//
+//    Copyright (C) 2020 Vincent Crocher
+//    The University of Melbourne
+//
+//	  This file is part of ShoulderTrackingIMU.
+//
+//
+//---------------------------------------------------------------------------
+#ifndef LINKMONITOR_H
+#define LINKMONITOR_H
+
+#define DEVICE_LOOP_PERIOD_S 0.01 //!< Device loop (sampling) period (as in SerialWin.h)
+#define LINK_WINDOW_S 2. //!< Link quality evaluated over windows of 2s
+#define LINK_MIN_SAMPLES 10 //!< Windows with less samples (e.g. pause) are not evaluated
+#define LINK_DOWN_LOSS 0.10 //!< Step down above 10% of lost samples...
+#define LINK_DOWN_ERRORS 5 //!< ...or 5 reading errors...
+#define LINK_DOWN_JITTER_S 0.3 //!< ...or 0.3s of delay jitter
+#define LINK_UP_LOSS 0.02 //!< Step up after LINK_UP_NB_WINDOWS windows with less than 2% of losses, no error and a jitter below 0.1s
+#define LINK_UP_JITTER_S 0.1
+#define LINK_UP_NB_WINDOWS 3
+
+//! One streaming level: samples per frame and device loops per sample
+typedef struct
+{
+    int BatchSize;
+    int Decimation;
+} StreamingLevel;
+
+//! Link quality estimation from the received samples, and choice of the device streaming
+//! level accordingly: less (batched) frames and then less samples when the link degrades
+//! (BLE range, interference), back to full rate once it is good again.
+//! Loss: 1-received/expected samples (from the device times). Jitter: spread of the
+//! host-device time offset over the window (i.e. of the transmission delay).
+class LinkMonitor
+{
+    public:
+        LinkMonitor();
+
+        void Reset();
+        void AddSample(float device_time, double pc_time);
+        void AddError() {NbErrors++;}
+        bool Update();
+        void Revert();
+
+        int GetLevel() {return Level;}
+        const StreamingLevel& GetStreaming() {return Levels[Level];}
+        float GetLoss() {return Loss;}
+        float GetJitter() {return Jitter;}
+
+    private:
+        void ResetWindow();
+
+        static const int NbLevels=4;
+        static const StreamingLevel Levels[NbLevels];
+        int Level, PreviousLevel;
+        int NbGoodWindows;
+
+        //Current window
+        int NbSamples, NbErrors;
+        float FirstDeviceTime, LastDeviceTime;
+        double MinOffset, MaxOffset;
+
+        //Last window evaluation
+        float Loss, Jitter;
+};
+
+#endif // LINKMONITOR_H
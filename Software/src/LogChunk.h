@@ -0,0 +1,47 @@
+//--------------------------------------------------------------------------
+//
+//    Copyright (C) 2020 Vincent Crocher
+//    The University of Melbourne
+//
+//	  This file is part of ShoulderTrackingIMU.
+//
+//
+//---------------------------------------------------------------------------
+#ifndef LOGCHUNK_H
+#define LOGCHUNK_H
+
+#include <string.h>
+#include <zlib.h> //Bundled with FLTK (fltk_z) on Win32
+
+//! Compressed log files are a sequence of independently compressed (zlib) chunks, each
+//! preceded by a header: "STZC", uint32 offset of the chunk in the uncompressed stream,
+//! uint32 uncompressed size, uint32 compressed size, uint32 crc32 of the uncompressed
+//! data (LSB first). A chunk can be decompressed alone: chunks can be decompressed in
+//! parallel, or only the ones of interest. A crash only loses the chunk being written.
+#define LOG_CHUNK_HEADER_SIZE 20
+#define LOG_CHUNK_LEVEL 6 //!< zlib compression level
+
+//! Max size of the compressed chunk (with its header) of raw_size bytes
+inline unsigned long int LogChunkBound(unsigned long int raw_size)
+{
+    return LOG_CHUNK_HEADER_SIZE+compressBound(raw_size);
+}
+
+//! Compress raw_size bytes at raw_offset of the uncompressed stream into a chunk (out must
+//! be LogChunkBound(raw_size) long)
+//!\return chunk size (header included), 0 on error
+inline unsigned long int LogChunkCompress(const unsigned char *raw, unsigned long int raw_size, unsigned long int raw_offset, unsigned char *out)
+{
+    uLongf size=compressBound(raw_size);
+    if(compress2(out+LOG_CHUNK_HEADER_SIZE, &size, raw, raw_size, LOG_CHUNK_LEVEL)!=Z_OK)
+        return 0;
+    unsigned long int crc=crc32(crc32(0L, Z_NULL, 0), raw, raw_size);
+    unsigned long int fields[4]={raw_offset, raw_size, size, crc};
+    memcpy(out, "STZC", 4);
+    for(int f=0; f<4; f++)
+        for(int i=0; i<4; i++)
+            out[4+4*f+i]=(fields[f]>>(8*i))&0xFF;
+    return LOG_CHUNK_HEADER_SIZE+size;
+}
+
+#endif // LOGCHUNK_H
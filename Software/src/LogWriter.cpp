@@ -0,0 +1,352 @@
+//--------------------------------------------------------------------------
+//
+//    Copyright (C) 2020 Vincent Crocher
+//    The University of Melbourne
+//
+//	  This file is part of ShoulderTrackingIMU.
+//
+//
+//---------------------------------------------------------------------------
+#include "LogWriter.h"
+#include "LogChunk.h"
+#include "MetricsRegistry.h"
+#include <string.h>
+#ifdef WINDOWS
+    #include <io.h>
+#else
+    #include <unistd.h>
+    #include <time.h>
+#endif
+
+
+LogWriter::LogWriter()
+{
+    File=NULL;
+    Running=false;
+    SyncInterval=LOG_DEFAULT_SYNC_S;
+    Compress=false;
+    ChunkBuffer=new unsigned char[LogChunkBound(LOG_BUFFER_SIZE)];
+    Size=0;
+    //Preallocated once: no allocation while logging
+    Buffers[0]=new char[LOG_BUFFER_SIZE];
+    Buffers[1]=new char[LOG_BUFFER_SIZE];
+    Front=Buffers[0];
+    Back=Buffers[1];
+    FrontSize=BackSize=0;
+    #ifdef WINDOWS
+        Thread=NULL;
+        InitializeCriticalSection(&Lock);
+        WakeEvent=CreateEvent(NULL, FALSE, FALSE, NULL); //Auto reset
+        QueryPerformanceFrequency(&Frequency);
+    #else
+        pthread_mutex_init(&Lock, NULL);
+        pthread_cond_init(&WakeCond, NULL);
+        WakeFlag=false;
+    #endif
+    memset(&Stats, 0, sizeof(LogWriterStats));
+}
+
+LogWriter::~LogWriter()
+{
+    Close();
+    #ifdef WINDOWS
+        CloseHandle(WakeEvent);
+        DeleteCriticalSection(&Lock);
+    #else
+        pthread_cond_destroy(&WakeCond);
+        pthread_mutex_destroy(&Lock);
+    #endif
+    delete[] Buffers[0];
+    delete[] Buffers[1];
+    delete[] ChunkBuffer;
+}
+
+//!Open (create) the log file and start the writer thread
+//!\return false if the file cannot be created
+bool LogWriter::Open(const char *filename)
+{
+    if(File)
+        Close();
+
+    File=fopen(filename, "wb");
+    if(!File)
+        return false;
+
+    FrontSize=BackSize=0;
+    RawOffset=0;
+    Size=0;
+    memset(&Stats, 0, sizeof(LogWriterStats));
+    Running=true;
+    #ifdef WINDOWS
+        Thread=CreateThread(NULL, 0, WriterThread, (LPVOID)this, 0, NULL);
+        bool started=(Thread!=NULL);
+    #else
+        WakeFlag=false;
+        bool started=(pthread_create(&Thread, NULL, WriterThread, this)==0);
+    #endif
+    if(!started)
+    {
+        Running=false;
+        fclose(File);
+        File=NULL;
+        return false;
+    }
+    return true;
+}
+
+//!Write everything left (and trailer, which can be larger than the buffers), sync and close the file.
+//! Blocks until the writer thread is done.
+void LogWriter::Close(const void *trailer, int trailer_size)
+{
+    if(!File)
+        return;
+
+    Running=false;
+    Wake();
+    #ifdef WINDOWS
+        WaitForSingleObject(Thread, INFINITE);
+        CloseHandle(Thread);
+        Thread=NULL;
+    #else
+        pthread_join(Thread, NULL);
+    #endif
+
+    if(trailer && trailer_size>0)
+    {
+        Size+=trailer_size;
+        WriteData((const char*)trailer, trailer_size);
+        Sync();
+    }
+    fclose(File);
+    File=NULL;
+
+    printf("Log: %lu lines (%lu dropped), %lu writes, %lu bytes (%lu on disk). Copy avg %.3fms max %.3fms, write+sync avg %.1fms max %.1fms.\n",
+           Stats.NbLines, Stats.NbDropped, Stats.NbWrites, Stats.RawBytes, Stats.FileBytes,
+           Stats.NbLines>0 ? Stats.TotalCopyTime/Stats.NbLines : 0, Stats.MaxCopyTime,
+           Stats.NbWrites>0 ? Stats.TotalWriteTime/Stats.NbWrites : 0, Stats.MaxWriteTime);
+}
+
+//!Copy data into the front buffer (caller thread, no disk access). All or nothing:
+//!\return false if the data was dropped (both buffers full)
+bool LogWriter::Write(const void *data, int size)
+{
+    if(!File)
+        return false;
+
+    double t0=NowMs();
+
+    Enter();
+    bool written=false, full;
+    if(FrontSize+size<=LOG_BUFFER_SIZE)
+    {
+        memcpy(Front+FrontSize, data, size);
+        FrontSize+=size;
+        Size+=size;
+        Stats.NbLines++;
+        written=true;
+        PipelineMetrics.Record(MetricLogQueue, FrontSize);
+        //Nearly full: don't wait for the sync interval
+        full=(FrontSize>LOG_BUFFER_SIZE-LOG_MAX_LINE);
+    }
+    else
+    {
+        //Writer still busy with the back buffer
+        Stats.NbDropped++;
+        PipelineMetrics.Add(MetricLogDropped);
+        full=true;
+    }
+    double t=NowMs()-t0;
+    Stats.TotalCopyTime+=t;
+    if(t>Stats.MaxCopyTime)
+        Stats.MaxCopyTime=t;
+    Leave();
+
+    if(full)
+        Wake();
+    return written;
+}
+
+//!Format a line into the front buffer (caller thread, no disk access)
+void LogWriter::Printf(const char *format, ...)
+{
+    if(!File)
+        return;
+
+    char line[LOG_MAX_LINE];
+    va_list args;
+    va_start(args, format);
+    int n=vsnprintf(line, LOG_MAX_LINE, format, args);
+    va_end(args);
+    if(n<0)
+        return;
+    if(n>=LOG_MAX_LINE)
+        n=LOG_MAX_LINE-1; //Truncated
+
+    Write(line, n);
+}
+
+//!Copy of the current statistics
+void LogWriter::GetStats(LogWriterStats *stats)
+{
+    Enter();
+    (*stats)=Stats;
+    Leave();
+}
+
+//!Swap the buffers and write the (previous front) one to disk, synced
+void LogWriter::WriteBack()
+{
+    Enter();
+    char *tmp=Back;
+    Back=Front;
+    BackSize=FrontSize;
+    Front=tmp;
+    FrontSize=0;
+    Leave();
+
+    if(BackSize==0)
+        return;
+
+    double t0=NowMs();
+    WriteData(Back, BackSize);
+    Sync();
+    BackSize=0;
+    double t=NowMs()-t0;
+    PipelineMetrics.Record(MetricLogWriteTime, (long long int)(t*1000));
+
+    Enter();
+    Stats.NbWrites++;
+    Stats.TotalWriteTime+=t;
+    if(t>Stats.MaxWriteTime)
+        Stats.MaxWriteTime=t;
+    Leave();
+}
+
+//!Write data to the file, as a compressed chunk if required (writer thread, or after it stopped)
+void LogWriter::WriteData(const char *data, unsigned long int size)
+{
+    unsigned long int file_bytes=size;
+    if(Compress)
+    {
+        //Trailer may be larger than the buffers
+        unsigned char *chunk=(size<=LOG_BUFFER_SIZE) ? ChunkBuffer : new unsigned char[LogChunkBound(size)];
+        file_bytes=LogChunkCompress((const unsigned char*)data, size, RawOffset, chunk);
+        if(file_bytes>0)
+            fwrite(chunk, 1, file_bytes, File);
+        if(chunk!=ChunkBuffer)
+            delete[] chunk;
+    }
+    else
+    {
+        fwrite(data, 1, size, File);
+    }
+    RawOffset+=size;
+
+    Enter();
+    Stats.RawBytes+=size;
+    Stats.FileBytes+=file_bytes;
+    Leave();
+}
+
+//!Flush the file to disk (data, not necessarily its metadata)
+void LogWriter::Sync()
+{
+    fflush(File);
+    #ifdef WINDOWS
+        FlushFileBuffers((HANDLE)_get_osfhandle(_fileno(File)));
+    #else
+        fdatasync(fileno(File));
+    #endif
+}
+
+//!Writer thread: write every SyncInterval or when woken up (front buffer full, closing)
+void LogWriter::Run()
+{
+    while(Running)
+    {
+        WaitWake(SyncInterval);
+        WriteBack();
+    }
+    //Last values
+    WriteBack();
+}
+
+#ifdef WINDOWS
+DWORD WINAPI LogWriter::WriterThread(LPVOID param)
+{
+    ((LogWriter*)param)->Run();
+    return 0;
+}
+
+void LogWriter::Wake()
+{
+    SetEvent(WakeEvent);
+}
+
+void LogWriter::WaitWake(double timeout_s)
+{
+    WaitForSingleObject(WakeEvent, (DWORD)(timeout_s*1000));
+}
+
+void LogWriter::Enter()
+{
+    EnterCriticalSection(&Lock);
+}
+
+void LogWriter::Leave()
+{
+    LeaveCriticalSection(&Lock);
+}
+
+double LogWriter::NowMs()
+{
+    LARGE_INTEGER t;
+    QueryPerformanceCounter(&t);
+    return t.QuadPart*1000./Frequency.QuadPart;
+}
+#else
+void* LogWriter::WriterThread(void *param)
+{
+    ((LogWriter*)param)->Run();
+    return NULL;
+}
+
+void LogWriter::Wake()
+{
+    pthread_mutex_lock(&Lock);
+    WakeFlag=true;
+    pthread_cond_signal(&WakeCond);
+    pthread_mutex_unlock(&Lock);
+}
+
+void LogWriter::WaitWake(double timeout_s)
+{
+    struct timespec until;
+    clock_gettime(CLOCK_REALTIME, &until);
+    long long int ns=until.tv_nsec+(long long int)(timeout_s*1e9);
+    until.tv_sec+=ns/1000000000;
+    until.tv_nsec=ns%1000000000;
+
+    pthread_mutex_lock(&Lock);
+    while(!WakeFlag && pthread_cond_timedwait(&WakeCond, &Lock, &until)==0);
+    WakeFlag=false;
+    pthread_mutex_unlock(&Lock);
+}
+
+void LogWriter::Enter()
+{
+    pthread_mutex_lock(&Lock);
+}
+
+void LogWriter::Leave()
+{
+    pthread_mutex_unlock(&Lock);
+}
+
+double LogWriter::NowMs()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec*1000.+t.tv_nsec/1e6;
+}
+#endif
@@ -0,0 +1,102 @@
+//--------------------------------------------------------------------------
+//
+//    Copyright (C) 2020 Vincent Crocher
+//    The University of Melbourne
+//
+//	  This file is part of ShoulderTrackingIMU.
+//
+//
+//---------------------------------------------------------------------------
+#ifndef LOGWRITER_H
+#define LOGWRITER_H
+
+#include <stdio.h>
+#include <stdarg.h>
+#ifdef WINDOWS
+    #include <windows.h>
+#else
+    #include <pthread.h>
+#endif
+
+#define LOG_BUFFER_SIZE (64*1024) //!< Size of each of the two buffers (~6s of values at 100Hz)
+#define LOG_MAX_LINE 256 //!< Longest line accepted by Printf(), and longest Write() that does not trigger a write
+#define LOG_DEFAULT_SYNC_S 1. //!< Default interval between two writes (and disk syncs)
+
+//! Write cost instrumentation (times in ms)
+typedef struct
+{
+    unsigned long int NbLines, NbDropped; //!< Lines (or Write() calls) logged, and lost because both buffers were full
+    unsigned long int NbWrites;
+    unsigned long int RawBytes, FileBytes; //!< Written (before and after compression)
+    double MaxCopyTime, TotalCopyTime; //!< Copy time (caller thread)
+    double MaxWriteTime, TotalWriteTime; //!< Write and sync time (writer thread)
+} LogWriterStats;
+
+//! Text log file written by a background thread: Printf() only formats the line into the
+//! front buffer (never touches the disk) and the writer thread swaps the buffers and writes
+//! and syncs (FlushFileBuffers or fdatasync) the back one every sync interval, or as
+//! soon as the front one is full. Values lost on a crash are therefore bounded to the
+//! last sync interval (plus the write time). If the disk is too slow for both buffers to
+//! be full, lines are dropped (and counted) rather than stalling the caller.
+//! With compression, each buffer written is an independent zlib chunk (see LogChunk.h),
+//! compressed by the writer thread.
+class LogWriter
+{
+    public:
+        LogWriter();
+        ~LogWriter();
+
+        bool Open(const char *filename);
+        void Close(const void *trailer=NULL, int trailer_size=0);
+        bool IsOpen() {return File!=NULL;}
+        void SetSyncInterval(double interval_s) {SyncInterval=interval_s;}
+        void SetCompression(bool compress) {Compress=compress;} //!< Before Open()
+        unsigned long int GetSize() {return Size;} //!< Bytes accepted since Open() (uncompressed)
+
+        bool Write(const void *data, int size);
+        void Printf(const char *format, ...);
+        void GetStats(LogWriterStats *stats);
+
+    private:
+        #ifdef WINDOWS
+            static DWORD WINAPI WriterThread(LPVOID param);
+        #else
+            static void* WriterThread(void *param);
+        #endif
+        void Run();
+        void WriteBack();
+        void WriteData(const char *data, unsigned long int size);
+        void Sync();
+        void Wake();
+        void WaitWake(double timeout_s);
+        void Enter();
+        void Leave();
+        double NowMs();
+
+        FILE *File;
+        #ifdef WINDOWS
+            HANDLE Thread, WakeEvent;
+            CRITICAL_SECTION Lock; //!< Protects Front, FrontSize and Stats
+            LARGE_INTEGER Frequency;
+        #else
+            pthread_t Thread;
+            pthread_cond_t WakeCond;
+            bool WakeFlag; //!< Wake() called (auto reset event)
+            pthread_mutex_t Lock; //!< Protects Front, FrontSize, Stats and WakeFlag
+        #endif
+        volatile bool Running;
+        double SyncInterval;
+        bool Compress;
+        unsigned char *ChunkBuffer; //!< Compressed buffer (LogChunkBound(LOG_BUFFER_SIZE))
+        unsigned long int RawOffset; //!< Uncompressed bytes written to the file
+        volatile unsigned long int Size;
+
+        //Double buffer: Front is filled by Printf(), Back is written by the writer thread
+        char *Buffers[2];
+        char *Front, *Back;
+        int FrontSize, BackSize;
+
+        LogWriterStats Stats;
+};
+
+#endif // LOGWRITER_H
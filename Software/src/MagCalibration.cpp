@@ -0,0 +1,210 @@
+//--------------------------------------------------------------------------
+//
+//    Copyright (C) 2020 Vincent Crocher
+//    The University of Melbourne
+//
+//	  This file is part of ShoulderTrackingIMU.
+//
+//
+//---------------------------------------------------------------------------
+#include "MagCalibration.h"
+
+//Raw values (16b) are scaled down for the normal equations conditioning
+#define SAMPLE_SCALE 4096.
+
+
+//!Solve A.x=b (n x n, A and b are modified) by Gaussian elimination with partial pivoting
+//!\return false if singular
+static bool SolveLinear(double A[9][9], double b[9], double x[9], int n)
+{
+    for(int k=0; k<n; k++)
+    {
+        int pivot=k;
+        for(int i=k+1; i<n; i++)
+            if(fabs(A[i][k])>fabs(A[pivot][k]))
+                pivot=i;
+        if(fabs(A[pivot][k])<1e-12)
+            return false;
+        if(pivot!=k)
+        {
+            for(int j=0; j<n; j++)
+            {
+                double tmp=A[k][j]; A[k][j]=A[pivot][j]; A[pivot][j]=tmp;
+            }
+            double tmp=b[k]; b[k]=b[pivot]; b[pivot]=tmp;
+        }
+        for(int i=k+1; i<n; i++)
+        {
+            double f=A[i][k]/A[k][k];
+            for(int j=k; j<n; j++)
+                A[i][j]-=f*A[k][j];
+            b[i]-=f*b[k];
+        }
+    }
+    for(int i=n-1; i>=0; i--)
+    {
+        double s=b[i];
+        for(int j=i+1; j<n; j++)
+            s-=A[i][j]*x[j];
+        x[i]=s/A[i][i];
+    }
+    return true;
+}
+
+//!Eigen decomposition of a symmetric 3x3 matrix (Jacobi rotations): A=V.diag(d).V'
+static void SymmetricEigen(double A[3][3], double d[3], double V[3][3])
+{
+    double a[3][3];
+    memcpy(a, A, sizeof(a));
+    for(int i=0; i<3; i++)
+        for(int j=0; j<3; j++)
+            V[i][j]=(i==j)?1:0;
+
+    for(int sweep=0; sweep<50; sweep++)
+    {
+        double off=fabs(a[0][1])+fabs(a[0][2])+fabs(a[1][2]);
+        if(off<1e-15)
+            break;
+        for(int p=0; p<2; p++)
+        {
+            for(int q=p+1; q<3; q++)
+            {
+                if(fabs(a[p][q])<1e-18)
+                    continue;
+                double theta=(a[q][q]-a[p][p])/(2*a[p][q]);
+                double t=(theta>=0?1.:-1.)/(fabs(theta)+sqrt(theta*theta+1));
+                double c=1/sqrt(t*t+1), s=t*c;
+                //a=J'.a.J
+                for(int k=0; k<3; k++)
+                {
+                    double akp=a[k][p], akq=a[k][q];
+                    a[k][p]=c*akp-s*akq;
+                    a[k][q]=s*akp+c*akq;
+                }
+                for(int k=0; k<3; k++)
+                {
+                    double apk=a[p][k], aqk=a[q][k];
+                    a[p][k]=c*apk-s*aqk;
+                    a[q][k]=s*apk+c*aqk;
+                }
+                //V=V.J
+                for(int k=0; k<3; k++)
+                {
+                    double vkp=V[k][p], vkq=V[k][q];
+                    V[k][p]=c*vkp-s*vkq;
+                    V[k][q]=s*vkp+c*vkq;
+                }
+            }
+        }
+    }
+    for(int i=0; i<3; i++)
+        d[i]=a[i][i];
+}
+
+
+EllipsoidFit::EllipsoidFit()
+{
+    Reset();
+}
+
+void EllipsoidFit::Reset()
+{
+    memset(N, 0, sizeof(N));
+    memset(R, 0, sizeof(R));
+    NbSamples=0;
+}
+
+//!Add a raw sample: O(81), constant memory
+void EllipsoidFit::Add(float x, float y, float z)
+{
+    x/=SAMPLE_SCALE;
+    y/=SAMPLE_SCALE;
+    z/=SAMPLE_SCALE;
+    double p[9]={x*x, y*y, z*z, 2*x*y, 2*x*z, 2*y*z, 2*x, 2*y, 2*z};
+    for(int i=0; i<9; i++)
+    {
+        for(int j=i; j<9; j++)
+            N[i][j]+=p[i]*p[j];
+        R[i]+=p[i];
+    }
+    NbSamples++;
+}
+
+//!Fit on the samples added so far.
+//!W is normalised so that its largest element is 1 (only the field direction matters).
+//!\return false if not enough samples or if they don't define a plausible ellipsoid
+bool EllipsoidFit::Solve(float offset[3], float W[3][3])
+{
+    if(NbSamples<ELLIPSOID_FIT_MIN_SAMPLES)
+        return false;
+
+    //Normal equations (symmetric: fill lower half)
+    double A[9][9], b[9], theta[9];
+    for(int i=0; i<9; i++)
+    {
+        for(int j=0; j<9; j++)
+            A[i][j]=(j>=i)?N[i][j]:N[j][i];
+        b[i]=R[i];
+    }
+    if(!SolveLinear(A, b, theta, 9))
+        return false;
+
+    //Quadratic form M and linear term v: x'.M.x + 2v'.x = 1
+    double M[3][3]={{theta[0], theta[3], theta[4]}, {theta[3], theta[1], theta[5]}, {theta[4], theta[5], theta[2]}};
+    double v[3]={theta[6], theta[7], theta[8]};
+
+    //Center: -M^-1.v
+    double Mc[9][9], mv[9], c[9];
+    for(int i=0; i<3; i++)
+    {
+        for(int j=0; j<3; j++)
+            Mc[i][j]=M[i][j];
+        mv[i]=-v[i];
+    }
+    if(!SolveLinear(Mc, mv, c, 3))
+        return false;
+
+    //(x-c)'.M.(x-c) = 1 + c'.M.c
+    double s=1;
+    for(int i=0; i<3; i++)
+        for(int j=0; j<3; j++)
+            s+=c[i]*M[i][j]*c[j];
+
+    //W = sqrt(M/s): M must be definite positive
+    double d[3], V[3][3];
+    SymmetricEigen(M, d, V);
+    double min_axis=1e300, max_axis=0;
+    for(int i=0; i<3; i++)
+    {
+        if(d[i]/s<=0)
+            return false;
+        d[i]=sqrt(d[i]/s);
+        if(d[i]<min_axis)
+            min_axis=d[i];
+        if(d[i]>max_axis)
+            max_axis=d[i];
+    }
+    if(max_axis/min_axis>ELLIPSOID_FIT_MAX_AXES_RATIO)
+        return false;
+
+    double max_w=0, w[3][3];
+    for(int i=0; i<3; i++)
+    {
+        for(int j=0; j<3; j++)
+        {
+            w[i][j]=0;
+            for(int k=0; k<3; k++)
+                w[i][j]+=V[i][k]*d[k]*V[j][k];
+            if(fabs(w[i][j])>max_w)
+                max_w=fabs(w[i][j]);
+        }
+    }
+
+    for(int i=0; i<3; i++)
+    {
+        offset[i]=c[i]*SAMPLE_SCALE;
+        for(int j=0; j<3; j++)
+            W[i][j]=w[i][j]/max_w;
+    }
+    return true;
+}
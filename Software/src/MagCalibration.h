@@ -0,0 +1,39 @@
+//--------------------------------------------------------------------------
+//
+//    Copyright (C) 2020 Vincent Crocher
+//    The University of Melbourne
+//
+//	  This file is part of ShoulderTrackingIMU.
+//
+//
+//---------------------------------------------------------------------------
+#ifndef MAGCALIBRATION_H
+#define MAGCALIBRATION_H
+
+#include <math.h>
+#include <string.h>
+
+#define ELLIPSOID_FIT_MIN_SAMPLES 100 //!< Minimum nb of samples for a fit
+#define ELLIPSOID_FIT_MAX_AXES_RATIO 3. //!< Max ratio between the ellipsoid axes: beyond, the samples don't cover enough directions
+
+//! Incremental least squares ellipsoid fit of magnetometer samples (hard and soft iron calibration).
+//! Samples are fitted to a x^2 + b y^2 + c z^2 + 2d xy + 2e xz + 2f yz + 2g x + 2h y + 2i z = 1:
+//! only the normal equations (9x9) are accumulated, samples are not kept.
+//! Solve() gives the offset and the (symmetric) matrix W such that |W.(m-offset)| is constant.
+class EllipsoidFit
+{
+    public:
+        EllipsoidFit();
+
+        void Reset();
+        void Add(float x, float y, float z);
+        int GetNbSamples() {return NbSamples;}
+        bool Solve(float offset[3], float W[3][3]);
+
+    private:
+        double N[9][9]; //!< Sum of p.p' with p=(x^2, y^2, z^2, 2xy, 2xz, 2yz, 2x, 2y, 2z)
+        double R[9]; //!< Sum of p
+        int NbSamples;
+};
+
+#endif // MAGCALIBRATION_H
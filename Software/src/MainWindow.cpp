@@ -9,6 +9,8 @@
 //---------------------------------------------------------------------------
 #include "MainWindow.h"
 
+#define MAG_CALIB_DURATION_S 20 //!< Duration of the magnetometer samples collection
+
 
 //!Timer cb that regularly polls values from the device
 //! and update interface accordingly
@@ -31,6 +33,7 @@ void UpdateValues_cb(void * param)
 
         //Reset nb of consecutive missed values
         mw->NbMissedUpdates=0;
+        mw->Acq.Link.AddSample(device_time, t_s);
 
         //Update status (mode and state)
         char status[100];
@@ -67,9 +70,8 @@ void UpdateValues_cb(void * param)
                 mw->Plot->DrawStatic();
         }
 
-        //Add to plot
-        mw->Plot->AddValues(vals);
-        mw->Plot->redraw();
+        //Add to plot (displayed at the plot refresh rate)
+        mw->Plot->AddValues(vals, thresholds);
 
         //Log
         char assessment_log_letter='G';//Set to A for assessment time, G during games
@@ -77,7 +79,14 @@ void UpdateValues_cb(void * param)
             assessment_log_letter='A';
         if(mw->Play)
         {
-            fprintf(mw->logFile, "%c,%c,%c,%f,%f,%f,%f,%f,%f,%f,%f,%d,%d\n", assessment_log_letter, mw->Mode, mw->State, t_s, device_time, vals[0], vals[1], vals[2], vals[3], thresholds[0], thresholds[1], MousePosition[0], MousePosition[1]);
+            //All mouse events since last values, then values with the current position
+            ActivityEvent events[ACTIVITY_BUFFER_SIZE];
+            int nb_events=mw->Activity.GetEvents(events, ACTIVITY_BUFFER_SIZE);
+            if(nb_events>0)
+                mw->Acq.LogMouse(events, nb_events);
+            int mouse_x, mouse_y;
+            mw->Activity.GetPosition(&mouse_x, &mouse_y);
+            mw->Acq.AddValues(assessment_log_letter, mw->Mode, mw->State, t_s, device_time, vals, thresholds, mouse_x, mouse_y);
             //No audio feedback in this trial
             /*Provide audio feedback if required (not in assessment mode, not in baseline)
             if(!mw->SerialCom->IsTesting())
@@ -104,7 +113,7 @@ void UpdateValues_cb(void * param)
     {
         //Get nb of consecutive missed values
         mw->NbMissedUpdates++;
-        printf("Nop %d\n", mw->NbMissedUpdates);
+        mw->Acq.Link.AddError();
 
         if(mw->Play && (mw->MinWindow->visible() || mw->Window->visible()))
         {
@@ -113,41 +122,51 @@ void UpdateValues_cb(void * param)
     }
 }
 
-//! Check if mouse was recently active (based on MouseActivity: see WinMouseMonitor)
-void CheckMouseActivity_cb(void * param)
+//! Activity transition (from the mouse hook or activity timer thread): handled in the main loop, which reads the current state
+static void ActivityChanged(bool, void * param)
+{
+    Fl::awake(ActivityChanged_cb, param);
+}
+
+//! Mouse activity changed (see ActivityMonitor): pause or play accordingly
+void ActivityChanged_cb(void * param)
 {
     MainWindow *mw=(MainWindow*)param;
 
-    if(MouseActivity<2)
-    {
-        printf("Inactive\n");
-        mw->MouseActive=false;
-    }
-    else
-    {
-        printf("Active\n");
-        mw->MouseActive=true;
-    }
+    //Last state (several transitions may be queued)
+    if(mw->Activity.IsActive()==mw->MouseActive)
+        return;
+    mw->MouseActive=mw->Activity.IsActive();
+    printf(mw->MouseActive ? "Active\n" : "Inactive\n");
 
     //Based on activity:
     //Request pause if needed
-    if(!mw->MouseActive && mw->Play)
+    if(!mw->MouseActive && mw->Play && !mw->Calibrating)
     {
         PlayPauseButton_cb(NULL, param);
         printf("Inactive: request pause.\n");
     }
     //Request play if needed
-    if(mw->MouseActive && !mw->Play)
+    if(mw->MouseActive && !mw->Play && !mw->Calibrating)
     {
         PlayPauseButton_cb(NULL, param);
         printf("Active: request play.\n");
     }
+}
 
-    //Reinit
-    MouseActivity=0;
+//! Inactivity detection, and mouse events not logged when paused
+void ActivityTimer_cb(void * param)
+{
+    MainWindow *mw=(MainWindow*)param;
+
+    mw->Activity.Update();
+    if(!mw->Play)
+    {
+        ActivityEvent events[ACTIVITY_BUFFER_SIZE];
+        mw->Activity.GetEvents(events, ACTIVITY_BUFFER_SIZE);
+    }
 
-    //Check for change every 5s
-    Fl::repeat_timeout(5, CheckMouseActivity_cb, param);
+    Fl::repeat_timeout(ACTIVITY_UPDATE_PERIOD_S, ActivityTimer_cb, param);
 }
 
 //!Play/pause: both on device and local (logging and plotting)
@@ -170,14 +189,10 @@ void PlayPauseButton_cb(Fl_Widget * widget, void * param)
         Fl::add_timeout(0.1, UpdateValues_cb, param);
 
         //If no log file openned yet: update log filename and open
-        if(!mw->logFile)
+        if(!mw->Acq.Log.IsOpen())
         {
-            mw->GenerateFilename();
-            printf("Log file: %s\n", mw->Filename);
-            mw->FilenameInput->value(mw->Filename);
-            char fullname[1024+FL_PATH_MAX];
-            sprintf(fullname, "%s%s", mw->logPath, mw->Filename);
-            mw->logFile=fopen(fullname, "w");
+            mw->Acq.OpenLog();
+            mw->FilenameInput->value(mw->Acq.Filename);
         }
 
         mw->Play=true;
@@ -189,10 +204,14 @@ void PlayPauseButton_cb(Fl_Widget * widget, void * param)
     }
     else //was playing
     {
+        //Not connected anymore: link drop (see AutoConnectTimer_cb), the values missed meanwhile are recovered on play
+        bool local_pause=mw->SerialCom->GetConnected();
         //Ask untill sucess
         while(mw->SerialCom->Connect(true) && !mw->SerialCom->SetState(false))
             Fl::wait(0.1);
         printf("Pause\n");
+        if(local_pause)
+            mw->Acq.Paused();
 
         mw->Play=false;
         mw->OnOffBox->color(FL_YELLOW);
@@ -269,9 +288,11 @@ void Quit_cb(Fl_Widget * widget, void * param)
     fl_message_title("ShoulderTracker");
     fl_alert("Make sure you turned OFF the device !");
 
+    //Keep device learnt thresholds for next session
+    mw->Acq.SaveThresholdProfile();
+
     //Close logging if needed
-    if(mw->logFile)
-        fclose(mw->logFile);
+    mw->Acq.CloseLog();
 
     //Hide window
     mw->MinWindow->hide();
@@ -302,11 +323,11 @@ void AutoConnectTimer_cb(void * param)
         mw->NbMissedConnections=0;
 
         //If was not running already and not inactive
-        if(!mw->Play && mw->MouseActive)
+        if(!mw->Play && mw->MouseActive && !mw->Calibrating)
         {
             //Set play, mode and log
             //Set mode
-            while(mw->SerialCom->Connect(true) && !mw->SerialCom->SetMode(mw->InitMode))
+            while(mw->SerialCom->Connect(true) && !mw->SerialCom->SetMode(mw->Acq.InitMode))
                 Fl::wait(0.1);
 
             //Start timer
@@ -327,6 +348,7 @@ void AutoConnectTimer_cb(void * param)
         //If first time, show game window and set in test mode
         if(!mw->WasConnected)
         {
+            mw->Acq.DeviceConnected();
             mw->SerialCom->SetTesting(true);
             mw->AssessGameWindow->show();
             mw->AssessGameWindow->SetState(Init);
@@ -366,6 +388,54 @@ void AutoConnectTimer_cb(void * param)
         Fl::repeat_timeout(.5, AutoConnectTimer_cb, param);
 }
 
+//! Evaluate the link quality and adapt the device streaming (batching, decimation) accordingly
+void LinkMonitor_cb(void * param)
+{
+    MainWindow *mw=(MainWindow*)param;
+
+    if(mw->Play)
+        mw->Acq.UpdateStreaming();
+
+    Fl::repeat_timeout(LINK_WINDOW_S, LinkMonitor_cb, param);
+}
+
+//! Diagnostics tab: pipeline metrics over the last period (only when displayed)
+void MetricsTimer_cb(void * param)
+{
+    MainWindow *mw=(MainWindow*)param;
+
+    if(mw->DiagnosticsBrowser->visible_r())
+    {
+        double dt=mw->Diagnostics.Update();
+        int top=mw->DiagnosticsBrowser->topline();
+        mw->DiagnosticsBrowser->clear();
+
+        char line[128];
+        mw->DiagnosticsBrowser->add("@bCounter\t@b/s\t@btotal");
+        for(int i=0; i<METRICS_NB && !MetricsRegistry::IsDistribution((metric_id)i); i++)
+        {
+            const MetricInterval &m=mw->Diagnostics.Get((metric_id)i);
+            sprintf(line, "%s\t%.1f\t%lu", MetricsRegistry::GetName((metric_id)i), m.Rate, (unsigned long int)m.Total);
+            mw->DiagnosticsBrowser->add(line);
+        }
+        mw->DiagnosticsBrowser->add("");
+        mw->DiagnosticsBrowser->add("@bTime/queue\t@bmean\t@bp99\t@bmax");
+        for(int i=0; i<METRICS_NB; i++)
+        {
+            if(!MetricsRegistry::IsDistribution((metric_id)i))
+                continue;
+            const MetricInterval &m=mw->Diagnostics.Get((metric_id)i);
+            sprintf(line, "%s\t%.0f\t%ld\t%ld", MetricsRegistry::GetName((metric_id)i), m.Mean, (long int)m.P99, (long int)m.Max);
+            mw->DiagnosticsBrowser->add(line);
+        }
+        sprintf(line, "(us or queue depth, last %.1fs)", dt);
+        mw->DiagnosticsBrowser->add(line);
+        mw->DiagnosticsBrowser->topline(top);
+    }
+
+    Fl::repeat_timeout(METRICS_DISPLAY_PERIOD_S, MetricsTimer_cb, param);
+}
+
 
 //!Prompt to switch between intervention and baseline (therapist use only)
 void SetInterventionButton_cb(Fl_Widget * widget, void * param)
@@ -373,7 +443,7 @@ void SetInterventionButton_cb(Fl_Widget * widget, void * param)
     MainWindow *mw=(MainWindow*)param;
 
     fl_message_title("ShoulderTracker");
-    if(mw->Intervention)
+    if(mw->Acq.Intervention)
     {
         if(fl_choice("Are you sure you want to switch to baseline mode?", "Yes, switch", "No, stay in intervention", NULL)==0)
         {
@@ -392,10 +462,120 @@ void SetInterventionButton_cb(Fl_Widget * widget, void * param)
 }
 
 
-MainWindow::MainWindow(mode_type init_mode, bool plotting)
+//!Query device loop profile and display it (device tab)
+void ProfileButton_cb(Fl_Widget * widget, void * param)
+{
+    MainWindow *mw=(MainWindow*)param;
+
+    mw->ProfileBrowser->clear();
+
+    DeviceProfile profile;
+    if(!mw->SerialCom->GetProfile(&profile))
+    {
+        mw->ProfileBrowser->add("@iNo reply from device");
+        return;
+    }
+
+    //Per stage timing
+    char line[100];
+    mw->ProfileBrowser->add("@bStage\t@bmin\t@bavg\t@bmax");
+    for(int i=0; i<profile.NbStages; i++)
+    {
+        sprintf(line, "%s\t%d\t%d\t%d", DeviceProfileStageNames[i], profile.Min[i], profile.Avg[i], profile.Max[i]);
+        mw->ProfileBrowser->add(line);
+    }
+    mw->ProfileBrowser->add("(us, since last refresh)");
+
+    //Loop jitter
+    mw->ProfileBrowser->add("");
+    sprintf(line, "Loops\t%d", profile.NbLoops);
+    mw->ProfileBrowser->add(line);
+    sprintf(line, "Overruns\t%d\t(%.1f%%)", profile.NbOverruns, profile.NbLoops>0 ? 100.*profile.NbOverruns/profile.NbLoops : 0.);
+    mw->ProfileBrowser->add(line);
+    sprintf(line, "Max period\t%d\tus", profile.MaxDt);
+    mw->ProfileBrowser->add(line);
+    sprintf(line, "TX dropped\t%d\tframes", profile.NbDroppedFrames);
+    mw->ProfileBrowser->add(line);
+    sprintf(line, "TX max fill\t%d\tbytes", profile.MaxTxFill);
+    mw->ProfileBrowser->add(line);
+    sprintf(line, "Active\t%.1f\t%%", profile.ActivePermil/10.);
+    mw->ProfileBrowser->add(line);
+}
+
+//!Magnetometer calibration (device tab): collect raw samples while the user rotates the device,
+//! fit an ellipsoid (hard and soft iron) and apply it on the device (saved in its EEPROM)
+void MagCalibButton_cb(Fl_Widget * widget, void * param)
 {
-    InitMode=init_mode;
+    MainWindow *mw=(MainWindow*)param;
+
+    fl_message_title("ShoulderTracker");
+    if(fl_choice("Magnetometer calibration:\nslowly rotate the device in all directions for %d s.", "Cancel", "Start", NULL, MAG_CALIB_DURATION_S)!=1)
+        return;
+
+    //No live values during calibration
+    mw->Calibrating=true;
+    bool was_playing=mw->Play;
+    if(was_playing)
+        PlayPauseButton_cb(widget, param);
+    Fl::remove_timeout(UpdateValues_cb, param);
+
+    mw->ProfileBrowser->clear();
+    if(!mw->SerialCom->SetMagStreaming(true))
+    {
+        mw->ProfileBrowser->add("@iNo reply from device");
+    }
+    else
+    {
+        //Collect and fit samples as they come
+        EllipsoidFit fit;
+        short samples[64][3];
+        char line[100];
+        struct timeval t0, t1;
+        gettimeofday(&t0, NULL);
+        do
+        {
+            Fl::wait(0.05);
+            int nb=mw->SerialCom->ReadMagSamples(samples, 64);
+            for(int i=0; i<nb; i++)
+                fit.Add(samples[i][0], samples[i][1], samples[i][2]);
+            sprintf(line, "Calibrating... %d samples", fit.GetNbSamples());
+            mw->ProfileBrowser->clear();
+            mw->ProfileBrowser->add(line);
+            gettimeofday(&t1, NULL);
+        }
+        while(t1.tv_sec-t0.tv_sec<MAG_CALIB_DURATION_S);
+        mw->SerialCom->SetMagStreaming(false);
 
+        float offset[3], W[3][3];
+        if(!fit.Solve(offset, W))
+        {
+            mw->ProfileBrowser->add("@iCalibration failed: rotate the device in all directions");
+        }
+        else if(!mw->SerialCom->SetMagCalibration(offset, W))
+        {
+            mw->ProfileBrowser->add("@iNo reply from device");
+        }
+        else
+        {
+            mw->ProfileBrowser->add("@bMagnetometer calibration applied");
+            sprintf(line, "Offset\t%.0f\t%.0f\t%.0f", offset[0], offset[1], offset[2]);
+            mw->ProfileBrowser->add(line);
+            for(int i=0; i<3; i++)
+            {
+                sprintf(line, "%s\t%.3f\t%.3f\t%.3f", i==0 ? "Matrix" : "", W[i][0], W[i][1], W[i][2]);
+                mw->ProfileBrowser->add(line);
+            }
+        }
+    }
+
+    mw->Calibrating=false;
+    if(was_playing)
+        PlayPauseButton_cb(widget, param);
+}
+
+
+MainWindow::MainWindow(mode_type init_mode, bool plotting, ReplaySource *replay, SerialCapture *wire)
+{
     //Test version with plotting and controls
         Window=new Fl_Double_Window(800, 400, "Shoulder tracking");
         Window->begin();
@@ -420,7 +600,7 @@ MainWindow::MainWindow(mode_type init_mode, bool plotting)
                         StaticButton->callback(ModeGroup_cb, (void*) this);
                         DynamicButton = new Fl_Radio_Round_Button(0, 0, 100, 20, "Dynamic");
                         DynamicButton->callback(ModeGroup_cb, (void*) this);
-                        if(InitMode==Static)
+                        if(init_mode==Static)
                         {
                             StaticButton->value(1);
                             DynamicButton->value(0);
@@ -434,13 +614,32 @@ MainWindow::MainWindow(mode_type init_mode, bool plotting)
                     ModeGroup->box(FL_EMBOSSED_FRAME);
                     //Log file
                     FilenameInput = new Fl_File_Input(ModeGroup->x()+30, ModeGroup->y()+ModeGroup->h()+10, 120, 30, "Log:");
-                    GenerateFilename();
-                    printf("File: %s\n", Filename);
-                    FilenameInput->value(Filename);
-                    logFile=NULL; //Not open yet
+                    Acq.GenerateFilename();
+                    printf("File: %s\n", Acq.Filename);
+                    FilenameInput->value(Acq.Filename);
                 ControlPanel->end();
                 ControlPanel->resizable(NULL);
                 tabs->resizable(ControlPanel);
+
+                Fl_Group *DevicePanel=new Fl_Group(tabs->x(), tabs->y()+20, tabs->w(), tabs->h()-30, "Device");
+                    //Loop profile
+                    ProfileButton = new Fl_Button(DevicePanel->x()+10, DevicePanel->y()+10, 70, 20, "Profile");
+                    ProfileButton->callback(ProfileButton_cb, (void*) this);
+                    MagCalibButton = new Fl_Button(ProfileButton->x()+ProfileButton->w()+10, ProfileButton->y(), 90, 20, "Calib. mag.");
+                    MagCalibButton->callback(MagCalibButton_cb, (void*) this);
+                    ProfileBrowser = new Fl_Browser(DevicePanel->x()+5, ProfileButton->y()+ProfileButton->h()+10, DevicePanel->w()-10, DevicePanel->h()-ProfileButton->h()-25);
+                    static int profile_col_widths[] = {75, 35, 35, 35, 0};
+                    ProfileBrowser->column_widths(profile_col_widths);
+                    ProfileBrowser->textsize(11);
+                DevicePanel->end();
+
+                Fl_Group *DiagnosticsPanel=new Fl_Group(tabs->x(), tabs->y()+20, tabs->w(), tabs->h()-30, "Diagnostics");
+                    //Pipeline metrics (see MetricsRegistry)
+                    DiagnosticsBrowser = new Fl_Browser(DiagnosticsPanel->x()+5, DiagnosticsPanel->y()+5, DiagnosticsPanel->w()-10, DiagnosticsPanel->h()-10);
+                    static int diagnostics_col_widths[] = {70, 40, 35, 0};
+                    DiagnosticsBrowser->column_widths(diagnostics_col_widths);
+                    DiagnosticsBrowser->textsize(11);
+                DiagnosticsPanel->end();
             }
             tabs->end();
             StatusBar=new Fl_Box(0, Window->h()-20, Window->w(), 20, "");
@@ -484,8 +683,11 @@ MainWindow::MainWindow(mode_type init_mode, bool plotting)
 
         //Intervention/baseline
         Preferences = new Fl_Preferences(Fl_Preferences::USER, "ShoulderTrackerIMU", "prefs");
-        ReadInterventionState();
-        if(Intervention)
+        Acq.Init(Preferences, init_mode);
+        int fps;
+        Preferences->get("PlotFrameRate", fps, PLOTS_DEFAULT_FPS);
+        Plot->SetFrameRate(fps);
+        if(Acq.Intervention)
             SetInterventionButton = new Fl_Button(winW-90-5, TimeLabel->y()+TimeLabel->h()+5, 90, 40, "Set\nBaseline");
         else
             SetInterventionButton = new Fl_Button(winW-90-5, TimeLabel->y()+TimeLabel->h()+5, 90, 40, "Set\nIntervention");
@@ -507,77 +709,57 @@ MainWindow::MainWindow(mode_type init_mode, bool plotting)
     //Either full or minimal window
     if(plotting)
     {
-        //Create a serial com with the Arduino
-        SerialCom = new Serial();
+        //Create a serial com with the Arduino (or the recording to replay)
+        SerialCom = new Serial(false, replay, wire);
+        Acq.SerialCom = SerialCom;
         Window->show();
     }
     else
     {
-        //Create a serial com with the Arduino
-        SerialCom = new Serial(true);
+        //Create a serial com with the Arduino (or the recording to replay)
+        SerialCom = new Serial(true, replay, wire);
+        Acq.SerialCom = SerialCom;
         MinWindow->show();
         //Run timer for auto-connect
         Fl::add_timeout(1.0, AutoConnectTimer_cb, (void *)this);
     }
     AssessGameWindow = new GameWindow(this);
     WasConnected = false;
+    Calibrating = false;
     AssessGameWindow->hide(); //Wait for device to connect to show it
 
-    //Add mouse activity management timer (every 5s)
-    Fl::add_timeout(5, CheckMouseActivity_cb, (void *)this);
+    //Mouse activity: any mouse event (or synthetic when replaying), pause/play on transitions
+    Activity.SetListener(ActivityChanged, (void *)this);
+    if(replay || (wire && wire->IsReplay()))
+        Activity.Start(new SyntheticActivitySource());
+    else
+        Activity.Start(new WinMouseSource());
+    Fl::add_timeout(ACTIVITY_UPDATE_PERIOD_S, ActivityTimer_cb, (void *)this);
+    //Link quality evaluation (streaming level) timer
+    Fl::add_timeout(LINK_WINDOW_S, LinkMonitor_cb, (void *)this);
+    //Diagnostics tab refresh
+    Fl::add_timeout(METRICS_DISPLAY_PERIOD_S, MetricsTimer_cb, (void *)this);
 }
 
 MainWindow::~MainWindow()
 {
+    Activity.Stop();
     delete Preferences;
     //Stop transmission, close connection and destroy Serial
     delete SerialCom;
 }
 
 
-void MainWindow::GenerateFilename()
-{
-    //Get log path
-    Fl_Preferences prefs(Fl_Preferences::USER, "ShoulderTrackerIMU", "logs" );
-    prefs.getUserdataPath(logPath, FL_PATH_MAX);
-    printf("Logs path: %s\n", logPath);
-
-    //Date and time
-    char timestr[80];
-    time_t rawtime;
-    tm* timeinfo;
-    time(&rawtime);
-    timeinfo = localtime(&rawtime);
-    strftime(timestr, 80, "%Y-%m-%d-%H-%M-%S\0", timeinfo);
-
-    //Add prefix and extension
-    sprintf(Filename, "STLog_%s.csv", timestr);
-}
-
-//! Read preferences to know if in intervention or baseline and set the internal IsIntervention flag (and return true if intervention)
-bool MainWindow::ReadInterventionState()
-{
-    Intervention = false;
-    int val;
-    Preferences->get("IsIntervention", val, (int)Intervention);
-    Intervention = (bool)val;
-    return Intervention;
-}
-
 void MainWindow::SetToIntervention()
 {
-    Intervention = true;
-    Preferences->set("IsIntervention", (int)Intervention);
-    Preferences->flush();
+    Acq.SetIntervention(true);
     SetInterventionButton->label("Set\nBaseline");
     SetInterventionButton->redraw();
 }
 
 void MainWindow::SetToBaseline()
 {
-    Intervention = false;
-    Preferences->set("IsIntervention", (int)Intervention);
-    Preferences->flush();
+    Acq.SetIntervention(false);
     SetInterventionButton->label("Set\nIntervention");
     SetInterventionButton->redraw();
 }
@@ -21,28 +21,32 @@
 #include <FL/Fl_Button.H>
 #include <FL/Fl_Radio_Round_Button.H>
 #include <FL/Fl_File_Input.H>
+#include <FL/Fl_Browser.H>
 #include <FL/Fl_Double_Window.H>
 #include <FL/filename.H>
 #include <FL/Fl_Preferences.H> //To get user data path
 
 #include "Fl_TimerSimple.H"
 
+#include "SerialWin.h"
 #ifdef WINDOWS
-    #include "SerialWin.h"
     #include "windows.h"
     #include "Mmsystem.h"
     #pragma comment(lib,"winmm.lib")
-#else
-    #include "Serial.h"
 #endif
 #include "Plots.h"
+#include "MagCalibration.h"
+#include "Acquisition.h"
 #include "WinMouseMonitor.h"
 #include "GameWindow.h"
 
 
 void UpdateValues_cb(void * param);
-void CheckMouseActivity_cb(void * param);
+void ActivityChanged_cb(void * param);
+void ActivityTimer_cb(void * param);
 void AutoConnectTimer_cb(void * param);
+void LinkMonitor_cb(void * param);
+void MetricsTimer_cb(void * param);
 void PlayPauseButton_cb(Fl_Widget * widget, void * param);
 void ClearButton_cb(Fl_Widget * widget, void * param);
 void ModeGroup_cb(Fl_Widget * widget, void * param);
@@ -50,23 +54,26 @@ void FreqButton_cb(Fl_Widget * widget, void * param);
 void MoveButton_cb(Fl_Widget * widget, void * param);
 void Quit_cb(Fl_Widget * widget, void * param);
 void SetInterventionButton_cb(Fl_Widget * widget, void * param);
+void ProfileButton_cb(Fl_Widget * widget, void * param);
+void MagCalibButton_cb(Fl_Widget * widget, void * param);
 
 
 
 class MainWindow
 {
     public:
-        MainWindow(mode_type init_mode, bool plotting);
+        MainWindow(mode_type init_mode, bool plotting, ReplaySource *replay=NULL, SerialCapture *wire=NULL);
         ~MainWindow();
 
-        void GenerateFilename();
-        bool ReadInterventionState();
         void SetToIntervention();
         void SetToBaseline();
 
         friend void UpdateValues_cb(void * param);
-        friend void CheckMouseActivity_cb(void * param);
+        friend void ActivityChanged_cb(void * param);
+        friend void ActivityTimer_cb(void * param);
         friend void AutoConnectTimer_cb(void * param);
+        friend void LinkMonitor_cb(void * param);
+        friend void MetricsTimer_cb(void * param);
         friend void PlayPauseButton_cb(Fl_Widget * widget, void * param);
         friend void ClearButton_cb(Fl_Widget * widget, void * param);
         friend void ModeGroup_cb(Fl_Widget * widget, void * param);
@@ -74,6 +81,8 @@ class MainWindow
         friend void MoveButton_cb(Fl_Widget * widget, void * param);
         friend void Quit_cb(Fl_Widget * widget, void * param);
         friend void SetInterventionButton_cb(Fl_Widget * widget, void * param);
+        friend void ProfileButton_cb(Fl_Widget * widget, void * param);
+        friend void MagCalibButton_cb(Fl_Widget * widget, void * param);
 
     public:
         Fl_Double_Window *Window, *MinWindow;
@@ -86,6 +95,9 @@ class MainWindow
         Fl_Pack *ModeGroup;
         Fl_Radio_Round_Button *StaticButton, *DynamicButton;
         Fl_File_Input * FilenameInput;
+        Fl_Button * ProfileButton, * MagCalibButton;
+        Fl_Browser * ProfileBrowser;
+        Fl_Browser * DiagnosticsBrowser;
 
         Fl_Box *TitleBox;
         Fl_Box *OnOffBox;
@@ -93,15 +105,15 @@ class MainWindow
         Fl_Button *QuitButton, *SetInterventionButton;
 
         Serial *SerialCom;
-        FILE *logFile;
-        char Filename[1024], logPath[FL_PATH_MAX];
+        Acquisition Acq; //!< Device acquisition: logs, link quality, thresholds profiles
+        ActivityMonitor Activity; //!< User (mouse) activity: automatic pause/play
+        MetricsReport Diagnostics; //!< Pipeline metrics displayed in the diagnostics tab
         Fl_Preferences *Preferences;
         bool Play, MouseActive;
         int NbMissedUpdates, NbMissedConnections;
         char Mode, State;
-        mode_type InitMode;
         bool WasConnected;
-        bool Intervention; //! When true, feedback will be provided during the session, otherwise (baseline period) no feedback is provided, device stays in test mode.
+        bool Calibrating; //!< Magnetometer calibration in progress: no automatic play
 };
 
 #endif // MAINWINDOW_H
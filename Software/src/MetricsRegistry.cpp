@@ -0,0 +1,158 @@
+//--------------------------------------------------------------------------
+//
+//    Copyright (C) 2020 Vincent Crocher
+//    The University of Melbourne
+//
+//	  This file is part of ShoulderTrackingIMU.
+//
+//
+//---------------------------------------------------------------------------
+#include "MetricsRegistry.h"
+#include <string.h>
+#include <sys/time.h>
+#include <chrono>
+
+MetricsRegistry PipelineMetrics;
+
+static const char *MetricNames[METRICS_NB]={"frames", "samples", "resyncs", "skipped", "no start", "bad header", "incomplete", "invalid", "no device",
+                                            "cmd timeout", "log dropped", "read", "cmd rtt", "log write", "render", "batch queue", "log queue", "capt queue", "mouse queue"};
+static const char *MetricUnits[METRICS_NB]={"", "", "", "bytes", "", "", "", "", "", "", "", "us", "us", "us", "us", "samples", "bytes", "bytes", "events"};
+
+
+MetricsRegistry::MetricsRegistry()
+{
+    for(int i=0; i<METRICS_NB; i++)
+    {
+        Count[i].store(0);
+        Sum[i].store(0);
+        Max[i].store(0);
+        for(int k=0; k<METRICS_NB_BUCKETS; k++)
+            Buckets[i][k].store(0);
+    }
+}
+
+const char* MetricsRegistry::GetName(metric_id id)
+{
+    return MetricNames[id];
+}
+
+const char* MetricsRegistry::GetUnit(metric_id id)
+{
+    return MetricUnits[id];
+}
+
+//! Monotonic clock (us), to time the measured operations
+long long int MetricsRegistry::NowUs()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//! One value of a distribution (negative ones counted as 0)
+void MetricsRegistry::Record(metric_id id, long long int value)
+{
+    if(value<0)
+        value=0;
+    //Bucket: nb of significant bits
+    int k=(value>0) ? 64-__builtin_clzll((unsigned long long int)value) : 0;
+    if(k>=METRICS_NB_BUCKETS)
+        k=METRICS_NB_BUCKETS-1;
+
+    Count[id].fetch_add(1, std::memory_order_relaxed);
+    Sum[id].fetch_add(value, std::memory_order_relaxed);
+    Buckets[id][k].fetch_add(1, std::memory_order_relaxed);
+    long long int max=Max[id].load(std::memory_order_relaxed);
+    while(value>max && !Max[id].compare_exchange_weak(max, value, std::memory_order_relaxed));
+}
+
+//! Current values (not an atomic copy of the whole registry: values being recorded may be
+//! partly included, which only shifts them to the next interval)
+void MetricsRegistry::Snapshot(MetricsSnapshot *snapshot)
+{
+    struct timeval t;
+    gettimeofday(&t, NULL);
+    snapshot->Time=t.tv_sec + t.tv_usec / (1000.0*1000.0);
+    for(int i=0; i<METRICS_NB; i++)
+    {
+        snapshot->Count[i]=Count[i].load(std::memory_order_relaxed);
+        snapshot->Sum[i]=Sum[i].load(std::memory_order_relaxed);
+        snapshot->Max[i]=Max[i].load(std::memory_order_relaxed);
+        for(int k=0; k<METRICS_NB_BUCKETS; k++)
+            snapshot->Buckets[i][k]=Buckets[i][k].load(std::memory_order_relaxed);
+    }
+}
+
+
+MetricsReport::MetricsReport()
+{
+    Reset();
+}
+
+//! Next interval starts now
+void MetricsReport::Reset()
+{
+    PipelineMetrics.Snapshot(&Prev);
+    Last=Prev;
+    memset(Intervals, 0, sizeof(Intervals));
+}
+
+//! New snapshot: metrics since the previous Update() (or Reset())
+//!\return the interval duration (s)
+double MetricsReport::Update()
+{
+    Prev=Last;
+    PipelineMetrics.Snapshot(&Last);
+    double dt=Last.Time-Prev.Time;
+
+    for(int i=0; i<METRICS_NB; i++)
+    {
+        MetricInterval &m=Intervals[i];
+        m.Total=Last.Count[i];
+        m.Count=Last.Count[i]-Prev.Count[i];
+        m.Rate=(dt>0) ? m.Count/dt : 0;
+        m.Mean=0;
+        m.P50=m.P99=m.Max=0;
+        if(!MetricsRegistry::IsDistribution((metric_id)i) || m.Count==0)
+            continue;
+
+        m.Mean=(Last.Sum[i]-Prev.Sum[i])/(double)m.Count;
+        //Percentiles: upper bound of the bucket reaching them (at most the max ever recorded)
+        unsigned long long int nb=0;
+        for(int k=0; k<METRICS_NB_BUCKETS; k++)
+        {
+            unsigned long long int n=Last.Buckets[i][k]-Prev.Buckets[i][k];
+            if(n==0)
+                continue;
+            long long int upper=(k==0) ? 0 : (1LL<<k)-1;
+            if(k==METRICS_NB_BUCKETS-1 || upper>Last.Max[i])
+                upper=Last.Max[i];
+            if(nb<(m.Count+1)/2 && nb+n>=(m.Count+1)/2)
+                m.P50=upper;
+            if(nb<m.Count-m.Count/100 && nb+n>=m.Count-m.Count/100)
+                m.P99=upper;
+            m.Max=upper;
+            nb+=n;
+        }
+    }
+    return dt;
+}
+
+void MetricsReport::WriteHeader(LogWriter *log)
+{
+    log->Printf("t (s),metric,unit,total,count,rate (/s),mean,p50,p99,max\n");
+}
+
+//! Last interval as CSV lines (one per metric, empty statistics for counters)
+void MetricsReport::Write(LogWriter *log)
+{
+    for(int i=0; i<METRICS_NB; i++)
+    {
+        const MetricInterval &m=Intervals[i];
+        //No %ll with the MinGW runtime: values fit in a long
+        if(MetricsRegistry::IsDistribution((metric_id)i))
+            log->Printf("%f,%s,%s,%lu,%lu,%.3f,%.1f,%ld,%ld,%ld\n", Last.Time, MetricsRegistry::GetName((metric_id)i), MetricsRegistry::GetUnit((metric_id)i),
+                        (unsigned long int)m.Total, (unsigned long int)m.Count, m.Rate, m.Mean, (long int)m.P50, (long int)m.P99, (long int)m.Max);
+        else
+            log->Printf("%f,%s,%s,%lu,%lu,%.3f,,,,\n", Last.Time, MetricsRegistry::GetName((metric_id)i), MetricsRegistry::GetUnit((metric_id)i),
+                        (unsigned long int)m.Total, (unsigned long int)m.Count, m.Rate);
+    }
+}
@@ -0,0 +1,117 @@
+//--------------------------------------------------------------------------
+//
+//    Copyright (C) 2020 Vincent Crocher
+//    The University of Melbourne
+//
+//	  This file is part of ShoulderTrackingIMU.
+//
+//
+//---------------------------------------------------------------------------
+#ifndef METRICSREGISTRY_H
+#define METRICSREGISTRY_H
+
+#include <stdio.h>
+#include <atomic>
+
+#include "LogWriter.h"
+
+#define METRICS_NB_BUCKETS 24 //!< Distributions: bucket k counts values in [2^(k-1), 2^k[ (0 in bucket 0), last one is open
+#define METRICS_DISPLAY_PERIOD_S 1. //!< Diagnostics tab refresh
+#define METRICS_DUMP_PERIOD_S 60. //!< Metrics file (<log>_metrics.csv) line period while logging
+
+//! Acquisition pipeline metrics
+enum metric_id
+{
+    //Serial decoding (counters)
+    MetricFrames, //!< Data frames decoded (single sample or batch)
+    MetricSamples, //!< Values returned by ReadBinary()
+    MetricResyncs, //!< Frames found after skipping bytes
+    MetricSkippedBytes, //!< Bytes skipped looking for a frame start
+    MetricErrNoStart, //!< No frame start (-4): nothing received, or only garbage
+    MetricErrHeader, //!< Wrong state or batch size (-4)
+    MetricErrIncomplete, //!< Frame not received entirely in time (-2)
+    MetricErrInvalid, //!< Wrong mode or frame end (-3)
+    MetricErrNotConnected, //!< No device (-1)
+    MetricCommandTimeouts, //!< Commands without (complete) reply
+    MetricLogDropped, //!< Log writes dropped (disk too slow)
+    //Times (distributions, us)
+    MetricReadTime, //!< ReadBinary() call, including the wait for the device
+    MetricCommandTime, //!< Command round trip (sent to reply received, 10ms polling)
+    MetricLogWriteTime, //!< Log buffer written to the disk (and synced)
+    MetricRenderTime, //!< Chart drawing
+    //Queues depths (distributions, when filled)
+    MetricBatchQueue, //!< Samples queued by a batch frame (returned one per ReadBinary())
+    MetricLogQueue, //!< Log bytes buffered, waiting for the next disk write
+    MetricCaptureQueue, //!< Serial capture bytes not written yet
+    MetricActivityQueue, //!< Mouse events not logged yet
+    METRICS_NB
+};
+
+//! Values of all the metrics at one time (cumulated since start)
+typedef struct
+{
+    double Time; //!< Host time (s)
+    unsigned long long int Count[METRICS_NB]; //!< Counter value, or nb of values of a distribution
+    unsigned long long int Sum[METRICS_NB];
+    unsigned long long int Buckets[METRICS_NB][METRICS_NB_BUCKETS];
+    long long int Max[METRICS_NB]; //!< Since start
+} MetricsSnapshot;
+
+//! One metric between two snapshots
+typedef struct
+{
+    unsigned long long int Total; //!< Since start
+    unsigned long long int Count; //!< Over the interval
+    double Rate; //!< Count per s
+    double Mean;
+    long long int P50, P99, Max; //!< Upper bounds (bucket), over the interval
+} MetricInterval;
+
+//! Registry of the acquisition pipeline metrics (decoding, commands, logging, display, queues),
+//! global (PipelineMetrics) and updated where they happen, from any thread: each update is
+//! a few relaxed atomic additions (no lock, no allocation), cheap enough for every frame.
+//! Counters only count. Distributions (times in us, queues depths) count their values in
+//! log2 buckets: percentiles and max of any interval are derived from the difference of two
+//! snapshots, so that several readers (see MetricsReport) never reset anything.
+class MetricsRegistry
+{
+    public:
+        MetricsRegistry();
+
+        void Add(metric_id id, unsigned long int n=1) {Count[id].fetch_add(n, std::memory_order_relaxed);}
+        void Record(metric_id id, long long int value);
+        void Snapshot(MetricsSnapshot *snapshot);
+
+        static const char* GetName(metric_id id);
+        static const char* GetUnit(metric_id id);
+        static bool IsDistribution(metric_id id) {return id>=MetricReadTime;}
+        static long long int NowUs();
+
+    private:
+        std::atomic<unsigned long long int> Count[METRICS_NB], Sum[METRICS_NB];
+        std::atomic<unsigned long long int> Buckets[METRICS_NB][METRICS_NB_BUCKETS];
+        std::atomic<long long int> Max[METRICS_NB];
+};
+
+extern MetricsRegistry PipelineMetrics;
+
+
+//! Metrics over successive intervals (one reader: display, file): Update() takes a snapshot
+//! and computes each metric since the previous one
+class MetricsReport
+{
+    public:
+        MetricsReport();
+
+        void Reset();
+        double Update();
+        const MetricInterval& Get(metric_id id) {return Intervals[id];}
+        void WriteHeader(LogWriter *log);
+        void Write(LogWriter *log);
+
+    private:
+        MetricsSnapshot Prev, Last;
+        MetricInterval Intervals[METRICS_NB];
+};
+
+#endif // METRICSREGISTRY_H
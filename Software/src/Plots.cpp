@@ -11,49 +11,87 @@
 
 Plots::Plots(int xx, int yy, int ww, int hh, const char *label): Fl_Group(xx, yy, ww, hh, label)
 {
-    const char plot_label[4][255]={"Value 1", "Value 2", "Threshold 1", "Threshold 2" };
+    const char plot_label[2][255]={"Value 1 (threshold in grey)", "Value 2 (threshold in grey)"};
     PlotColors[0]=FL_DARK_RED;
     PlotColors[1]=FL_DARK_GREEN;
     for(int i=0; i<2; i++)
     {
-        //sprintf(plot_label, "Joint %d", i+1);
-        SubPlots[i]=new Fl_Chart(xx, yy+i*((int)(hh/2.)), ww-100, (int)(hh/2.)-20, "");
-        SubPlots[i]->type(FL_LINE_CHART);
-        SubPlots[i]->box(FL_EMBOSSED_BOX);
+        SubPlots[i]=new RingChart(xx, yy+i*((int)(hh/2.)), ww, (int)(hh/2.)-20, "");
         SubPlots[i]->copy_label(plot_label[i]);
         SubPlots[i]->labelcolor(PlotColors[i]);
-        SubPlots[i]->color(FL_WHITE);
-        SubPlots[i]->maxsize(1000);
-        SubPlots[i]->autosize(0);
-    }
-    for(int i=0; i<2; i++)
-    {
-        //sprintf(plot_label, "Joint %d", i+1);
-        SubPlots[i+2]=new Fl_Chart(xx+ww-100, yy+i*((int)(hh/2.)), 100, (int)(hh/2.)-20, "");
-        SubPlots[i+2]->type(FL_LINE_CHART);
-        SubPlots[i+2]->box(FL_EMBOSSED_BOX);
-        SubPlots[i+2]->copy_label(plot_label[i+2]);
-        SubPlots[i+2]->labelcolor(PlotColors[i]);
-        SubPlots[i+2]->color(FL_WHITE);
-        SubPlots[i+2]->maxsize(1000);
-        SubPlots[i+2]->autosize(0);
+        SubPlots[i]->SetColors(PlotColors[i], FL_GRAY);
     }
     /*SubPlots[0]->bounds(0, 1);
     SubPlots[1]->bounds(0, 2.);*/
     end();
+
+    Dynamic=false;
+    NbPending=0;
+    RefreshPeriod=1./PLOTS_DEFAULT_FPS;
+    Fl::add_timeout(RefreshPeriod, Refresh_cb, (void*)this);
 }
 
 Plots::~Plots()
 {
-    //dtor
+    Fl::remove_timeout(Refresh_cb, (void*)this);
 }
 
-void Plots::AddValues(float *vals)
+//!Queue values (angles and velocities, as received) and thresholds for the next display refresh.
+//! Only the values of the current mode are plotted: angles in static, velocities in dynamic.
+void Plots::AddValues(float *vals, float *thresh)
 {
+    //Display not refreshed for a while (e.g. window being moved): no need to wait further
+    if(NbPending>=PLOTS_MAX_PENDING)
+        Flush();
+
     for(int j=0; j<2; j++)
     {
-        SubPlots[j]->add(vals[j], 0, PlotColors[j]); //Current value
-        SubPlots[j+2]->add(vals[j+2], 0, PlotColors[j]);//Threshold
+        Pending[NbPending][j]=Dynamic?vals[j+2]:vals[j];
+        Pending[NbPending][j+2]=thresh[j];
     }
+    NbPending++;
     //printf("%f %f %f %f\n", vals[0], vals[1], vals[2], vals[3]);
 }
+
+//!Set the display refresh rate (frames per second)
+void Plots::SetFrameRate(float fps)
+{
+    if(fps<1)
+        fps=1;
+    RefreshPeriod=1./fps;
+}
+
+//!Append the pending values to the charts. Only the charts are damaged (not the whole group):
+//! they are redrawn once at the next FLTK flush whatever the nb of values added.
+void Plots::Flush()
+{
+    if(NbPending==0)
+        return;
+
+    for(int i=0; i<NbPending; i++)
+        for(int j=0; j<2; j++)
+            SubPlots[j]->Add(Pending[i][j], Pending[i][j+2]); //Current value and threshold
+    NbPending=0;
+}
+
+//!Mouse wheel zoom (both charts)
+int Plots::handle(int event)
+{
+    if(event==FL_MOUSEWHEEL && Fl::event_dy()!=0)
+    {
+        long long int span=SubPlots[0]->GetSpan();
+        span=(Fl::event_dy()>0)?span*2:span/2;
+        for(int j=0; j<2; j++)
+            SubPlots[j]->SetSpan(span);
+        return 1;
+    }
+    return Fl_Group::handle(event);
+}
+
+//!Display refresh timer
+void Plots::Refresh_cb(void *param)
+{
+    Plots *p=(Plots*)param;
+    p->Flush();
+    Fl::repeat_timeout(p->RefreshPeriod, Refresh_cb, param);
+}
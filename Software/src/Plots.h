@@ -10,10 +10,17 @@
 #ifndef PLOTS_H
 #define PLOTS_H
 
+#include <FL/Fl.H>
 #include <FL/Fl_Group.H>
-#include <FL/Fl_Chart.H>
 #include <stdio.h>
+#include "RingChart.h"
 
+#define PLOTS_DEFAULT_FPS 30 //!< Default display refresh rate
+#define PLOTS_MAX_PENDING 64 //!< Values waiting for the next refresh (~0.6s at 100Hz)
+
+//! Values and thresholds charts (value and its threshold on the same chart). Values are added at
+//! the data rate but only appended to the charts (and redrawn) at the display rate: see SetFrameRate().
+//! Mouse wheel to zoom in/out (from 1s to the whole session, both charts together).
 class Plots : public Fl_Group
 {
     public:
@@ -21,15 +28,26 @@ class Plots : public Fl_Group
         ~Plots();
 
         //void SetData(Data * data);
-        void AddValues(float *val);
+        void AddValues(float *vals, float *thresh);
+        void SetFrameRate(float fps);
+        void Flush();
+
+        void DrawDynamic(){Dynamic=true;NbPending=0;for(int i=0; i<2; i++)SubPlots[i]->Clear();SubPlots[0]->bounds(0, .05);SubPlots[1]->bounds(0, 2.);} //Set plot bounds for dynamic mode
+        void DrawStatic(){Dynamic=false;NbPending=0;for(int i=0; i<2; i++){SubPlots[i]->Clear();SubPlots[i]->bounds(0, 180);}} //Set plot bounds for static mode
 
-        void DrawDynamic(){for(int i=0; i<4; i++)SubPlots[i]->clear();SubPlots[0]->bounds(0, .05);SubPlots[1]->bounds(0, 2.);SubPlots[2]->bounds(0, .05);SubPlots[3]->bounds(0, 2.);} //Set plot bounds for dynamic mode
-        void DrawStatic(){for(int i=0; i<4; i++){SubPlots[i]->clear();SubPlots[i]->bounds(0, 180);}} //Set plot bounds for static mode
+        int handle(int event);
 
     protected:
     private:
-        Fl_Chart *SubPlots[4];
-        Fl_Color PlotColors[4];
+        static void Refresh_cb(void *param);
+
+        RingChart *SubPlots[2];
+        Fl_Color PlotColors[2];
+        bool Dynamic; //!< Plotting velocities (otherwise angles)
+
+        float Pending[PLOTS_MAX_PENDING][4]; //!< Values (2) and thresholds (2) added since the last refresh
+        int NbPending;
+        double RefreshPeriod; //!< Display refresh period (s)
 };
 
 #endif // PLOTS_H
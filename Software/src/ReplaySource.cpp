@@ -0,0 +1,257 @@
+//--------------------------------------------------------------------------
+//
+//    Copyright (C) 2020 Vincent Crocher
+//    The University of Melbourne
+//
+//	  This file is part of ShoulderTrackingIMU.
+//
+//
+//---------------------------------------------------------------------------
+#include "ReplaySource.h"
+#include <string.h>
+#include <ctype.h>
+#include <sys/time.h>
+#ifdef WINDOWS
+    #include <windows.h>
+#else
+    #include <unistd.h>
+    #define Sleep(ms) usleep((ms)*1000)
+#endif
+
+
+static double Now()
+{
+    struct timeval t;
+    gettimeofday(&t, NULL);
+    return t.tv_sec + t.tv_usec / (1000.0*1000.0);
+}
+
+
+ReplaySource::ReplaySource()
+{
+    Filename[0]='\0';
+    Speed=1.0;
+    Binary=NULL;
+    CsvFile=NULL;
+    Ended=false;
+    HasNext=false;
+    Playing=false;
+    Anchored=false;
+}
+
+ReplaySource::~ReplaySource()
+{
+    Close();
+}
+
+//! Open a recorded session: CSV if .csv, binary log otherwise
+//!\param speed: x real time, 0 for as fast as possible
+//!\return false if the file cannot be read or has no values
+bool ReplaySource::Open(const char *filename, double speed)
+{
+    Close();
+    strncpy(Filename, filename, sizeof(Filename)-1);
+    Filename[sizeof(Filename)-1]='\0';
+    Speed=(speed>0) ? speed : 0;
+
+    const char *ext=strrchr(filename, '.');
+    bool csv=ext && tolower(ext[1])=='c' && tolower(ext[2])=='s' && tolower(ext[3])=='v' && ext[4]=='\0';
+    if(csv)
+    {
+        CsvFile=fopen(filename, "r");
+        if(!CsvFile)
+            return false;
+    }
+    else
+    {
+        Binary=new SessionLogReader();
+        if(!Binary->Open(filename))
+        {
+            delete Binary;
+            Binary=NULL;
+            return false;
+        }
+    }
+
+    //First value
+    HasNext=Next();
+    if(!HasNext)
+    {
+        Close();
+        return false;
+    }
+    Ended=false;
+    Anchored=false;
+    ReplayTime=0;
+    LastDeviceTime=DeviceTime;
+    NbValues=0;
+    StartTime=LastReadTime=0;
+    LatenessSum=LatenessMax=0;
+    PipelineSum=PipelineMax=0;
+    printf("Replaying %s (%s).\n", Filename, Speed>0 ? "paced" : "as fast as possible");
+    return true;
+}
+
+void ReplaySource::Close()
+{
+    if(Binary)
+    {
+        delete Binary;
+        Binary=NULL;
+    }
+    if(CsvFile)
+    {
+        fclose(CsvFile);
+        CsvFile=NULL;
+    }
+    HasNext=false;
+}
+
+//! Read ahead the next streamed value of the recording
+//!\return false at the end of the recording
+bool ReplaySource::Next()
+{
+    if(Binary)
+    {
+        SessionRecord rec;
+        while(Binary->Next(&rec))
+        {
+            if(rec.Type=='O')
+                continue;
+            Mode=rec.Mode;
+            State=rec.State;
+            DeviceTime=rec.DeviceTime;
+            for(int k=0; k<4; k++)
+                Vals[k]=rec.Vals[k];
+            Thresh[0]=rec.Thresh[0];
+            Thresh[1]=rec.Thresh[1];
+            return true;
+        }
+        return false;
+    }
+
+    //CSV: type, mode, state, host time, device time, values, thresholds, mouse. Other lines (header) skipped.
+    char line[REPLAY_MAX_LINE];
+    while(CsvFile && fgets(line, REPLAY_MAX_LINE, CsvFile))
+    {
+        char type;
+        if(sscanf(line, "%c,%c,%c,%*f,%f,%f,%f,%f,%f,%f,%f", &type, &Mode, &State, &DeviceTime, &Vals[0], &Vals[1], &Vals[2], &Vals[3], &Thresh[0], &Thresh[1])==10
+           && type!='O' && (Mode=='S' || Mode=='D'))
+            return true;
+    }
+    return false;
+}
+
+//! Next value of the recording, as Serial::ReadBinary(): waits for it up to REPLAY_MAX_WAIT_MS
+//!\return 0 if a value is returned, -2 if not yet (paced) or paused, -1 at the end of the recording
+int ReplaySource::Read(char *mode, char *state, float *device_time, float *vals, float *thresh)
+{
+    double now=Now();
+
+    //Time spent by the caller on the previous value
+    if(LastReadTime>0)
+    {
+        double t=now-LastReadTime;
+        PipelineSum+=t;
+        if(t>PipelineMax)
+            PipelineMax=t;
+        LastReadTime=0;
+    }
+
+    if(!HasNext)
+    {
+        if(!Ended)
+        {
+            Ended=true;
+            printf("Replay ended.\n");
+            PrintStats();
+        }
+        return -1;
+    }
+
+    //Paused: device would not stream
+    if(!Playing)
+    {
+        Sleep(REPLAY_MAX_WAIT_MS);
+        return -2;
+    }
+
+    //Paced on the recording time, from the first value (or resume)
+    double lateness=0;
+    if(Speed>0)
+    {
+        if(!Anchored)
+        {
+            AnchorTime=now-ReplayTime/Speed;
+            Anchored=true;
+        }
+        double due=AnchorTime+ReplayTime/Speed;
+        if(due>now)
+        {
+            int wait_ms=(int)((due-now)*1000+0.5);
+            if(wait_ms>REPLAY_MAX_WAIT_MS)
+            {
+                Sleep(REPLAY_MAX_WAIT_MS);
+                return -2;
+            }
+            if(wait_ms>0)
+                Sleep(wait_ms);
+            now=Now();
+        }
+        lateness=now-due;
+        if(lateness<0)
+            lateness=0;
+    }
+
+    (*mode)=Mode;
+    (*state)=State;
+    (*device_time)=DeviceTime;
+    for(int k=0; k<4; k++)
+        vals[k]=Vals[k];
+    thresh[0]=Thresh[0];
+    thresh[1]=Thresh[1];
+
+    if(NbValues==0)
+        StartTime=now;
+    NbValues++;
+    LatenessSum+=lateness;
+    if(lateness>LatenessMax)
+        LatenessMax=lateness;
+
+    //Read ahead, gaps shortened (and device restarts)
+    HasNext=Next();
+    if(HasNext)
+    {
+        float dt=DeviceTime-LastDeviceTime;
+        if(dt<0)
+            dt=0;
+        if(dt>REPLAY_MAX_GAP_S)
+            dt=REPLAY_MAX_GAP_S;
+        ReplayTime+=dt;
+        LastDeviceTime=DeviceTime;
+    }
+
+    LastReadTime=Now();
+    return 0;
+}
+
+//! Play (as the device streaming) or pause: pacing restarts from the current value on play
+void ReplaySource::SetPlaying(bool play)
+{
+    Playing=play;
+    if(!play)
+        Anchored=false;
+}
+
+//! Throughput and latency counters on the console
+void ReplaySource::PrintStats()
+{
+    if(NbValues==0)
+        return;
+
+    double duration=LastReadTime>0 ? LastReadTime-StartTime : Now()-StartTime;
+    printf("Replay: %lu values in %.1fs: %.0f values/s (x%.1f real time).\n", NbValues, duration, duration>0 ? NbValues/duration : 0, duration>0 ? ReplayTime/duration : 0);
+    printf("Replay: lateness mean %.2fms, max %.1fms. Pipeline time per value mean %.3fms, max %.1fms.\n",
+           LatenessSum/NbValues*1000, LatenessMax*1000, NbValues>1 ? PipelineSum/(NbValues-1)*1000 : 0, PipelineMax*1000);
+    fflush(stdout);
+}
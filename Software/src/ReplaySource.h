@@ -0,0 +1,72 @@
+//--------------------------------------------------------------------------
+//
+//    Copyright (C) 2020 Vincent Crocher
+//    The University of Melbourne
+//
+//	  This file is part of ShoulderTrackingIMU.
+//
+//
+//---------------------------------------------------------------------------
+#ifndef REPLAYSOURCE_H
+#define REPLAYSOURCE_H
+
+#include <stdio.h>
+
+#include "SessionLogReader.h"
+
+#define REPLAY_MAX_WAIT_MS 20 //!< Longest wait for a value in Read() (as a device frame read)
+#define REPLAY_MAX_GAP_S 0.2 //!< Longer gaps of the recording (pause, link drop) are shortened to this
+#define REPLAY_MAX_LINE 512
+
+//! Recorded session (STLog) played back as the device would stream it: see Serial::Serial().
+//! The values of the GUI or headless pipeline (plots, log, metrics) then come from the
+//! recording, without hardware: demos and repeatable performance measurements.
+//! Binary logs (.stl/.stlz, see SessionLogReader) or CSV ones (.csv, as from StlToCsv).
+//! Offline records (O) are skipped: they are not streamed by the device.
+//! Values are paced on their device time, at speed x real time (0: as fast as possible).
+//! Counters: throughput (values per s), lateness of the values (delivered after their
+//! time, i.e. pipeline not keeping up) and pipeline time per value (between two Read()).
+class ReplaySource
+{
+    public:
+        ReplaySource();
+        ~ReplaySource();
+
+        bool Open(const char *filename, double speed=1.0);
+        void Close();
+        int Read(char *mode, char *state, float *device_time, float *vals, float *thresh);
+        void SetPlaying(bool play);
+        void PrintStats();
+
+        bool IsOpen() {return Binary || CsvFile;}
+        bool IsEnded() {return Ended;}
+        const char* GetFilename() {return Filename;}
+
+    private:
+        bool Next();
+
+        char Filename[1024];
+        double Speed;
+        SessionLogReader *Binary;
+        FILE *CsvFile;
+        bool Ended;
+
+        //Next value to deliver (read ahead)
+        bool HasNext;
+        char Mode, State;
+        float DeviceTime, Vals[4], Thresh[2];
+
+        //Pacing
+        bool Playing, Anchored;
+        double AnchorTime; //!< Host time of ReplayTime 0 (s)
+        double ReplayTime; //!< Recording time of the next value, gaps shortened (s)
+        float LastDeviceTime;
+
+        //Counters
+        unsigned long int NbValues;
+        double StartTime, LastReadTime;
+        double LatenessSum, LatenessMax;
+        double PipelineSum, PipelineMax;
+};
+
+#endif // REPLAYSOURCE_H
@@ -0,0 +1,219 @@
+//--------------------------------------------------------------------------
+//
+//    Copyright (C) 2020 Vincent Crocher
+//    The University of Melbourne
+//
+//	  This file is part of ShoulderTrackingIMU.
+//
+//
+//---------------------------------------------------------------------------
+#include "RingChart.h"
+#include <stdio.h>
+#include <FL/Fl.H>
+#include "MetricsRegistry.h"
+
+
+MinMaxRing::MinMaxRing()
+{
+    Raw=new float[CHART_CAPACITY];
+    Min[0]=Max[0]=NULL;
+    long long int block=1;
+    for(int k=1; k<=CHART_PYRAMID_LEVELS; k++)
+    {
+        block*=CHART_PYRAMID_BASE;
+        Min[k]=new float[CHART_CAPACITY/block];
+        Max[k]=new float[CHART_CAPACITY/block];
+    }
+    NbAdded=0;
+}
+
+MinMaxRing::~MinMaxRing()
+{
+    delete[] Raw;
+    for(int k=1; k<=CHART_PYRAMID_LEVELS; k++)
+    {
+        delete[] Min[k];
+        delete[] Max[k];
+    }
+}
+
+//!Add a sample: updates the block containing it at each level (O(levels))
+void MinMaxRing::Add(float v)
+{
+    Raw[NbAdded%CHART_CAPACITY]=v;
+    long long int block=1;
+    for(int k=1; k<=CHART_PYRAMID_LEVELS; k++)
+    {
+        block*=CHART_PYRAMID_BASE;
+        int idx=(int)((NbAdded/block)%(CHART_CAPACITY/block));
+        //First sample of the block: overwrite the (wrapped) old block
+        if(NbAdded%block==0)
+        {
+            Min[k][idx]=v;
+            Max[k][idx]=v;
+        }
+        else
+        {
+            if(v<Min[k][idx])
+                Min[k][idx]=v;
+            if(v>Max[k][idx])
+                Max[k][idx]=v;
+        }
+    }
+    NbAdded++;
+}
+
+//!Min and max of the samples [from, to[ (absolute indices, kept in the buffer, from<to).
+//! Uses the largest blocks fully inside the range: at most 2*(CHART_PYRAMID_BASE-1) reads per level.
+void MinMaxRing::GetMinMax(long long int from, long long int to, float *min, float *max)
+{
+    (*min)=(*max)=Get(from);
+    long long int i=from;
+    while(i<to)
+    {
+        //Largest level whose block starts at i and ends before to
+        int k=0;
+        long long int block=1;
+        while(k<CHART_PYRAMID_LEVELS && i%(block*CHART_PYRAMID_BASE)==0 && i+block*CHART_PYRAMID_BASE<=to)
+        {
+            k++;
+            block*=CHART_PYRAMID_BASE;
+        }
+        float mn, mx;
+        if(k==0)
+        {
+            mn=mx=Get(i);
+        }
+        else
+        {
+            int idx=(int)((i/block)%(CHART_CAPACITY/block));
+            mn=Min[k][idx];
+            mx=Max[k][idx];
+        }
+        if(mn<(*min))
+            (*min)=mn;
+        if(mx>(*max))
+            (*max)=mx;
+        i+=block;
+    }
+}
+
+
+
+RingChart::RingChart(int xx, int yy, int ww, int hh, const char *label): Fl_Widget(xx, yy, ww, hh, label)
+{
+    box(FL_EMBOSSED_BOX);
+    color(FL_WHITE);
+    align(FL_ALIGN_BOTTOM);
+    BoundMin=0;
+    BoundMax=1;
+    Span=1000;
+    ValueColor=FL_DARK_RED;
+    ThreshColor=FL_GRAY;
+}
+
+void RingChart::Clear()
+{
+    Value.Clear();
+    Threshold.Clear();
+    redraw();
+}
+
+//!Add a value and its threshold. Only damages the widget: drawn at next FLTK flush.
+void RingChart::Add(float value, float threshold)
+{
+    Value.Add(value);
+    Threshold.Add(threshold);
+    redraw();
+}
+
+//!Set the nb of samples displayed (clamped between 1s and the whole buffer)
+void RingChart::SetSpan(long long int nb_samples)
+{
+    if(nb_samples<CHART_MIN_SPAN)
+        nb_samples=CHART_MIN_SPAN;
+    if(nb_samples>CHART_CAPACITY)
+        nb_samples=CHART_CAPACITY;
+    Span=nb_samples;
+    redraw();
+}
+
+int RingChart::ToY(float v)
+{
+    int yy=y()+Fl::box_dy(box());
+    int hh=h()-Fl::box_dh(box());
+    if(v<BoundMin)
+        v=BoundMin;
+    if(v>BoundMax)
+        v=BoundMax;
+    return yy+hh-1-(int)((v-BoundMin)/(BoundMax-BoundMin)*(hh-1));
+}
+
+//!Draw samples [first, last[ over the chart width: one vertical min/max segment per pixel column,
+//! extended to the previous column range so that the curve stays continuous.
+void RingChart::DrawSeries(MinMaxRing &s, long long int first, long long int last, Fl_Color c)
+{
+    int xx=x()+Fl::box_dx(box());
+    int ww=w()-Fl::box_dw(box());
+    //Samples are aligned on the right (most recent) edge, Span samples over the width
+    double samples_per_px=(double)Span/ww;
+    int x0=xx+ww-(int)((last-first)/samples_per_px);
+
+    fl_color(c);
+    bool has_prev=false;
+    float prev_min=0, prev_max=0;
+    for(int px=(x0>xx?x0:xx); px<xx+ww; px++)
+    {
+        long long int from=last-(long long int)((xx+ww-px)*samples_per_px);
+        long long int to=last-(long long int)((xx+ww-px-1)*samples_per_px);
+        if(from<first)
+            from=first;
+        if(to<=from)
+            to=from+1; //Zoomed in: same sample on several columns
+        if(to>last)
+            continue;
+
+        float mn, mx;
+        s.GetMinMax(from, to, &mn, &mx);
+        float draw_min=mn, draw_max=mx;
+        if(has_prev)
+        {
+            if(draw_min>prev_max)
+                draw_min=prev_max;
+            if(draw_max<prev_min)
+                draw_max=prev_min;
+        }
+        fl_yxline(px, ToY(draw_min), ToY(draw_max));
+        prev_min=mn;
+        prev_max=mx;
+        has_prev=true;
+    }
+}
+
+void RingChart::draw()
+{
+    long long int t0=MetricsRegistry::NowUs();
+    draw_box();
+    fl_push_clip(x()+Fl::box_dx(box()), y()+Fl::box_dy(box()), w()-Fl::box_dw(box()), h()-Fl::box_dh(box()));
+
+    long long int last=Value.GetNbAdded();
+    long long int first=last-Span;
+    if(first<Value.GetFirst())
+        first=Value.GetFirst();
+    if(last>first)
+    {
+        DrawSeries(Threshold, first, last, ThreshColor);
+        DrawSeries(Value, first, last, ValueColor);
+    }
+
+    //Displayed time span
+    char span_label[32];
+    sprintf(span_label, "%.0fs", Span/100.);
+    fl_color(FL_BLACK);
+    fl_font(FL_HELVETICA, 10);
+    fl_draw(span_label, x()+Fl::box_dx(box())+2, y()+Fl::box_dy(box())+10);
+
+    fl_pop_clip();
+    draw_label();
+    PipelineMetrics.Record(MetricRenderTime, MetricsRegistry::NowUs()-t0);
+}
@@ -0,0 +1,73 @@
+//--------------------------------------------------------------------------
+//
+//    Copyright (C) 2020 Vincent Crocher
+//    The University of Melbourne
+//
+//	  This file is part of ShoulderTrackingIMU.
+//
+//
+//---------------------------------------------------------------------------
+#ifndef RINGCHART_H
+#define RINGCHART_H
+
+#include <FL/Fl_Widget.H>
+#include <FL/fl_draw.H>
+
+#define CHART_PYRAMID_BASE 4 //!< Samples per block between two pyramid levels
+#define CHART_PYRAMID_LEVELS 8 //!< Pyramid levels above the raw samples: largest blocks of 4^8=65536 samples
+#define CHART_CAPACITY (17*65536) //!< Samples kept (multiple of the largest block): ~3h at 100Hz
+#define CHART_MIN_SPAN 100 //!< Max zoom in: 1s at 100Hz
+
+//! Ring buffer of samples with a min/max pyramid: level k holds the min and max of blocks
+//! of 4^k consecutive samples. Blocks are aligned on the absolute sample index so that the
+//! pyramid wraps with the buffer. Any range is then summarised in a few block reads.
+class MinMaxRing
+{
+    public:
+        MinMaxRing();
+        ~MinMaxRing();
+
+        void Clear() {NbAdded=0;}
+        void Add(float v);
+        void GetMinMax(long long int from, long long int to, float *min, float *max);
+        float Get(long long int idx) {return Raw[idx%CHART_CAPACITY];}
+
+        long long int GetNbAdded() {return NbAdded;} //!< Absolute index of the next sample
+        long long int GetFirst() {return NbAdded>CHART_CAPACITY?NbAdded-CHART_CAPACITY:0;} //!< Absolute index of the oldest sample kept
+
+    private:
+        float *Raw;
+        float *Min[CHART_PYRAMID_LEVELS+1], *Max[CHART_PYRAMID_LEVELS+1]; //!< Index 0 unused (raw samples)
+        long long int NbAdded;
+};
+
+
+//! Chart of a value and its threshold (overlaid, same axis) over a span of up to CHART_CAPACITY
+//! samples. Each pixel column is drawn from the min/max of the samples it covers, read at the
+//! pyramid level matching the zoom: a redraw costs O(width) whatever the span.
+class RingChart : public Fl_Widget
+{
+    public:
+        RingChart(int xx, int yy, int ww, int hh, const char *label=0);
+
+        void Clear();
+        void Add(float value, float threshold);
+        void bounds(float min, float max) {BoundMin=min; BoundMax=max; redraw();}
+        void SetSpan(long long int nb_samples);
+        long long int GetSpan() {return Span;}
+        void SetColors(Fl_Color value_color, Fl_Color thresh_color) {ValueColor=value_color; ThreshColor=thresh_color;}
+
+    protected:
+        void draw();
+
+    private:
+        void DrawSeries(MinMaxRing &s, long long int first, long long int last, Fl_Color c);
+        int ToY(float v);
+
+        MinMaxRing Value, Threshold;
+        float BoundMin, BoundMax;
+        long long int Span; //!< Nb of samples displayed over the chart width
+        Fl_Color ValueColor, ThreshColor;
+};
+
+#endif // RINGCHART_H
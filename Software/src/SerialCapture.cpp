@@ -0,0 +1,301 @@
+//--------------------------------------------------------------------------
+//
+//    Copyright (C) 2020 Vincent Crocher
+//    The University of Melbourne
+//
+//	  This file is part of ShoulderTrackingIMU.
+//
+//
+//---------------------------------------------------------------------------
+#include "SerialCapture.h"
+#include <string.h>
+#include <sys/time.h>
+#include <chrono>
+#include "MetricsRegistry.h"
+
+
+SerialCapture::SerialCapture():Head(0), Tail(0), Running(false)
+{
+    File=NULL;
+    StartUs=LastUs=0;
+    NbDropped=0;
+    Replay=false;
+    Ended=false;
+    Pos=0;
+    PosUs=0;
+    RxPos=0;
+    RxNb=0;
+    AnchorUs=0;
+}
+
+SerialCapture::~SerialCapture()
+{
+    Close();
+}
+
+//! Monotonic clock (us)
+long long int SerialCapture::NowUs()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//! Create a capture file and start its writer thread
+bool SerialCapture::OpenCapture(const char *filename)
+{
+    Close();
+    File=fopen(filename, "wb");
+    if(!File)
+        return false;
+
+    struct timeval t;
+    gettimeofday(&t, NULL);
+    long long int start_us=t.tv_sec*1000000LL+t.tv_usec;
+    unsigned char header[CAPTURE_HEADER_SIZE];
+    memset(header, 0, CAPTURE_HEADER_SIZE);
+    memcpy(header, "STWC", 4);
+    header[4]=CAPTURE_VERSION&0xFF;
+    header[5]=(CAPTURE_VERSION>>8)&0xFF;
+    header[6]=CAPTURE_HEADER_SIZE&0xFF;
+    header[7]=(CAPTURE_HEADER_SIZE>>8)&0xFF;
+    for(int i=0; i<8; i++)
+        header[8+i]=(start_us>>(8*i))&0xFF;
+    fwrite(header, 1, CAPTURE_HEADER_SIZE, File);
+
+    Head.store(0);
+    Tail.store(0);
+    NbDropped=0;
+    StartUs=LastUs=NowUs();
+    Running.store(true);
+    Writer=std::thread(&SerialCapture::WriterThread, this);
+    printf("Capturing serial bytes in %s\n", filename);
+    return true;
+}
+
+//! Load a capture file to replay it
+bool SerialCapture::OpenReplay(const char *filename)
+{
+    Close();
+    FILE *f=fopen(filename, "rb");
+    if(!f)
+        return false;
+    fseek(f, 0, SEEK_END);
+    long size=ftell(f);
+    fseek(f, 0, SEEK_SET);
+    Data.resize(size>0 ? size : 0);
+    bool ok=(size>=CAPTURE_HEADER_SIZE && fread(&Data[0], 1, size, f)==(size_t)size);
+    fclose(f);
+    if(!ok || memcmp(&Data[0], "STWC", 4)!=0 || Data[4]+Data[5]*256!=CAPTURE_VERSION)
+    {
+        Data.clear();
+        return false;
+    }
+
+    Replay=true;
+    Ended=false;
+    Pos=Data[6]+Data[7]*256;
+    PosUs=0;
+    RxNb=0;
+    printf("Replaying serial capture %s (%ld bytes)\n", filename, size);
+    return true;
+}
+
+//! Stop the capture (remaining records written) or the replay
+void SerialCapture::Close()
+{
+    if(File)
+    {
+        Running.store(false);
+        if(Writer.joinable())
+            Writer.join();
+        fclose(File);
+        File=NULL;
+        if(NbDropped>0)
+            printf("Serial capture: %lu records dropped (disk too slow).\n", NbDropped);
+    }
+    Replay=false;
+    Data.clear();
+}
+
+void SerialCapture::AddOpen(int port)
+{
+    unsigned char p=(unsigned char)port;
+    Push(CAPTURE_OPEN, &p, 1);
+}
+
+void SerialCapture::AddClose()
+{
+    Push(CAPTURE_CLOSE, NULL, 0);
+}
+
+void SerialCapture::AddBytes(int type, const unsigned char *bytes, int nb)
+{
+    for(int i=0; i<nb; i+=CAPTURE_MAX_CHUNK)
+        Push(type, bytes+i, (nb-i<CAPTURE_MAX_CHUNK) ? nb-i : CAPTURE_MAX_CHUNK);
+}
+
+//! Append a record to the ring buffer (producer side): dropped if it does not fit
+//!\return false if dropped
+bool SerialCapture::Push(int type, const unsigned char *bytes, int nb)
+{
+    if(!File)
+        return false;
+
+    //Type and nb of bytes, time since previous record (varint), bytes
+    long long int now=NowUs();
+    unsigned long long int dt=(now>LastUs) ? now-LastUs : 0;
+    unsigned char rec[1+10+CAPTURE_MAX_CHUNK];
+    int n=0;
+    rec[n++]=(type<<6)|nb;
+    do
+    {
+        unsigned char b=dt&0x7F;
+        dt>>=7;
+        if(dt)
+            b|=0x80;
+        rec[n++]=b;
+    }
+    while(dt);
+    if(nb>0)
+        memcpy(rec+n, bytes, nb);
+    n+=nb;
+
+    unsigned int head=Head.load(std::memory_order_relaxed);
+    unsigned int tail=Tail.load(std::memory_order_acquire);
+    if(CAPTURE_BUFFER_SIZE-(head-tail)<(unsigned int)n)
+    {
+        NbDropped++;
+        return false;
+    }
+    for(int i=0; i<n; i++)
+        Buffer[(head+i)&(CAPTURE_BUFFER_SIZE-1)]=rec[i];
+    Head.store(head+n, std::memory_order_release);
+    LastUs=now;
+    PipelineMetrics.Record(MetricCaptureQueue, head+n-tail);
+    return true;
+}
+
+//! Write the ring buffer content to the file (consumer side)
+void SerialCapture::Drain()
+{
+    unsigned int head=Head.load(std::memory_order_acquire);
+    unsigned int tail=Tail.load(std::memory_order_relaxed);
+    if(head==tail)
+        return;
+
+    unsigned int from=tail&(CAPTURE_BUFFER_SIZE-1);
+    unsigned int nb=head-tail;
+    unsigned int first=(from+nb>CAPTURE_BUFFER_SIZE) ? CAPTURE_BUFFER_SIZE-from : nb;
+    fwrite(Buffer+from, 1, first, File);
+    if(nb>first)
+        fwrite(Buffer, 1, nb-first, File);
+    fflush(File);
+    Tail.store(head, std::memory_order_release);
+}
+
+void SerialCapture::WriterThread()
+{
+    while(Running.load())
+    {
+        Drain();
+        std::this_thread::sleep_for(std::chrono::milliseconds(CAPTURE_WRITE_PERIOD_MS));
+    }
+    Drain();
+}
+
+//! Parse the record at pos: type, nb of bytes and time (time_us: previous record time, updated)
+//!\return false at the end of the capture (or truncated record), pos is then the bytes position
+bool SerialCapture::ReadRecord(long *pos, int *type, int *nb, long long int *time_us)
+{
+    long p=*pos, size=Data.size();
+    if(p>=size)
+        return false;
+
+    (*type)=Data[p]>>6;
+    (*nb)=Data[p]&0x3F;
+    p++;
+    unsigned long long int dt=0;
+    for(int shift=0; ; shift+=7)
+    {
+        if(p>=size || shift>63)
+            return false;
+        unsigned char b=Data[p++];
+        dt|=(unsigned long long int)(b&0x7F)<<shift;
+        if(!(b&0x80))
+            break;
+    }
+    if(p+(*nb)>size)
+        return false;
+
+    (*time_us)+=dt;
+    (*pos)=p;
+    return true;
+}
+
+//! Next captured connection (port opening): replay timing restarts from it
+//!\return false if none left (end of the capture)
+bool SerialCapture::ReplayOpen(int *port)
+{
+    RxNb=0;
+    int type, nb;
+    long p=Pos;
+    long long int t=PosUs;
+    while(ReadRecord(&p, &type, &nb, &t))
+    {
+        long bytes=p;
+        p+=nb;
+        if(type==CAPTURE_OPEN && nb==1)
+        {
+            (*port)=Data[bytes];
+            Pos=p;
+            PosUs=t;
+            AnchorUs=NowUs()-t;
+            return true;
+        }
+    }
+    Pos=Data.size();
+    Ended=true;
+    return false;
+}
+
+//! Captured bytes received up to now (capture time), as RS232_PollComport()
+//!\return the nb of bytes read (up to nb)
+int SerialCapture::ReplayRead(unsigned char *buffer, int nb)
+{
+    int n=0;
+    long long int elapsed=NowUs()-AnchorUs;
+    while(n<nb)
+    {
+        //Rest of a received chunk
+        if(RxNb>0)
+        {
+            int k=(RxNb<nb-n) ? RxNb : nb-n;
+            memcpy(buffer+n, &Data[RxPos], k);
+            RxPos+=k;
+            RxNb-=k;
+            n+=k;
+            continue;
+        }
+
+        int type, len;
+        long p=Pos;
+        long long int t=PosUs;
+        if(!ReadRecord(&p, &type, &len, &t))
+        {
+            Ended=true;
+            break;
+        }
+        //Not received yet (received after previous event), or next connection
+        long long int available=(t-CAPTURE_REPLAY_EARLY_US>PosUs) ? t-CAPTURE_REPLAY_EARLY_US : PosUs;
+        if(available>elapsed || type==CAPTURE_OPEN)
+            break;
+        Pos=p+len;
+        PosUs=t;
+        //Sent bytes: the same commands are sent by the replayed code
+        if(type==CAPTURE_RX)
+        {
+            RxPos=p;
+            RxNb=len;
+        }
+    }
+    return n;
+}
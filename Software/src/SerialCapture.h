@@ -0,0 +1,104 @@
+//--------------------------------------------------------------------------
+//
+//    Copyright (C) 2020 Vincent Crocher
+//    The University of Melbourne
+//
+//	  This file is part of ShoulderTrackingIMU.
+//
+//
+//---------------------------------------------------------------------------
+#ifndef SERIALCAPTURE_H
+#define SERIALCAPTURE_H
+
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+//! Serial wire capture file (.stwc) format, version 1:
+//! Header (CAPTURE_HEADER_SIZE bytes): "STWC", uint16 version, uint16 header size, int64
+//! capture start time (us, wall clock), all LSB first.
+//! Then one record per port event: byte 0 is the type (bits 6-7) and the nb of bytes
+//! (bits 0-5), followed by the time since the previous record (us, monotonic clock) as a
+//! varint (7 bits per byte, LSB first, bit 7 set if more) and the bytes:
+//!  -received (RX) or sent (TX) bytes, as read from or written to the port, 1 to 63 bytes
+//!  -port opened (OPEN): 1 byte, the rs232 port index
+//!  -port closed (CLOSE): no byte
+//! About 2 to 3 bytes of overhead per read (~2.5KB/s of capture at 19200 baud).
+#define CAPTURE_VERSION 1
+#define CAPTURE_HEADER_SIZE 16
+#define CAPTURE_RX 0
+#define CAPTURE_TX 1
+#define CAPTURE_OPEN 2
+#define CAPTURE_CLOSE 3
+#define CAPTURE_MAX_CHUNK 63 //!< Longer reads/writes are split in several records
+#define CAPTURE_BUFFER_SIZE (64*1024) //!< Ring buffer (power of 2): ~20s of link
+#define CAPTURE_WRITE_PERIOD_MS 200 //!< Ring buffer written to the file every 200ms
+#define CAPTURE_REPLAY_EARLY_US 20000 //!< Replayed chunks are available up to 20ms before their capture time (timers jitter)
+
+//! Raw serial bytes capture and replay, under Serial (see Serial::PortRead()):
+//! - capture (--capture): every byte received and sent, and port open/close, with a
+//!   monotonic timestamp. Records are pushed to a lock-free single producer/single consumer
+//!   ring buffer (no lock, no system call, no allocation in the acquisition thread), and
+//!   written to the file by a background thread. Records not fitting (file system stalled)
+//!   are dropped and counted.
+//! - replay (--replay of a .stwc file): Serial reads the captured bytes instead of a port,
+//!   each chunk being available at its original time (relative to the port opening). As
+//!   the capture time is the one of the read, bytes arrived before: a chunk is available
+//!   from the previous event, or at most CAPTURE_REPLAY_EARLY_US before its time, so that
+//!   a reply is never early but slightly later reads get it. The frame decoding (resync,
+//!   batches, commands replies) runs on the exact field bytes. Sent bytes are ignored (the
+//!   commands are sent by the same code).
+class SerialCapture
+{
+    public:
+        SerialCapture();
+        ~SerialCapture();
+
+        bool OpenCapture(const char *filename);
+        bool OpenReplay(const char *filename);
+        void Close();
+
+        bool IsCapturing() {return File!=NULL;}
+        bool IsReplay() {return Replay;}
+        bool IsEnded() {return Ended;}
+        unsigned long int GetNbDropped() {return NbDropped;}
+
+        //Capture (acquisition thread)
+        void AddRx(const unsigned char *bytes, int nb) {AddBytes(CAPTURE_RX, bytes, nb);}
+        void AddTx(const unsigned char *bytes, int nb) {AddBytes(CAPTURE_TX, bytes, nb);}
+        void AddOpen(int port);
+        void AddClose();
+
+        //Replay
+        bool ReplayOpen(int *port);
+        int ReplayRead(unsigned char *buffer, int nb);
+
+    private:
+        void AddBytes(int type, const unsigned char *bytes, int nb);
+        bool Push(int type, const unsigned char *bytes, int nb);
+        void Drain();
+        void WriterThread();
+        bool ReadRecord(long *pos, int *type, int *nb, long long int *time_us);
+        long long int NowUs();
+
+        //Capture: ring buffer (producer: Push(), consumer: Drain())
+        FILE *File;
+        unsigned char Buffer[CAPTURE_BUFFER_SIZE];
+        std::atomic<unsigned int> Head, Tail; //!< Free running write (producer) and read (consumer) positions
+        std::atomic<bool> Running;
+        std::thread Writer;
+        long long int StartUs, LastUs;
+        unsigned long int NbDropped; //!< Records dropped (ring buffer full)
+
+        //Replay: whole capture in memory, current record
+        bool Replay, Ended;
+        std::vector<unsigned char> Data;
+        long Pos; //!< Next record
+        long long int PosUs; //!< Time of the record before Pos
+        long RxPos; //!< Bytes of a RX record not read yet
+        int RxNb;
+        long long int AnchorUs; //!< Host time of the capture time 0
+};
+
+#endif // SERIALCAPTURE_H
@@ -8,9 +8,16 @@
 //
 //---------------------------------------------------------------------------
 #include "SerialWin.h"
+#ifndef WINDOWS
+    #include <unistd.h>
+    #define Sleep(ms) usleep((ms)*1000)
+#endif
 
 
 
+const char *DeviceProfileStageNames[]={"IMU read", "Angles", "Velocities", "Background", "Threshold", "Feedback", "TX", "Loop"};
+
+
 unsigned int Int16toInt(unsigned char LSB, unsigned char HSB)
 {
     return LSB + HSB*256;
@@ -21,13 +28,29 @@ unsigned int Int32toInt(unsigned char LLSB, unsigned char LSB, unsigned char HSB
     return  (((HHSB*256) + HSB)*256 + LSB)*256 + LLSB;
 }
 
+//! Binary frame start byte: single sample ([S/D]) or batch ([s/d])
+static bool IsBinaryStart(unsigned char c)
+{
+    return c=='D' || c=='S' || c=='d' || c=='s';
+}
+
 
 
-Serial::Serial(bool quiet):TestingMode(false)
+//!\param replay: if not NULL, values are read from this recording instead of a device (no port opened)
+//!\param wire: if not NULL, the port bytes are captured, or replayed from a capture (no port opened)
+Serial::Serial(bool quiet, ReplaySource *replay, SerialCapture *wire):TestingMode(false)
 {
     //Try any COM port...
     Connected=false;
+    Replay=replay;
+    Wire=wire;
     PortCom=0;
+    MagBufferNb=0;
+    RxNb=0;
+    LastReplyPos=0;
+    NbPending=0;
+    LogDecimation=PrevLogDecimation=1;
+    PrevDecimationNb=0;
     Connect(quiet);
 }
 
@@ -43,13 +66,39 @@ bool Serial::Connect(bool quiet)
     if(Connected)
         return true;
 
+    //Replay: "connected" until the end of the recording
+    if(Replay)
+    {
+        Connected=Replay->IsOpen() && !Replay->IsEnded();
+        return Connected;
+    }
+
+    //Wire replay: next captured connection(s), checked as a device
+    if(WireReplay())
+    {
+        int port;
+        while(!Connected && Wire->ReplayOpen(&port))
+        {
+            PortCom=port;
+            Connected=true;
+            printf("Replaying capture of COM%d.\n", PortCom+1);
+            if(!CheckDevice())
+                Connected=false;
+        }
+        if(!Connected)
+            printf("End of the serial capture.\n");
+        return Connected;
+    }
+
     //Try any COM port...
     int baud_rate=19200;
-    for(PortCom=0; PortCom<10; PortCom++)
+    for(PortCom=SERIAL_FIRST_PORT; PortCom<=SERIAL_LAST_PORT; PortCom++)
     {
         if(!RS232_OpenComport(PortCom, baud_rate, "8N1"))
         {
             Connected=true;
+            if(Wire)
+                Wire->AddOpen(PortCom);
             printf("Connected on port COM%d.\n", PortCom+1);
             RS232_enableDTR(PortCom);
             RS232_enableRTS(PortCom);
@@ -64,7 +113,7 @@ bool Serial::Connect(bool quiet)
             }
             else
             {
-                RS232_CloseComport(PortCom);
+                PortClose();
                 Connected=false;
                 printf("\t NO.\n");
             }
@@ -73,7 +122,7 @@ bool Serial::Connect(bool quiet)
 
     if(!Connected)
     {
-        printf("Unable to open the port (COM1 - COM10).\n");
+        printf("Unable to open the port (COM%d - COM%d).\n", SERIAL_FIRST_PORT+1, SERIAL_LAST_PORT+1);
         if(!quiet)
             fl_alert("Shoulder Tracker not detected.\n\n Is the device ON?\n Have you plugged the USB dongle?\n");
         Connected=false;
@@ -85,10 +134,14 @@ bool Serial::Connect(bool quiet)
 //!Ask device to stop transmitting and close connection
 void Serial::Disconnect()
 {
-    if(Connected)
+    if(Replay)
+    {
+        Replay->SetPlaying(false);
+    }
+    else if(Connected)
     {
         SetState(false);
-        RS232_CloseComport(PortCom);
+        PortClose();
     }
 
     Connected=false;
@@ -97,9 +150,9 @@ void Serial::Disconnect()
 int Serial::SendChar(unsigned char c)
 {
 
-    if(Connected)
+    if(Connected && !Replay)
     {
-        RS232_SendByte(PortCom, c);
+        PortWrite(&c, 1);
         return 0;
     }
 
@@ -108,13 +161,13 @@ int Serial::SendChar(unsigned char c)
 
 int Serial::SendChars(const char *c, int nb_vals)
 {
-    if(Connected)
+    if(Connected && !Replay)
     {
         unsigned char mess[255];
         for(int i=0; i<fmin(nb_vals,255); i++)
             mess[i]=c[i];
 
-        RS232_SendBuf(PortCom, mess, nb_vals);
+        PortWrite(mess, nb_vals);
         return 0;
     }
 
@@ -122,6 +175,77 @@ int Serial::SendChars(const char *c, int nb_vals)
 }
 
 
+//!Port access: all the bytes go through these (see SerialCapture.h). Bytes already received
+//! and kept by Query() are read first.
+//!\return nb of bytes read
+int Serial::PortRead(unsigned char *buffer, int nb)
+{
+    if(RxNb>0)
+    {
+        int n=(nb<RxNb) ? nb : RxNb;
+        memcpy(buffer, RxBuffer, n);
+        RxDrop(n);
+        return n;
+    }
+
+    return PortReceive(buffer, nb);
+}
+
+//!Bytes from the port (captured), or from the wire replay
+//!\return nb of bytes read
+int Serial::PortReceive(unsigned char *buffer, int nb)
+{
+    if(WireReplay())
+        return Wire->ReplayRead(buffer, nb);
+
+    int n=RS232_PollComport(PortCom, buffer, nb);
+    if(n>0 && Wire)
+        Wire->AddRx(buffer, n);
+    return n;
+}
+
+void Serial::PortWrite(const unsigned char *buffer, int nb)
+{
+    if(WireReplay())
+        return;
+    if(Wire)
+        Wire->AddTx(buffer, nb);
+    RS232_SendBuf(PortCom, (unsigned char *)buffer, nb);
+}
+
+//!Remove the nb oldest received bytes not read yet
+void Serial::RxDrop(int nb)
+{
+    memmove(RxBuffer, RxBuffer+nb, RxNb-nb);
+    RxNb-=nb;
+    PrevDecimationNb=(PrevDecimationNb>nb) ? PrevDecimationNb-nb : 0;
+}
+
+//! Flushed bytes are not captured: nothing to skip when replaying
+void Serial::PortFlushRX()
+{
+    RxNb=0; //Captured, and replayed the same way
+    PrevDecimationNb=0;
+    if(!WireReplay())
+        RS232_flushRX(PortCom);
+}
+
+void Serial::PortFlushTX()
+{
+    if(!WireReplay())
+        RS232_flushTX(PortCom);
+}
+
+void Serial::PortClose()
+{
+    if(WireReplay())
+        return;
+    if(Wire)
+        Wire->AddClose();
+    RS232_CloseComport(PortCom);
+}
+
+
 //!Read a data frame from the device
 int Serial::Read(char *mode, char *state, float *device_time, float *vals, float *thresh)
 {
@@ -136,7 +260,7 @@ int Serial::Read(char *mode, char *state, float *device_time, float *vals, float
         while( startbyte!='D' && startbyte!='S' && i<2*nb_bytes_expected)
         {
             i++;
-            RS232_PollComport(PortCom, &startbyte, 1);
+            PortRead(&startbyte, 1);
             Sleep(1); //1ms
         }
         if(i>=2*nb_bytes_expected)
@@ -145,20 +269,20 @@ int Serial::Read(char *mode, char *state, float *device_time, float *vals, float
         *mode=startbyte;
 
         //Get full sequence (minus start byte)
-        if(RS232_PollComport(PortCom, buffer, nb_bytes_expected-1)==nb_bytes_expected-1)
+        if(PortRead(buffer, nb_bytes_expected-1)==nb_bytes_expected-1)
         {
             //printf("--%s--\n\n", buffer);
             //Parse received bytes
             if(sscanf((char *)buffer, "%c%f,%f,%f,%f,%f,%f,%f", state, device_time, &vals[0], &vals[1], &vals[2], &vals[3], &thresh[0], &thresh[1])!=8)
             {
-                //RS232_flushRX(PortCom);
+                //PortFlushRX();
                 delete[] buffer;
                 return -2;
             }
             delete[] buffer;
 
             //Flush buffer
-            RS232_flushRX(PortCom);
+            PortFlushRX();
 
             //Check that values looks correct
             if( (*mode=='D' || *mode=='S') && (*state=='P' || *state=='R') )
@@ -188,34 +312,102 @@ int Serial::Read(char *mode, char *state, float *device_time, float *vals, float
     }
 }
 
-//!Read binary formatted data frame from the device
+//!Wait (up to timeout_ms) for nb bytes: a frame start can be received before the end of the frame
+//!\return nb of bytes read
+int Serial::ReadBytes(unsigned char *buffer, int nb, int timeout_ms)
+{
+    int nb_rcv=0;
+    for(int t=0; nb_rcv<nb && t<=timeout_ms; t++)
+    {
+        int n=PortRead(buffer+nb_rcv, nb-nb_rcv);
+        if(n>0)
+            nb_rcv+=n;
+        else
+            Sleep(1); //1ms
+    }
+    return nb_rcv;
+}
+
+//!Read binary formatted data frame from the device: single sample ([S/D]) or batch ([s/d]) frames
+//! (see firmware). Samples of a batch frame are returned one per call, oldest first.
+//!\return 0 if success, -1 if not connected, -2 if frame incomplete (or replay paused),
+//! -3 if frame invalid, -4 if no frame start or wrong header (see PipelineMetrics for the counts)
 int Serial::ReadBinary(char *mode, char *state, float *device_time, float *vals, float *thresh)
 {
+    long long int t0=MetricsRegistry::NowUs();
+    int ret=DecodeBinary(mode, state, device_time, vals, thresh);
+    PipelineMetrics.Record(MetricReadTime, MetricsRegistry::NowUs()-t0);
+    if(ret==0)
+        PipelineMetrics.Add(MetricSamples);
+    return ret;
+}
+
+int Serial::DecodeBinary(char *mode, char *state, float *device_time, float *vals, float *thresh)
+{
+    //Samples left from the last batch frame
+    if(NbPending>0)
+    {
+        BinarySample *s=&Pending[BATCH_MAX_SIZE-NbPending];
+        (*mode)=s->Mode;
+        (*state)=s->State;
+        (*device_time)=s->Time;
+        for(int k=0; k<4; k++)
+            vals[k]=s->Vals[k];
+        thresh[0]=s->Thresh[0];
+        thresh[1]=s->Thresh[1];
+        NbPending--;
+        return 0;
+    }
+
+    if(Replay)
+    {
+        int ret=Replay->Read(mode, state, device_time, vals, thresh);
+        if(ret==-1)
+            Connected=false; //End of recording
+        return ret;
+    }
+
     if(Connected)
     {
         int nb_bytes_expected=1+1+4+1+1+2+2+2+2+2;//Ending by CRLF.
-        unsigned char *buffer=new unsigned char[nb_bytes_expected-1];
+        unsigned char buffer[1+4+1+BATCH_MAX_SIZE*6+2*2+2];
 
         //Get first char of the sequence
         unsigned char startbyte=0;
-        int i=0;
-        while( startbyte!='D' && startbyte!='S' && i<2*nb_bytes_expected)
+        int i=0, nb_skipped=0;
+        bool prev_decimation=false; //Frame sent before the last decimation change
+        while( !IsBinaryStart(startbyte) && i<2*nb_bytes_expected)
         {
             i++;
-            RS232_PollComport(PortCom, &startbyte, 1);
+            prev_decimation=(PrevDecimationNb>0);
+            if(PortRead(&startbyte, 1)==1 && !IsBinaryStart(startbyte))
+                nb_skipped++;
             Sleep(1); //1ms
         }
+        if(nb_skipped>0)
+            PipelineMetrics.Add(MetricSkippedBytes, nb_skipped);
         if(i>=2*nb_bytes_expected)
+        {
+            PipelineMetrics.Add(MetricErrNoStart);
             return -4;
+        }
+        if(nb_skipped>0)
+            PipelineMetrics.Add(MetricResyncs);
+
+        if(startbyte=='d' || startbyte=='s')
+            return ReadBatch(startbyte, prev_decimation ? PrevLogDecimation : LogDecimation, mode, state, device_time, vals, thresh);
 
         (*mode)=startbyte;
 
         //Get full sequence (minus start byte)
-        if(RS232_PollComport(PortCom, buffer, nb_bytes_expected-1)==nb_bytes_expected-1)
+        if(ReadBytes(buffer, nb_bytes_expected-1, 20)==nb_bytes_expected-1)
         {
             //State: use as sanity check
             if(buffer[0]!='R' && buffer[0]!='T' && buffer[0]!='P')
+            {
+                PipelineMetrics.Add(MetricErrHeader);
                 return -4;
+            }
             //State
             (*state)=buffer[0];
             //Time in s
@@ -236,18 +428,21 @@ int Serial::ReadBinary(char *mode, char *state, float *device_time, float *vals,
             //CHECKSUM???
             //return -2;
 
-            //Flush buffer
-            RS232_flushRX(PortCom);
-
             //Check that values looks correct
             if( (*mode=='D' || *mode=='S') )
+            {
+                PipelineMetrics.Add(MetricFrames);
                 return 0;
+            }
             else
+            {
+                PipelineMetrics.Add(MetricErrInvalid);
                 return -3;
+            }
         }
         else //Wrong nb of bytes received
         {
-            delete[] buffer;
+            PipelineMetrics.Add(MetricErrIncomplete);
             return -2;
         }
     }
@@ -257,16 +452,74 @@ int Serial::ReadBinary(char *mode, char *state, float *device_time, float *vals,
         if(Connect(true))
         {
             //Read again if finally connected
-            return ReadBinary(mode, state, device_time, vals, thresh);
+            return DecodeBinary(mode, state, device_time, vals, thresh);
         }
         else
         {
             //error otherwise
+            PipelineMetrics.Add(MetricErrNotConnected);
             return -1;
         }
     }
 }
 
+//!Read the rest of a batch frame (after the start byte), return its first sample and keep the others for next calls
+//!\param decimation: device log decimation when the frame was sent (samples spacing)
+int Serial::ReadBatch(unsigned char startbyte, int decimation, char *mode, char *state, float *device_time, float *vals, float *thresh)
+{
+    unsigned char buffer[1+4+1+BATCH_MAX_SIZE*6+2*2+2];
+
+    //State, time of the last sample, nb of samples
+    if(ReadBytes(buffer, 1+4+1, 20)!=1+4+1)
+    {
+        PipelineMetrics.Add(MetricErrIncomplete);
+        return -2;
+    }
+    int nb=buffer[5];
+    if((buffer[0]!='R' && buffer[0]!='T' && buffer[0]!='P') || nb<1 || nb>BATCH_MAX_SIZE)
+    {
+        PipelineMetrics.Add(MetricErrHeader);
+        return -4;
+    }
+
+    //Samples, thresholds, CRLF
+    unsigned char *b=buffer+1+4+1;
+    if(ReadBytes(b, nb*6+2*2+2, 40)!=nb*6+2*2+2)
+    {
+        PipelineMetrics.Add(MetricErrIncomplete);
+        return -2;
+    }
+    if(b[nb*6+4]!='\r' || b[nb*6+5]!='\n')
+    {
+        PipelineMetrics.Add(MetricErrInvalid);
+        return -3;
+    }
+
+    //Samples are evenly spaced (one every decimation device loops)
+    unsigned int last_ms=Int32toInt(buffer[1], buffer[2], buffer[3], buffer[4]);
+    float thresh_1=(float)(Int16toInt(b[nb*6], b[nb*6+1])/100.);
+    float thresh_2=(float)(Int16toInt(b[nb*6+2], b[nb*6+3])/100.);
+    for(int i=0; i<nb; i++)
+    {
+        //Stored at the end of Pending: NbPending last ones are returned
+        BinarySample *s=&Pending[BATCH_MAX_SIZE-nb+i];
+        s->Mode=startbyte-'a'+'A';
+        s->State=buffer[0];
+        s->Time=(float) ((last_ms-(nb-1-i)*(unsigned int)(DEVICE_LOOP_PERIOD_S*1000)*decimation) /1000.); //Whole ms, as single sample frames
+        s->Vals[0]=(signed char) b[i*6];
+        s->Vals[1]=(signed char) b[i*6+1];
+        s->Vals[2]=(float)(Int16toInt(b[i*6+2], b[i*6+3])/1000.);
+        s->Vals[3]=(float)(Int16toInt(b[i*6+4], b[i*6+5])/1000.);
+        s->Thresh[0]=thresh_1;
+        s->Thresh[1]=thresh_2;
+    }
+    NbPending=nb;
+    PipelineMetrics.Add(MetricFrames);
+    PipelineMetrics.Record(MetricBatchQueue, nb);
+
+    return DecodeBinary(mode, state, device_time, vals, thresh);
+}
+
 
 
 
@@ -277,7 +530,7 @@ bool Serial::CheckDevice()
     if(Connected)
     {
         //Flush buffer
-        RS232_flushRX(PortCom);
+        PortFlushRX();
 
         //Ensure is in pause mode
         SetState(false);
@@ -289,15 +542,21 @@ bool Serial::CheckDevice()
 
             //Get reply: should be "OKST"
             unsigned char reply[5]={'\0','\0','\0','\0','\0'};
-            if(RS232_PollComport(PortCom, reply, 4)==4);
+            if(PortRead(reply, 4)==4);
             {
                 //Flush buffer
-                RS232_flushRX(PortCom);
+                PortFlushRX();
                 printf("reply: -%s-\n", reply);
 
                 //Check reply
                 if(strcmp((char*)reply, "OKST")==0)
+                {
+                    //Streaming settings are kept by the device (e.g. previous host session)
+                    int decimation;
+                    if(GetParameter(ParamLogDecimation, &decimation))
+                        printf("Device log decimation: 1/%d.\n", decimation);
                     return true;
+                }
             }
         }
     }
@@ -309,10 +568,16 @@ bool Serial::CheckDevice()
 //!\return true if success
 bool Serial::SetState(bool play)
 {
+    if(Replay)
+    {
+        Replay->SetPlaying(play);
+        return Connected;
+    }
+
     if(Connected)
     {
         //Flush buffer
-        RS232_flushRX(PortCom);
+        PortFlushRX();
 
         //Send running (CDR) or pause (CDP)
         char cmd[4], expected_reply[3];
@@ -336,10 +601,10 @@ bool Serial::SetState(bool play)
 
             //Get reply: should be "OKxP" or "OKxR"
             unsigned char reply[10]={'\0','\0','\0','\0','\0','\0','\0','\0','\0','\0'};
-            if(RS232_PollComport(PortCom, reply, 10)>3);
+            if(PortRead(reply, 10)>3);
             {
                 //Flush buffer
-                RS232_flushRX(PortCom);
+                PortFlushRX();
 
                 printf("-%s-\n", reply);
                 //Check reply
@@ -369,11 +634,15 @@ void Serial::SetTesting(bool val)
 
 bool Serial::SetMode(mode_type mode)
 {
+    //Replay: mode is the recorded one
+    if(Replay)
+        return Connected;
+
     if(Connected)
     {
         //Flush buffer
-        RS232_flushRX(PortCom);
-        RS232_flushTX(PortCom);
+        PortFlushRX();
+        PortFlushTX();
 
         //Send running (CDR) or pause (CDP)
         char cmd[4], expected_reply[3];
@@ -394,10 +663,10 @@ bool Serial::SetMode(mode_type mode)
 
             //Get reply: should be "OKxP" or "OKxR"
             unsigned char reply[10]={'\0','\0','\0','\0','\0','\0','\0','\0','\0','\0'};;
-            if(RS232_PollComport(PortCom, reply, 10)>3);
+            if(PortRead(reply, 10)>3);
             {
                 //Flush buffer
-                RS232_flushRX(PortCom);
+                PortFlushRX();
 
                 printf("M-%s-\n", reply);
                 //Check reply
@@ -419,3 +688,277 @@ bool Serial::SetMode(mode_type mode)
 
     return false;
 }
+
+
+
+//!Send a command and retrieve the nb_bytes binary payload following the reply header
+//! (e.g. "OKX", reply ending by CRLF). The data frames received in between are kept, in
+//! order, for the next reads (see ReadBinary): streaming values are not lost.
+//!\return 0 if success, -1 if not connected, -2 if no (complete) reply
+int Serial::Query(const char *cmd, int cmd_len, const char *header, unsigned char *payload, int nb_bytes)
+{
+    if(!Connected)
+        return -1;
+    //No device to reply
+    if(Replay)
+        return -2;
+
+    if(SendChars(cmd, cmd_len)!=0)
+        return -1;
+    long long int t0=MetricsRegistry::NowUs();
+
+    //Reply follows the bytes already received: accumulate until header, payload and CRLF are found (or timeout)
+    int start=RxNb, header_len=strlen(header), reply_len=header_len+nb_bytes+2;
+    for(int t=0; t<500; t+=10)
+    {
+        Sleep(10);
+        //Full (values not read for a long time): oldest bytes lost
+        if(RxNb==SERIAL_RX_BUFFER_SIZE)
+        {
+            int nb_lost=(start>0) ? start : SERIAL_RX_BUFFER_SIZE/2;
+            PipelineMetrics.Add(MetricSkippedBytes, nb_lost);
+            RxDrop(nb_lost);
+            start=(start>nb_lost) ? start-nb_lost : 0;
+        }
+        int n=PortReceive(RxBuffer+RxNb, SERIAL_RX_BUFFER_SIZE-RxNb);
+        if(n>0)
+            RxNb+=n;
+
+        for(int i=start; i+reply_len<=RxNb; i++)
+        {
+            unsigned char *r=RxBuffer+i;
+            if(memcmp(r, header, header_len)==0 && r[reply_len-2]=='\r' && r[reply_len-1]=='\n')
+            {
+                if(nb_bytes>0)
+                    memcpy(payload, r+header_len, nb_bytes);
+                //Remove the reply: data frames around it are read next
+                LastReplyPos=i;
+                memmove(r, r+reply_len, RxNb-i-reply_len);
+                RxNb-=reply_len;
+                PipelineMetrics.Record(MetricCommandTime, MetricsRegistry::NowUs()-t0);
+                return 0;
+            }
+        }
+    }
+
+    PipelineMetrics.Add(MetricCommandTimeouts);
+    return -2;
+}
+
+//!Retrieve device loop profile (per stage timing) and jitter counters.
+//! Counters are reset on the device after each call.
+//!\return true if success
+bool Serial::GetProfile(DeviceProfile *profile)
+{
+    unsigned char buffer[1+DEVICE_PROFILE_NB_STAGES*3*2];
+
+    //Jitter: nb loops (32b), nb overruns (32b), max period (16b), dropped frames (16b), max TX fill (16b), active ratio (16b)
+    if(Query("CDJ", 3, "OKJ", buffer, 4+4+2+2+2+2)!=0)
+        return false;
+    profile->NbLoops=Int32toInt(buffer[0], buffer[1], buffer[2], buffer[3]);
+    profile->NbOverruns=Int32toInt(buffer[4], buffer[5], buffer[6], buffer[7]);
+    profile->MaxDt=Int16toInt(buffer[8], buffer[9]);
+    profile->NbDroppedFrames=Int16toInt(buffer[10], buffer[11]);
+    profile->MaxTxFill=Int16toInt(buffer[12], buffer[13]);
+    profile->ActivePermil=Int16toInt(buffer[14], buffer[15]);
+
+    //Profile: nb of stages then min, avg, max (16b) per stage
+    if(Query("CDX", 3, "OKX", buffer, 1+DEVICE_PROFILE_NB_STAGES*3*2)!=0)
+        return false;
+    //Firmware with a different set of stages
+    if(buffer[0]!=DEVICE_PROFILE_NB_STAGES)
+        return false;
+    profile->NbStages=buffer[0];
+    for(int i=0; i<profile->NbStages; i++)
+    {
+        unsigned char *b=buffer+1+i*3*2;
+        profile->Min[i]=Int16toInt(b[0], b[1]);
+        profile->Avg[i]=Int16toInt(b[2], b[3]);
+        profile->Max[i]=Int16toInt(b[4], b[5]);
+    }
+
+    return true;
+}
+
+//!Retrieve the device adaptive thresholds profile (summary of the learnt values) of the current mode
+//!\return true if success, false if no reply or nothing learnt yet on the device
+bool Serial::GetThresholdProfile(unsigned char *profile)
+{
+    return Query("CDG", 3, "OKG", profile, THRESHOLD_PROFILE_SIZE)==0;
+}
+
+//!Push an adaptive thresholds profile (as from GetThresholdProfile) to the device:
+//! applied if of the current device mode and saved in device EEPROM.
+//!\return true if success
+bool Serial::SetThresholdProfile(const unsigned char *profile)
+{
+    char cmd[3+THRESHOLD_PROFILE_SIZE];
+    memcpy(cmd, "CDW", 3);
+    memcpy(cmd+3, profile, THRESHOLD_PROFILE_SIZE);
+    return Query(cmd, 3+THRESHOLD_PROFILE_SIZE, "OKW", NULL, 0)==0;
+}
+
+//!Retrieve up to OFFLINE_DUMP_MAX records of the device offline buffer, oldest first,
+//! with a sequence nb (device time in s, 16b) after from_seq.
+//!\return the nb of records retrieved, -1 if no reply
+int Serial::GetOfflineRecords(unsigned int from_seq, OfflineRecord *records)
+{
+    char cmd[5]={'C', 'D', 'O', (char)(from_seq&0xFF), (char)((from_seq>>8)&0xFF)};
+    unsigned char buffer[1+OFFLINE_DUMP_MAX*OFFLINE_RECORD_SIZE];
+
+    //Nb of valid records then OFFLINE_DUMP_MAX records (fixed length reply)
+    if(Query(cmd, 5, "OKO", buffer, 1+OFFLINE_DUMP_MAX*OFFLINE_RECORD_SIZE)!=0)
+        return -1;
+
+    int nb=(buffer[0]>OFFLINE_DUMP_MAX) ? OFFLINE_DUMP_MAX : buffer[0];
+    for(int i=0; i<nb; i++)
+    {
+        //Seq (16b), flags, angles (8b signed), max velocities (cm.s-1 and deg.s-1)
+        unsigned char *b=buffer+1+i*OFFLINE_RECORD_SIZE;
+        records[i].Seq=Int16toInt(b[0], b[1]);
+        records[i].Mode=(b[2]&0x01) ? 'D' : 'S';
+        records[i].State=(b[2]&0x02) ? 'T' : 'R';
+        records[i].Feedback=(b[2]&0x04)!=0;
+        records[i].Angle[0]=(signed char)b[3];
+        records[i].Angle[1]=(signed char)b[4];
+        records[i].LinVel=b[5]/100.;
+        records[i].AngVel=b[6];
+    }
+
+    return nb;
+}
+
+//!Start (on) or stop magnetometer calibration mode: device streams raw magnetometer values
+//!\return true if success
+bool Serial::SetMagStreaming(bool on)
+{
+    char cmd[4]={'C', 'D', 'M', (char)(on ? 1 : 0)};
+    MagBufferNb=0;
+    return Query(cmd, 4, "OKM", NULL, 0)==0;
+}
+
+//!Retrieve the raw magnetometer samples received since last call (calibration mode, non blocking)
+//!\return the nb of samples (up to max_nb), -1 if not connected
+int Serial::ReadMagSamples(short samples[][3], int max_nb)
+{
+    if(!Connected || Replay)
+        return -1;
+
+    int n=PortRead(MagBuffer+MagBufferNb, sizeof(MagBuffer)-MagBufferNb);
+    if(n>0)
+        MagBufferNb+=n;
+
+    //Frames: MC, x, y, z (16b), CRLF
+    const int frame_size=2+3*2+2;
+    int nb=0, i=0;
+    while(i+frame_size<=MagBufferNb && nb<max_nb)
+    {
+        unsigned char *b=MagBuffer+i;
+        if(b[0]=='M' && b[1]=='C' && b[8]=='\r' && b[9]=='\n')
+        {
+            for(int k=0; k<3; k++)
+                samples[nb][k]=(short)Int16toInt(b[2+2*k], b[3+2*k]);
+            nb++;
+            i+=frame_size;
+        }
+        else
+        {
+            i++;
+        }
+    }
+
+    //Keep what is left (incomplete frame) for next call
+    memmove(MagBuffer, MagBuffer+i, MagBufferNb-i);
+    MagBufferNb-=i;
+
+    return nb;
+}
+
+//!Apply and save on the device a magnetometer calibration: m_calibrated = W.(m_raw-offset).
+//! W elements must be in [-1, 1].
+//!\return true if success
+bool Serial::SetMagCalibration(const float offset[3], const float W[3][3])
+{
+    char cmd[3+MAG_CALIBRATION_SIZE];
+    unsigned char *calib=(unsigned char *)cmd+3;
+    memcpy(cmd, "CDC", 3);
+
+    //'E', offsets, W in Q12, all LSB first
+    short vals[3+9];
+    for(int i=0; i<3; i++)
+    {
+        vals[i]=(short)floor(offset[i]+0.5);
+        for(int j=0; j<3; j++)
+            vals[3+i*3+j]=(short)floor(W[i][j]*4096+0.5);
+    }
+    calib[0]='E';
+    for(int i=0; i<3+9; i++)
+    {
+        calib[1+2*i]=vals[i]&0xFF;
+        calib[2+2*i]=(vals[i]>>8)&0xFF;
+    }
+    unsigned char sum=0;
+    for(int i=0; i<MAG_CALIBRATION_SIZE-1; i++)
+        sum+=calib[i];
+    calib[MAG_CALIBRATION_SIZE-1]=~sum;
+
+    return Query(cmd, 3+MAG_CALIBRATION_SIZE, "OKC", NULL, 0)==0;
+}
+
+//!Set a device parameter (minimal thresholds x100, sleep delay in s). The device limits the value to its valid range:
+//! the applied value is returned in applied if not NULL.
+//!\return true if success
+bool Serial::SetParameter(device_parameter param, int value, int *applied)
+{
+    char cmd[6]={'C', 'D', 'V', (char)param, (char)(value&0xFF), (char)((value>>8)&0xFF)};
+    unsigned char reply[3];
+
+    //Acknowledged with id and applied value
+    if(Query(cmd, 6, "OKV", reply, 3)!=0 || reply[0]!=param)
+    {
+        //Reply lost, the device may have applied it: read it back (batch samples time)
+        int device_value;
+        if(param==ParamLogDecimation)
+            GetParameter(param, &device_value);
+        return false;
+    }
+    int value_applied=(short)Int16toInt(reply[1], reply[2]);
+    if(param==ParamLogDecimation)
+        LogDecimationChanged(value_applied);
+    if(applied)
+        (*applied)=value_applied;
+    return true;
+}
+
+//!Get a device parameter value
+//!\return true if success
+bool Serial::GetParameter(device_parameter param, int *value)
+{
+    char cmd[4]={'C', 'D', 'U', (char)param};
+    unsigned char reply[3];
+
+    if(Query(cmd, 4, "OKU", reply, 3)!=0 || reply[0]!=param)
+        return false;
+    (*value)=(short)Int16toInt(reply[1], reply[2]);
+    if(param==ParamLogDecimation)
+        LogDecimationChanged(*value);
+    return true;
+}
+
+//!Device log decimation from a command reply: the batch frames received before the reply
+//! (still in RxBuffer) were sent with the previous one
+void Serial::LogDecimationChanged(int decimation)
+{
+    if(decimation<1 || decimation==LogDecimation)
+        return;
+    PrevLogDecimation=LogDecimation;
+    PrevDecimationNb=LastReplyPos;
+    LogDecimation=decimation;
+}
+
+//!Set device streaming: batch_size samples per frame (1: single sample frames), one sample every decimation device loops
+//!\return true if success
+bool Serial::SetStreaming(int batch_size, int decimation)
+{
+    return SetParameter(ParamBatchSize, batch_size) && SetParameter(ParamLogDecimation, decimation);
+}
@@ -16,13 +16,77 @@
 #include <FL/fl_ask.H>
 
 #include "rs232.h"
+#include "ReplaySource.h"
+#include "SerialCapture.h"
+#include "MetricsRegistry.h"
 
 enum mode_type {Static, Dynamic};
 
+#define DEVICE_PROFILE_NB_STAGES 8
+
+//! Device loop timing as returned by CDJ (jitter) and CDX (per stage profile) commands
+typedef struct
+{
+    int NbStages;
+    unsigned int Min[DEVICE_PROFILE_NB_STAGES], Avg[DEVICE_PROFILE_NB_STAGES], Max[DEVICE_PROFILE_NB_STAGES]; //!< in us
+    unsigned int NbLoops, NbOverruns;
+    unsigned int MaxDt; //!< Longest loop period (us, 65535 for longer ones)
+    unsigned int NbDroppedFrames, MaxTxFill;
+    unsigned int ActivePermil; //!< Loop active (not sleeping) time ratio, in 1/1000
+} DeviceProfile;
+
+//! Names of the stages in the order of the device CDX record (see firmware Profiling.h)
+extern const char *DeviceProfileStageNames[];
+
+//! Adaptive thresholds profile (CDG/CDW) size: mode, 2x12 quantiles (16b), checksum (see firmware ThresholdStore.h)
+#define THRESHOLD_PROFILE_SIZE (1+2*12*2+1)
+
+//! Device offline buffer (CDO): records size and max nb per reply (see firmware OfflineBuffer.h)
+#define OFFLINE_RECORD_SIZE 7
+#define OFFLINE_DUMP_MAX 8
+
+//! Device parameters which can be set (CDV) and read (CDU), see firmware PARAMETER
+enum device_parameter {ParamSensitivity, ParamMinThreshold1, ParamMinThreshold2, ParamLogDecimation, ParamSleepDelay, ParamBatchSize};
+
+//! rs232 ports scanned for a device (see rs232.c)
+#ifdef WINDOWS
+    #define SERIAL_FIRST_PORT 0 //!< COM1
+    #define SERIAL_LAST_PORT 9 //!< COM10
+#else
+    #define SERIAL_FIRST_PORT 16 //!< /dev/ttyUSB0
+    #define SERIAL_LAST_PORT 27 //!< /dev/rfcomm1 (USB, ACM and bluetooth serial ports)
+#endif
+
+#define SERIAL_RX_BUFFER_SIZE 4096 //!< Bytes received while waiting for command replies (~2s at 19200 bauds), read before the port
+
+#define DEVICE_LOOP_PERIOD_S 0.01 //!< Device loop (sampling) period
+#define BATCH_MAX_SIZE 4 //!< Max nb of samples in a batch frame (see firmware MAX_BATCH_SIZE)
+
+//! One sample of a binary (batch) frame
+typedef struct
+{
+    char Mode, State;
+    float Time;
+    float Vals[4], Thresh[2];
+} BinarySample;
+
+//! Magnetometer calibration (CDC) size: 'E', offsets (3 x 16b), W matrix (9 x 16b Q12), checksum (see firmware MagCalibration.h)
+#define MAG_CALIBRATION_SIZE (1+3*2+9*2+1)
+
+//! Decimated values (1 per s) kept by the device in case of link drop
+typedef struct
+{
+    unsigned int Seq; //!< Device time in s (16b: wraps around)
+    char Mode, State;
+    bool Feedback; //!< Feedback given during that second
+    float Angle[2]; //!< deg
+    float LinVel, AngVel; //!< Max over the second (m.s-1 and deg.s-1)
+} OfflineRecord;
+
 class Serial
 {
     public:
-        Serial(bool quiet=false);
+        Serial(bool quiet=false, ReplaySource *replay=NULL, SerialCapture *wire=NULL);
         ~Serial();
 
         bool Connect(bool quiet=false);
@@ -38,14 +102,53 @@ class Serial
         void SetTesting(bool testingmode);
         bool IsTesting(){return TestingMode;}
         bool SetMode(mode_type mode);
+        bool GetProfile(DeviceProfile *profile);
+        bool GetThresholdProfile(unsigned char *profile);
+        bool SetThresholdProfile(const unsigned char *profile);
+        int GetOfflineRecords(unsigned int from_seq, OfflineRecord *records);
+        bool SetMagStreaming(bool on);
+        int ReadMagSamples(short samples[][3], int max_nb);
+        bool SetMagCalibration(const float offset[3], const float W[3][3]);
+        bool SetParameter(device_parameter param, int value, int *applied=NULL);
+        bool GetParameter(device_parameter param, int *value);
+        bool SetStreaming(int batch_size, int decimation);
 
         bool GetConnected() { return Connected; }
+        int GetPort() { return PortCom; } //!< rs232 port index (COM<index+1>)
         void SetConnected(bool val) { Connected = val; }
+        bool IsReplay() { return Replay!=NULL; }
+        bool IsReplayEnded() { return (Replay && Replay->IsEnded()) || (WireReplay() && Wire->IsEnded()); }
 
     private:
+        bool WireReplay() { return Wire && Wire->IsReplay(); }
+        int PortRead(unsigned char *buffer, int nb);
+        int PortReceive(unsigned char *buffer, int nb);
+        void RxDrop(int nb);
+        void PortWrite(const unsigned char *buffer, int nb);
+        void PortFlushRX();
+        void PortFlushTX();
+        void PortClose();
+        int Query(const char *cmd, int cmd_len, const char *header, unsigned char *payload, int nb_bytes);
+        int ReadBytes(unsigned char *buffer, int nb, int timeout_ms);
+        void LogDecimationChanged(int decimation);
+        int DecodeBinary(char *mode, char *state, float *device_time, float *vals, float *thresh);
+        int ReadBatch(unsigned char startbyte, int decimation, char *mode, char *state, float *device_time, float *vals, float *thresh);
+
         int PortCom;
         bool Connected;
+        ReplaySource *Replay; //!< Recorded values instead of a device (not owned), see ReplaySource.h
+        SerialCapture *Wire; //!< Raw bytes capture or replay (not owned), see SerialCapture.h
         bool TestingMode;
+        unsigned char MagBuffer[256]; //!< Raw magnetometer frames not parsed yet (calibration mode)
+        int MagBufferNb;
+        unsigned char RxBuffer[SERIAL_RX_BUFFER_SIZE]; //!< Received bytes not read yet: data frames received while waiting for a command reply (see Query)
+        int RxNb;
+        int LastReplyPos; //!< Bytes received before the last command reply (in RxBuffer then)
+        BinarySample Pending[BATCH_MAX_SIZE]; //!< Samples of the last batch frame not returned yet (the NbPending last ones)
+        int NbPending;
+        int LogDecimation; //!< Current device log decimation (for batch samples time)
+        int PrevLogDecimation; //!< Decimation of the frames received before the last change...
+        int PrevDecimationNb; //!< ...and still in RxBuffer (first bytes)
 };
 
 #endif // SERIAL_H
@@ -0,0 +1,189 @@
+//--------------------------------------------------------------------------
+//
+//    Copyright (C) 2020 Vincent Crocher
+//    The University of Melbourne
+//
+//	  This file is part of ShoulderTrackingIMU.
+//
+//
+//---------------------------------------------------------------------------
+#include "SessionLog.h"
+#include <string.h>
+#include <math.h>
+
+static void PutU16(unsigned char *b, unsigned int v) {b[0]=v&0xFF; b[1]=(v>>8)&0xFF;}
+static void PutU32(unsigned char *b, unsigned int v) {for(int i=0; i<4; i++) b[i]=(v>>(8*i))&0xFF;}
+static void PutI64(unsigned char *b, long long int v) {for(int i=0; i<8; i++) b[i]=((unsigned long long int)v>>(8*i))&0xFF;}
+
+//Scaled value, clamped to the field range
+static unsigned int ToU16(float v, int scale)
+{
+    long int s=lround(v*scale);
+    return s<0 ? 0 : (s>0xFFFF ? 0xFFFF : s);
+}
+static int ToI8(float v)
+{
+    long int s=lround(v);
+    return s<-128 ? -128 : (s>127 ? 127 : s);
+}
+
+
+//!Host time in s from time in us, computed as from gettimeofday() (same double)
+double SessionHostTime(long long int us)
+{
+    return (us/1000000) + (us%1000000) / (1000.0*1000.0);
+}
+
+//!Host time in us, rounded as printed with %f in the CSV logs (t_s*1e6 can round differently)
+long long int SessionHostTimeUs(double t_s)
+{
+    char txt[64];
+    long long int sec, usec;
+    snprintf(txt, 64, "%f", t_s);
+    if(t_s<0 || sscanf(txt, "%lld.%lld", &sec, &usec)!=2)
+        return llround(t_s*1000000.);
+    return sec*1000000+usec;
+}
+
+//!Record as a line of the CSV log (same as logged by MainWindow before the binary format,
+//! i.e. "%c,%c,%c,%f,%f,%f,%f,%f,%f,%f,%f,%d,%d\n"), in csv.Line()
+//!\return line length
+int SessionRecordToCsv(const SessionRecord *rec, CsvWriter &csv)
+{
+    csv.Begin();
+    csv.Char(rec->Type);
+    csv.Char(rec->Mode);
+    csv.Char(rec->State);
+    csv.Fixed(SessionHostTime(rec->HostTimeUs));
+    csv.Fixed(rec->DeviceTime);
+    for(int i=0; i<4; i++)
+        csv.Fixed(rec->Vals[i]);
+    csv.Fixed(rec->Thresh[0]);
+    csv.Fixed(rec->Thresh[1]);
+    csv.Int(rec->Mouse[0]);
+    csv.Int(rec->Mouse[1]);
+    return csv.End();
+}
+
+
+
+SessionLogEncoder::SessionLogEncoder()
+{
+    memset(&State, 0, sizeof(EncoderState));
+    PreviousState=State;
+}
+
+//!File header
+//!\return nb of bytes (SESSION_LOG_HEADER_SIZE)
+int SessionLogEncoder::EncodeHeader(char mode, bool intervention, const char *device_id, long long int start_us, unsigned char *out)
+{
+    memset(out, 0, SESSION_LOG_HEADER_SIZE);
+    memcpy(out, "STLG", 4);
+    PutU16(out+4, SESSION_LOG_VERSION);
+    PutU16(out+6, SESSION_LOG_HEADER_SIZE);
+    out[8]=SESSION_LOG_RECORD_SIZE;
+    out[9]=mode;
+    out[10]=intervention;
+    strncpy((char*)out+11, device_id, 16);
+    PutU16(out+27, SESSION_LOG_VEL_SCALE);
+    PutU16(out+29, SESSION_LOG_THRESH_SCALE);
+    PutU16(out+31, SESSION_LOG_OFFLINE_LIN_VEL_SCALE);
+    PutU16(out+33, SESSION_LOG_OFFLINE_ANG_VEL_SCALE);
+    PutI64(out+35, start_us);
+
+    Index.clear();
+    memset(&State, 0, sizeof(EncoderState));
+    State.Offset=SESSION_LOG_HEADER_SIZE;
+    PreviousState=State;
+    return SESSION_LOG_HEADER_SIZE;
+}
+
+//!Encode a value (preceded by a block start record if needed) in out (2*SESSION_LOG_RECORD_SIZE bytes max)
+//!\return nb of bytes
+int SessionLogEncoder::Encode(const SessionRecord *rec, unsigned char *out)
+{
+    PreviousState=State;
+    int nb=0;
+
+    unsigned int device_ms=(unsigned int)lround(rec->DeviceTime*1000.);
+    //New block: full, first one, or time deltas out of range (pause, device reset...)
+    if(State.NbBlocks==0 || State.NbInBlock>=SESSION_LOG_BLOCK_RECORDS ||
+       rec->HostTimeUs<State.BaseUs || rec->HostTimeUs-State.BaseUs>0xFFFFFFFFLL ||
+       device_ms<State.BaseMs || device_ms-State.BaseMs>0xFFFF)
+    {
+        memset(out, 0, SESSION_LOG_RECORD_SIZE);
+        out[0]=SESSION_LOG_TYPE_BLOCK;
+        PutI64(out+1, rec->HostTimeUs);
+        PutU32(out+9, device_ms);
+        SessionBlockIndex block={State.Offset, rec->HostTimeUs, device_ms, 0};
+        Index.resize(State.NbBlocks);
+        Index.push_back(block);
+        State.BaseUs=rec->HostTimeUs;
+        State.BaseMs=device_ms;
+        State.NbInBlock=0;
+        State.NbBlocks++;
+        State.Offset+=SESSION_LOG_RECORD_SIZE;
+        nb+=SESSION_LOG_RECORD_SIZE;
+    }
+
+    unsigned char *b=out+nb;
+    int type=(rec->Type=='G') ? 1 : ((rec->Type=='A') ? 2 : 3);
+    int state=(rec->State=='R') ? 0 : ((rec->State=='T') ? 1 : 2);
+    b[0]=type | ((rec->Mode=='D')<<2) | (state<<3);
+    PutU32(b+1, (unsigned int)(rec->HostTimeUs-State.BaseUs));
+    PutU16(b+5, device_ms-State.BaseMs);
+    b[7]=(unsigned char)ToI8(rec->Vals[0]);
+    b[8]=(unsigned char)ToI8(rec->Vals[1]);
+    if(rec->Type=='O')
+    {
+        PutU16(b+9, ToU16(rec->Vals[2], SESSION_LOG_OFFLINE_LIN_VEL_SCALE));
+        PutU16(b+11, ToU16(rec->Vals[3], SESSION_LOG_OFFLINE_ANG_VEL_SCALE));
+    }
+    else
+    {
+        PutU16(b+9, ToU16(rec->Vals[2], SESSION_LOG_VEL_SCALE));
+        PutU16(b+11, ToU16(rec->Vals[3], SESSION_LOG_VEL_SCALE));
+    }
+    PutU16(b+13, ToU16(rec->Thresh[0], SESSION_LOG_THRESH_SCALE));
+    PutU16(b+15, ToU16(rec->Thresh[1], SESSION_LOG_THRESH_SCALE));
+    PutU16(b+17, (unsigned short)rec->Mouse[0]);
+    PutU16(b+19, (unsigned short)rec->Mouse[1]);
+    nb+=SESSION_LOG_RECORD_SIZE;
+
+    State.NbInBlock++;
+    State.Offset+=SESSION_LOG_RECORD_SIZE;
+    Index.back().NbRecords=State.NbInBlock;
+    return nb;
+}
+
+//!Forget the last encoded value (not written)
+void SessionLogEncoder::Rollback()
+{
+    State=PreviousState;
+    Index.resize(State.NbBlocks);
+    if(State.NbBlocks>0)
+        Index.back().NbRecords=State.NbInBlock;
+}
+
+//!Block index and end of file marker
+//!\return nb of bytes, 0 if max_size is too small
+int SessionLogEncoder::EncodeIndex(unsigned char *out, int max_size)
+{
+    int size=GetIndexSize();
+    if(size>max_size)
+        return 0;
+
+    memcpy(out, "STIX", 4);
+    PutU32(out+4, Index.size());
+    unsigned char *b=out+8;
+    for(unsigned int i=0; i<Index.size(); i++, b+=SESSION_LOG_INDEX_ENTRY_SIZE)
+    {
+        PutU32(b, Index[i].Offset);
+        PutI64(b+4, Index[i].BaseUs);
+        PutU32(b+12, Index[i].BaseMs);
+        PutU32(b+16, Index[i].NbRecords);
+    }
+    PutU32(b, State.Offset);
+    memcpy(b+4, "STLX", 4);
+    return size;
+}
@@ -0,0 +1,111 @@
+//--------------------------------------------------------------------------
+//
+//    Copyright (C) 2020 Vincent Crocher
+//    The University of Melbourne
+//
+//	  This file is part of ShoulderTrackingIMU.
+//
+//
+//---------------------------------------------------------------------------
+#ifndef SESSIONLOG_H
+#define SESSIONLOG_H
+
+#include <stdio.h>
+#include <vector>
+#include "CsvWriter.h"
+
+//! Binary session log (.stl) format, version 1. All values LSB first.
+//!
+//! Header (SESSION_LOG_HEADER_SIZE bytes):
+//!  "STLG", uint16 version, uint16 header size, uint8 record size, char initial mode (S/D),
+//!  uint8 intervention, char device id[16], uint16 scales (velocities, thresholds, offline
+//!  linear and angular velocities), int64 start time (us), padding.
+//! Then a stream of fixed size (SESSION_LOG_RECORD_SIZE) records, byte 0 being the type
+//! (bits 0-1), mode (bit 2: D) and state (bits 3-4: R, T, P):
+//!  -block start (type 0): int64 base host time (us), uint32 base device time (ms).
+//!   A new block is started every SESSION_LOG_BLOCK_RECORDS values, or when the time
+//!   deltas below do not fit.
+//!  -value (type 1: G, 2: A, 3: O): uint32 host time - block base (us), uint16 device time -
+//!   block base (ms), int8 angles x2 (deg), uint16 velocities x2, uint16 thresholds x2
+//!   (scaled, see header), int16 mouse position x2.
+//! Closed files end with the block index: "STIX", uint32 nb of blocks, for each block its
+//! offset (uint32), base times (int64 us, uint32 ms) and nb of values (uint32); and the
+//! index offset (uint32) and "STLX". Files without it (crash) are read up to the last
+//! complete record.
+//! Values are stored as received from the device (whole degrees, scaled velocities and
+//! thresholds) so that converting back to CSV gives the same text as logging as CSV.
+#define SESSION_LOG_VERSION 1
+#define SESSION_LOG_HEADER_SIZE 64
+#define SESSION_LOG_RECORD_SIZE 21
+#define SESSION_LOG_BLOCK_RECORDS 256
+#define SESSION_LOG_INDEX_ENTRY_SIZE 20
+#define SESSION_LOG_TYPE_BLOCK 0 //!< Record type of the block start records
+#define SESSION_LOG_VEL_SCALE 1000 //!< As transmitted by the device (mm.s-1 and mrad.s-1)
+#define SESSION_LOG_THRESH_SCALE 100
+#define SESSION_LOG_OFFLINE_LIN_VEL_SCALE 100 //!< Offline records (cm.s-1)
+#define SESSION_LOG_OFFLINE_ANG_VEL_SCALE 1 //!< Offline records (deg.s-1)
+
+//! One logged line
+typedef struct
+{
+    char Type; //!< G (game), A (assessment) or O (offline record)
+    char Mode, State;
+    long long int HostTimeUs;
+    float DeviceTime;
+    float Vals[4], Thresh[2];
+    int Mouse[2];
+} SessionRecord;
+
+typedef struct
+{
+    unsigned int Offset;
+    long long int BaseUs;
+    unsigned int BaseMs;
+    unsigned int NbRecords;
+} SessionBlockIndex;
+
+typedef struct
+{
+    int Version;
+    char Mode;
+    bool Intervention;
+    char DeviceId[17];
+    int Scales[4]; //!< Velocities, thresholds, offline linear and angular velocities
+    long long int StartUs;
+} SessionHeader;
+
+double SessionHostTime(long long int us);
+long long int SessionHostTimeUs(double t_s);
+int SessionRecordToCsv(const SessionRecord *rec, CsvWriter &csv);
+
+
+//! Builds the binary log content (no file access: the bytes are written by the caller,
+//! see LogWriter). If the caller cannot write the bytes of a record, Rollback() must be
+//! called for the next ones to stay consistent.
+class SessionLogEncoder
+{
+    public:
+        SessionLogEncoder();
+
+        int EncodeHeader(char mode, bool intervention, const char *device_id, long long int start_us, unsigned char *out);
+        int Encode(const SessionRecord *rec, unsigned char *out);
+        void Rollback();
+        int EncodeIndex(unsigned char *out, int max_size);
+        int GetIndexSize() {return 4+4+Index.size()*SESSION_LOG_INDEX_ENTRY_SIZE+4+4;}
+
+    private:
+        typedef struct
+        {
+            unsigned int Offset;
+            long long int BaseUs;
+            unsigned int BaseMs;
+            int NbInBlock;
+            int NbBlocks;
+        } EncoderState;
+
+        EncoderState State, PreviousState;
+        std::vector<SessionBlockIndex> Index;
+};
+
+
+#endif // SESSIONLOG_H
@@ -0,0 +1,277 @@
+//--------------------------------------------------------------------------
+//
+//    Copyright (C) 2020 Vincent Crocher
+//    The University of Melbourne
+//
+//	  This file is part of ShoulderTrackingIMU.
+//
+//
+//---------------------------------------------------------------------------
+#include "SessionLogReader.h"
+#include "LogChunk.h"
+#include <string.h>
+#include <thread>
+
+//Record type (bits 0-1 of byte 0) and state (bits 3-4)
+static const char RecordTypes[4]={0, 'G', 'A', 'O'};
+static const char RecordStates[3]={'R', 'T', 'P'};
+
+static unsigned int GetU16(const unsigned char *b) {return b[0] | (b[1]<<8);}
+static unsigned int GetU32(const unsigned char *b) {return b[0] | (b[1]<<8) | (b[2]<<16) | ((unsigned int)b[3]<<24);}
+static long long int GetI64(const unsigned char *b)
+{
+    unsigned long long int v=0;
+    for(int i=7; i>=0; i--)
+        v=(v<<8) | b[i];
+    return (long long int)v;
+}
+
+
+typedef struct
+{
+    const unsigned char *Compressed;
+    unsigned long int CompressedSize, RawOffset, RawSize, Crc;
+    bool Ok;
+} Chunk;
+
+//!Decompress chunks k, k+step, k+2*step... (one thread)
+static void DecompressChunks(std::vector<Chunk> *chunks, unsigned char *out, int k, int step)
+{
+    for(unsigned int i=k; i<chunks->size(); i+=step)
+    {
+        Chunk &c=(*chunks)[i];
+        uLongf size=c.RawSize;
+        c.Ok=(uncompress(out+c.RawOffset, &size, c.Compressed, c.CompressedSize)==Z_OK && size==c.RawSize &&
+              crc32(crc32(0L, Z_NULL, 0), out+c.RawOffset, size)==c.Crc);
+    }
+}
+
+
+SessionLogReader::SessionLogReader()
+{
+    Close();
+}
+
+SessionLogReader::~SessionLogReader()
+{
+}
+
+//!Load a binary log and read its header (and index)
+//!\return false if not a (supported) binary log
+bool SessionLogReader::Open(const char *filename)
+{
+    Close();
+    FILE *f=fopen(filename, "rb");
+    if(!f)
+        return false;
+    fseek(f, 0, SEEK_END);
+    long file_size=ftell(f);
+    fseek(f, 0, SEEK_SET);
+    std::vector<unsigned char> file(file_size);
+    bool read=(file_size>0 && fread(&file[0], 1, file_size, f)==(size_t)file_size);
+    fclose(f);
+    if(!read)
+        return false;
+
+    if(file_size>=4 && memcmp(&file[0], "STZC", 4)==0)
+    {
+        Compressed=true;
+        if(!Decompress(file))
+            return false;
+    }
+    else
+    {
+        Data.swap(file);
+    }
+
+    const unsigned char *h=Data.size()>=SESSION_LOG_HEADER_SIZE ? &Data[0] : NULL;
+    if(!h || memcmp(h, "STLG", 4)!=0 || GetU16(h+4)!=SESSION_LOG_VERSION || h[8]!=SESSION_LOG_RECORD_SIZE)
+    {
+        Close();
+        return false;
+    }
+    Header.Version=GetU16(h+4);
+    Header.Mode=h[9];
+    Header.Intervention=h[10];
+    memcpy(Header.DeviceId, h+11, 16);
+    Header.DeviceId[16]='\0';
+    for(int i=0; i<4; i++)
+        Header.Scales[i]=GetU16(h+27+2*i);
+    Header.StartUs=GetI64(h+35);
+    DataStart=GetU16(h+6);
+
+    Complete=ReadIndex();
+    if(!Complete)
+    {
+        //Interrupted session: up to the last complete record
+        DataEnd=DataStart+(Data.size()-DataStart)/SESSION_LOG_RECORD_SIZE*SESSION_LOG_RECORD_SIZE;
+        BuildIndex();
+    }
+
+    Pos=DataStart;
+    return true;
+}
+
+void SessionLogReader::Close()
+{
+    Data.clear();
+    Index.clear();
+    Complete=false;
+    Compressed=false;
+    NbChunks=0;
+    DataStart=DataEnd=Pos=0;
+    BaseUs=0;
+    BaseMs=0;
+}
+
+//!Decompress all the (complete and valid) chunks of file in Data, in parallel
+bool SessionLogReader::Decompress(const std::vector<unsigned char> &file)
+{
+    //Chunks list: stops at the first incomplete one (crash) or discontinuity
+    std::vector<Chunk> chunks;
+    unsigned long int pos=0, raw_size=0;
+    while(pos+LOG_CHUNK_HEADER_SIZE<=file.size() && memcmp(&file[pos], "STZC", 4)==0)
+    {
+        Chunk c;
+        c.RawOffset=GetU32(&file[pos+4]);
+        c.RawSize=GetU32(&file[pos+8]);
+        c.CompressedSize=GetU32(&file[pos+12]);
+        c.Crc=GetU32(&file[pos+16]);
+        c.Compressed=&file[pos+LOG_CHUNK_HEADER_SIZE];
+        if(pos+LOG_CHUNK_HEADER_SIZE+c.CompressedSize>file.size() || c.RawOffset!=raw_size)
+            break;
+        chunks.push_back(c);
+        raw_size+=c.RawSize;
+        pos+=LOG_CHUNK_HEADER_SIZE+c.CompressedSize;
+    }
+    if(chunks.size()==0)
+        return false;
+
+    Data.resize(raw_size);
+    int nb_threads=std::thread::hardware_concurrency();
+    if(nb_threads<1)
+        nb_threads=1;
+    if(nb_threads>(int)chunks.size())
+        nb_threads=chunks.size();
+    std::vector<std::thread> threads;
+    for(int k=1; k<nb_threads; k++)
+        threads.push_back(std::thread(DecompressChunks, &chunks, &Data[0], k, nb_threads));
+    DecompressChunks(&chunks, &Data[0], 0, nb_threads);
+    for(unsigned int k=0; k<threads.size(); k++)
+        threads[k].join();
+
+    //Up to the first corrupted chunk
+    NbChunks=0;
+    while(NbChunks<(int)chunks.size() && chunks[NbChunks].Ok)
+        NbChunks++;
+    Data.resize(NbChunks<(int)chunks.size() ? chunks[NbChunks].RawOffset : raw_size);
+    return NbChunks>0;
+}
+
+bool SessionLogReader::ReadIndex()
+{
+    long size=Data.size();
+    if(size<SESSION_LOG_HEADER_SIZE+16 || memcmp(&Data[size-4], "STLX", 4)!=0)
+        return false;
+
+    DataEnd=GetU32(&Data[size-8]);
+    if(DataEnd<DataStart || DataEnd+8>size || memcmp(&Data[DataEnd], "STIX", 4)!=0)
+        return false;
+    unsigned int nb=GetU32(&Data[DataEnd+4]);
+    if(DataEnd+8+(long)nb*SESSION_LOG_INDEX_ENTRY_SIZE+8!=size)
+        return false;
+
+    Index.resize(nb);
+    const unsigned char *b=&Data[DataEnd+8];
+    for(unsigned int i=0; i<nb; i++, b+=SESSION_LOG_INDEX_ENTRY_SIZE)
+    {
+        Index[i].Offset=GetU32(b);
+        Index[i].BaseUs=GetI64(b+4);
+        Index[i].BaseMs=GetU32(b+12);
+        Index[i].NbRecords=GetU32(b+16);
+    }
+    return true;
+}
+
+//!Index from the block start records (interrupted sessions)
+void SessionLogReader::BuildIndex()
+{
+    Index.clear();
+    for(long pos=DataStart; pos+SESSION_LOG_RECORD_SIZE<=DataEnd; pos+=SESSION_LOG_RECORD_SIZE)
+    {
+        const unsigned char *b=&Data[pos];
+        if((b[0]&0x03)==SESSION_LOG_TYPE_BLOCK)
+        {
+            SessionBlockIndex block={(unsigned int)pos, GetI64(b+1), GetU32(b+9), 0};
+            Index.push_back(block);
+        }
+        else if(Index.size()>0)
+        {
+            Index.back().NbRecords++;
+        }
+    }
+}
+
+//!Go to the block containing host time host_us (first block if before)
+//!\return false if no block
+bool SessionLogReader::Seek(long long int host_us)
+{
+    if(Index.size()==0)
+        return false;
+    //Last block starting before host_us
+    unsigned int lo=0, hi=Index.size();
+    while(hi-lo>1)
+    {
+        unsigned int mid=(lo+hi)/2;
+        if(Index[mid].BaseUs<=host_us)
+            lo=mid;
+        else
+            hi=mid;
+    }
+    Pos=Index[lo].Offset;
+    return true;
+}
+
+//!Next value of the log
+//!\return false at the end of the log
+bool SessionLogReader::Next(SessionRecord *rec)
+{
+    while(Pos+SESSION_LOG_RECORD_SIZE<=DataEnd)
+    {
+        const unsigned char *b=&Data[Pos];
+        Pos+=SESSION_LOG_RECORD_SIZE;
+
+        int type=b[0]&0x03;
+        if(type==SESSION_LOG_TYPE_BLOCK)
+        {
+            BaseUs=GetI64(b+1);
+            BaseMs=GetU32(b+9);
+            continue;
+        }
+
+        rec->Type=RecordTypes[type];
+        rec->Mode=(b[0]&0x04) ? 'D' : 'S';
+        int state=(b[0]>>3)&0x03;
+        rec->State=RecordStates[state<3 ? state : 2];
+        rec->HostTimeUs=BaseUs+GetU32(b+1);
+        rec->DeviceTime=(float) ((BaseMs+GetU16(b+5)) /1000.);
+        rec->Vals[0]=(signed char)b[7];
+        rec->Vals[1]=(signed char)b[8];
+        if(rec->Type=='O')
+        {
+            rec->Vals[2]=(float)(GetU16(b+9)/(double)Header.Scales[2]);
+            rec->Vals[3]=(float)(GetU16(b+11)/(double)Header.Scales[3]);
+        }
+        else
+        {
+            rec->Vals[2]=(float)(GetU16(b+9)/(double)Header.Scales[0]);
+            rec->Vals[3]=(float)(GetU16(b+11)/(double)Header.Scales[0]);
+        }
+        rec->Thresh[0]=(float)(GetU16(b+13)/(double)Header.Scales[1]);
+        rec->Thresh[1]=(float)(GetU16(b+15)/(double)Header.Scales[1]);
+        rec->Mouse[0]=(short)GetU16(b+17);
+        rec->Mouse[1]=(short)GetU16(b+19);
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,54 @@
+//--------------------------------------------------------------------------
+//
+//    Copyright (C) 2020 Vincent Crocher
+//    The University of Melbourne
+//
+//	  This file is part of ShoulderTrackingIMU.
+//
+//
+//---------------------------------------------------------------------------
+#ifndef SESSIONLOGREADER_H
+#define SESSIONLOGREADER_H
+
+#include <vector>
+#include "SessionLog.h"
+
+//! Reader of binary session logs (.stl), plain or compressed (.stlz, see LogChunk.h).
+//! The whole log is loaded in memory (~7.5MB per hour of values): compressed chunks are
+//! decompressed in parallel (one thread per core). Values are then read sequentially
+//! from any block: Seek() to a host time uses the block index (rebuilt from the block
+//! start records for interrupted sessions).
+class SessionLogReader
+{
+    public:
+        SessionLogReader();
+        ~SessionLogReader();
+
+        bool Open(const char *filename);
+        void Close();
+        bool Next(SessionRecord *rec);
+        bool Seek(long long int host_us);
+        void Rewind() {Pos=DataStart;}
+
+        const SessionHeader& GetHeader() {return Header;}
+        bool IsComplete() {return Complete;} //!< Closed properly (index present)
+        bool IsCompressed() {return Compressed;}
+        int GetNbChunks() {return NbChunks;}
+        const std::vector<SessionBlockIndex>& GetIndex() {return Index;}
+
+    private:
+        bool Decompress(const std::vector<unsigned char> &file);
+        bool ReadIndex();
+        void BuildIndex();
+
+        std::vector<unsigned char> Data; //!< Uncompressed log
+        SessionHeader Header;
+        bool Complete, Compressed;
+        int NbChunks;
+        std::vector<SessionBlockIndex> Index;
+        long DataStart, DataEnd, Pos;
+        long long int BaseUs;
+        unsigned int BaseMs;
+};
+
+#endif // SESSIONLOGREADER_H
@@ -0,0 +1,202 @@
+//--------------------------------------------------------------------------
+//
+//    Copyright (C) 2020 Vincent Crocher
+//    The University of Melbourne
+//
+//	  This file is part of ShoulderTrackingIMU.
+//
+//
+//---------------------------------------------------------------------------
+#include "SessionMetrics.h"
+#include <string.h>
+#include <time.h>
+
+
+SessionMetrics::SessionMetrics()
+{
+    Reset(0);
+}
+
+//! New session, starting at host time t_s
+void SessionMetrics::Reset(double t_s)
+{
+    StartTime=t_s;
+    NbValues=0;
+    memset(Modes, 0, sizeof(Modes));
+    Minutes.clear();
+    LastDeviceTime=-1;
+    LastMode=0;
+    InEpisode=false;
+    EpisodeMode=0;
+    EpisodeTime=0;
+    LastAboveTime=0;
+}
+
+//! One logged value (same arguments as Acquisition::LogValues). The time since the previous
+//! value is accounted to this one. Testing values (state T: no feedback) are not counted
+//! above the thresholds nor as compensation episodes.
+void SessionMetrics::AddValues(char type, char mode, char state, double t_s, float device_time, const float *vals, const float *thresh)
+{
+    NbValues++;
+    int m=(mode=='D') ? 1 : 0;
+
+    //Time since previous value, not counted across gaps (or device restart)
+    float dt=0;
+    if(LastDeviceTime>=0)
+    {
+        dt=device_time-LastDeviceTime;
+        if(dt<=0 || dt>METRICS_MAX_DT_S)
+        {
+            dt=0;
+            EndEpisode();
+        }
+    }
+    LastDeviceTime=device_time;
+    if(mode!=LastMode)
+        EndEpisode();
+    LastMode=mode;
+
+    //Current minute (rows only appended: amortised O(1))
+    MinuteMetrics *minute=NULL;
+    long int i=(long int)((t_s-StartTime)/60.);
+    if(i>=0 && i<METRICS_MAX_MINUTES)
+    {
+        if(i>=(long int)Minutes.size())
+        {
+            MinuteMetrics empty;
+            memset(&empty, 0, sizeof(empty));
+            Minutes.resize(i+1, empty);
+        }
+        minute=&Minutes[i];
+        //Thresholds trajectory of the current mode only
+        if(minute->Mode!=mode)
+        {
+            minute->NbThresh=0;
+            minute->ThreshSum[0]=minute->ThreshSum[1]=0;
+        }
+        minute->Mode=mode;
+    }
+
+    ModeMetrics &mm=Modes[m];
+    mm.Time+=dt;
+    if(minute)
+        minute->Time+=dt;
+
+    //Offline records: one per second, max velocities (other units) and no thresholds
+    if(type=='O')
+    {
+        EndEpisode();
+        mm.OfflineTime+=dt;
+        if(minute)
+            minute->OfflineTime+=dt;
+        return;
+    }
+
+    //Above threshold as the device feedback: angles in static mode, velocities in dynamic
+    const float *v=(mode=='D') ? &vals[2] : &vals[0];
+    bool above=(state!='T' && thresh[0]>0 && thresh[1]>0 && (v[0]>thresh[0] || v[1]>thresh[1]));
+    if(above)
+    {
+        mm.TimeAbove+=dt;
+        if(!InEpisode)
+        {
+            InEpisode=true;
+            EpisodeMode=m;
+            EpisodeTime=0;
+            mm.NbEpisodes++;
+            if(minute)
+                minute->NbEpisodes++;
+        }
+        EpisodeTime+=dt;
+        LastAboveTime=device_time;
+    }
+    else if(InEpisode && device_time-LastAboveTime>=METRICS_EPISODE_GAP_S)
+    {
+        EndEpisode();
+    }
+
+    if(minute)
+    {
+        if(above)
+            minute->TimeAbove+=dt;
+        minute->NbValues++;
+        minute->VelSum[0]+=vals[2];
+        minute->VelSum[1]+=vals[3];
+        minute->NbThresh++;
+        minute->ThreshSum[0]+=thresh[0];
+        minute->ThreshSum[1]+=thresh[1];
+    }
+}
+
+void SessionMetrics::EndEpisode()
+{
+    if(!InEpisode)
+        return;
+
+    ModeMetrics &mm=Modes[EpisodeMode];
+    mm.EpisodesTime+=EpisodeTime;
+    if(EpisodeTime>mm.LongestEpisode)
+        mm.LongestEpisode=EpisodeTime;
+    InEpisode=false;
+}
+
+//! Write the session summary (CSV): totals per mode, then one line per minute with values
+//!\return false if the file cannot be created
+bool SessionMetrics::Write(const char *filename, char init_mode, bool intervention)
+{
+    EndEpisode();
+
+    FILE *f=fopen(filename, "w");
+    if(!f)
+        return false;
+
+    char timestr[80];
+    time_t start=(time_t)StartTime;
+    strftime(timestr, 80, "%Y-%m-%d %H:%M:%S", localtime(&start));
+    fprintf(f, "ShoulderTracker session summary\n");
+    fprintf(f, "Start,%s\nInitial mode,%c\nIntervention,%d\nValues,%lu\n\n", timestr, init_mode, intervention, NbValues);
+
+    fprintf(f, "Mode,Time (s),Offline time (s),Time above thresholds (s),Above thresholds (%% of live time),Compensation episodes,Episodes mean duration (s),Longest episode (s)\n");
+    for(int m=0; m<2; m++)
+    {
+        const ModeMetrics &mm=Modes[m];
+        double live=mm.Time-mm.OfflineTime;
+        fprintf(f, "%s,%.1f,%.1f,%.1f,%.1f,%d,%.2f,%.2f\n", m==1 ? "Dynamic" : "Static", mm.Time, mm.OfflineTime, mm.TimeAbove,
+                live>0 ? 100*mm.TimeAbove/live : 0, mm.NbEpisodes, mm.NbEpisodes>0 ? mm.EpisodesTime/mm.NbEpisodes : 0, mm.LongestEpisode);
+    }
+
+    fprintf(f, "\nMinute,Mode,Time (s),Offline time (s),Time above thresholds (s),Compensation episodes,Mean linear velocity (m.s-1),Mean angular velocity (rad.s-1),Mean threshold 1,Mean threshold 2\n");
+    for(unsigned int i=0; i<Minutes.size(); i++)
+    {
+        const MinuteMetrics &min=Minutes[i];
+        //No values (pause, device off)
+        if(min.Mode==0)
+            continue;
+        fprintf(f, "%u,%c,%.1f,%.1f,%.1f,%d", i, min.Mode, min.Time, min.OfflineTime, min.TimeAbove, min.NbEpisodes);
+        if(min.NbValues>0)
+            fprintf(f, ",%.3f,%.3f", min.VelSum[0]/min.NbValues, min.VelSum[1]/min.NbValues);
+        else
+            fprintf(f, ",,");
+        if(min.NbThresh>0)
+            fprintf(f, ",%.2f,%.2f\n", min.ThreshSum[0]/min.NbThresh, min.ThreshSum[1]/min.NbThresh);
+        else
+            fprintf(f, ",,\n");
+    }
+
+    fclose(f);
+    return true;
+}
+
+//! Session totals on the console
+void SessionMetrics::Print()
+{
+    for(int m=0; m<2; m++)
+    {
+        const ModeMetrics &mm=Modes[m];
+        if(mm.Time<=0)
+            continue;
+        double live=mm.Time-mm.OfflineTime;
+        printf("%s: %.0fs, %.1f%% above thresholds, %d compensation episodes (longest %.1fs).\n", m==1 ? "Dynamic" : "Static", mm.Time,
+               live>0 ? 100*mm.TimeAbove/live : 0, mm.NbEpisodes, mm.LongestEpisode);
+    }
+}
@@ -0,0 +1,77 @@
+//--------------------------------------------------------------------------
+//
+//    Copyright (C) 2020 Vincent Crocher
+//    The University of Melbourne
+//
+//	  This file is part of ShoulderTrackingIMU.
+//
+//
+//---------------------------------------------------------------------------
+#ifndef SESSIONMETRICS_H
+#define SESSIONMETRICS_H
+
+#include <stdio.h>
+#include <vector>
+
+#define METRICS_MAX_DT_S 2.0 //!< Longer gaps between two values (link drop without offline records, device off) are not counted
+#define METRICS_EPISODE_GAP_S 0.5 //!< Shorter returns below the thresholds do not end a compensation episode
+#define METRICS_MAX_MINUTES (31*24*60) //!< Values beyond (wrong clock) are ignored
+
+//! Totals over the session, for one mode (static or dynamic)
+typedef struct
+{
+    double Time; //!< With values, live or offline (s)
+    double OfflineTime; //!< Recovered from the device buffer (s): no thresholds
+    double TimeAbove; //!< Live values above (any of) the thresholds, out of testing (s)
+    int NbEpisodes; //!< Compensation episodes (consecutive time above the thresholds)
+    double EpisodesTime; //!< Total duration of the ended episodes (s)
+    double LongestEpisode; //!< s
+} ModeMetrics;
+
+//! One minute of session
+typedef struct
+{
+    char Mode; //!< S or D (last values), 0 if no values
+    float Time, OfflineTime, TimeAbove; //!< s
+    int NbEpisodes; //!< Started during this minute
+    int NbValues; //!< Live values
+    double VelSum[2]; //!< Linear and angular velocities (activity), live values
+    int NbThresh;
+    double ThreshSum[2]; //!< Thresholds of the current mode (trajectory)
+} MinuteMetrics;
+
+//! Session outcome measures computed while logging (see Acquisition::LogValues), in O(1)
+//! per value: time above the thresholds, compensation episodes (number, duration), and
+//! per minute activity (mean velocities) and thresholds trajectory. Durations are from
+//! the device time (as offline records). Written as a short CSV summary when the session
+//! log is closed, instead of post-processing the whole log.
+class SessionMetrics
+{
+    public:
+        SessionMetrics();
+
+        void Reset(double t_s);
+        void AddValues(char type, char mode, char state, double t_s, float device_time, const float *vals, const float *thresh);
+        bool Write(const char *filename, char init_mode, bool intervention);
+        void Print();
+
+        unsigned long int GetNbValues() {return NbValues;}
+        const ModeMetrics& GetMode(char mode) {return Modes[mode=='D' ? 1 : 0];}
+
+    private:
+        void EndEpisode();
+
+        double StartTime; //!< Host time of the session start (s)
+        unsigned long int NbValues;
+        ModeMetrics Modes[2]; //!< Static, dynamic
+        std::vector<MinuteMetrics> Minutes;
+
+        float LastDeviceTime;
+        char LastMode;
+        bool InEpisode;
+        int EpisodeMode;
+        double EpisodeTime; //!< Time above the thresholds during the current episode
+        float LastAboveTime; //!< Device time of the last value above the thresholds
+};
+
+#endif // SESSIONMETRICS_H
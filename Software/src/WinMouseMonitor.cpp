@@ -1,18 +1,15 @@
 #include "WinMouseMonitor.h"
 
 HHOOK hMouseHook;
-int MouseActivity;
-int MousePosition[2];
+ActivityMonitor *HookMonitor=NULL; //!< Events destination (the hook has no user parameter)
 
 __declspec(dllexport) LRESULT CALLBACK MouseEvent (int nCode, WPARAM wParam, LPARAM lParam)
 {
     MOUSEHOOKSTRUCT * pMouseStruct = (MOUSEHOOKSTRUCT *)lParam;
-    if (pMouseStruct != NULL)
+    if (pMouseStruct != NULL && HookMonitor != NULL)
     {
-        //printf("Mouse position X = %d  Mouse Position Y = %d %d\n", pMouseStruct->pt.x,pMouseStruct->pt.y,MouseActivity);
-        MouseActivity++;
-        MousePosition[0]=pMouseStruct->pt.x;
-        MousePosition[1]=pMouseStruct->pt.y;
+        //printf("Mouse position X = %d  Mouse Position Y = %d\n", pMouseStruct->pt.x,pMouseStruct->pt.y);
+        HookMonitor->AddEvent(pMouseStruct->pt.x, pMouseStruct->pt.y);
     }
     return CallNextHookEx(hMouseHook,
         nCode,wParam,lParam);
@@ -30,11 +27,9 @@ void MessageLoop()
 DWORD WINAPI MyMouseLogger(LPVOID lpParm)
 {
     HINSTANCE hInstance = GetModuleHandle(NULL);
-    if (!hInstance) hInstance = LoadLibrary((LPCSTR) lpParm);
+    if (!hInstance && lpParm) hInstance = LoadLibrary((LPCSTR) lpParm);
     if (!hInstance) return 1;
 
-    MouseActivity=0;
-
     hMouseHook = SetWindowsHookEx (
         WH_MOUSE_LL,
         (HOOKPROC) MouseEvent,
@@ -45,3 +40,30 @@ DWORD WINAPI MyMouseLogger(LPVOID lpParm)
     UnhookWindowsHookEx(hMouseHook);
     return 0;
 }
+
+
+WinMouseSource::WinMouseSource()
+{
+    Thread=NULL;
+    ThreadId=0;
+}
+
+bool WinMouseSource::Start(ActivityMonitor *monitor)
+{
+    HookMonitor=monitor;
+    Thread=CreateThread(NULL, 0, MyMouseLogger, NULL, 0, &ThreadId);
+    return Thread!=NULL;
+}
+
+//! Quit the hook message loop and wait for its thread
+void WinMouseSource::Stop()
+{
+    if(Thread)
+    {
+        PostThreadMessage(ThreadId, WM_QUIT, 0, 0);
+        WaitForSingleObject(Thread, 1000);
+        CloseHandle(Thread);
+        Thread=NULL;
+    }
+    HookMonitor=NULL;
+}
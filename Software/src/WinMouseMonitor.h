@@ -4,10 +4,26 @@
 #include <windows.h>
 #include <stdio.h>
 
+#include "ActivityMonitor.h"
+
 DWORD WINAPI MyMouseLogger(LPVOID lpParm);
 
-extern int MouseActivity;
-extern int MousePosition[2];
+//! Windows low level mouse hook (any mouse event, in any application): the hook runs in its
+//! own thread (message loop)
+class WinMouseSource: public ActivitySource
+{
+    public:
+        WinMouseSource();
+        ~WinMouseSource() {Stop();}
+
+        bool Start(ActivityMonitor *monitor);
+        void Stop();
+        const char* GetName() {return "mouse hook";}
+
+    private:
+        HANDLE Thread;
+        DWORD ThreadId;
+};
 
 
 #endif // WINMOUSEMONITOR_H_INCLUDED
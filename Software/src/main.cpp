@@ -8,21 +8,32 @@
 //
 //---------------------------------------------------------------------------
 #include <getopt.h>
-#include "MainWindow.h"
+#include "Headless.h"
+#ifdef WINDOWS
+    #include "MainWindow.h"
 
-#define _WIN32_WINNT 0x0400
-#pragma comment( lib, "user32.lib" )
+    #define _WIN32_WINNT 0x0400
+    #pragma comment( lib, "user32.lib" )
 
-#include <windows.h>
+    #include <windows.h>
+#endif
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 
 int main (int argc, char ** argv)
 {
     mode_type InitMode;
     bool Plotting=false;
-
-    //POSIX command line arguments: PLOTTING mode and Static/Dynamic
+    bool HeadlessMode=false;
+    const char *ControlPath=NULL;
+    const char *ReplayFile=NULL;
+    double ReplaySpeed=1.0;
+    const char *CaptureFile=NULL;
+    bool ActivityPause=false;
+
+    //POSIX command line arguments: PLOTTING mode, HEADLESS mode (and its control socket), REPLAY of a recording (and its speed), serial CAPTURE, ACTIVITY pause (headless) and Static/Dynamic
     int OptionChar;             //Option character
     bool mode_spec=false;
     while (1)
@@ -32,13 +43,19 @@ int main (int argc, char ** argv)
             //Supported options
             {"mode", required_argument,       0, 'm'},
             {"plotting",  no_argument,       0, 'p'},
+            {"headless",  no_argument,       0, 'H'},
+            {"control",   required_argument, 0, 'c'},
+            {"replay",    required_argument, 0, 'r'},
+            {"speed",     required_argument, 0, 's'},
+            {"capture",   required_argument, 0, 'w'},
+            {"activity",  no_argument,       0, 'a'},
             //{"output",    required_argument, 0, 'o'},
             {0, 0, 0, 0}
         };
         // getopt_long stores the option index here.
         int option_index = 0;
 
-        OptionChar = getopt_long (argc, argv, "pm:", long_options, &option_index);
+        OptionChar = getopt_long (argc, argv, "pHc:r:s:w:am:", long_options, &option_index);
 
         // Detect the end of the options
         if (OptionChar == -1)
@@ -82,28 +99,109 @@ int main (int argc, char ** argv)
                 printf("Plotting ON.\n");
                 break;
 
+             //No GUI: acquisition only
+             case 'H':
+                HeadlessMode=true;
+                printf("Headless mode.\n");
+                break;
+
+             //Headless mode control socket
+             case 'c':
+                ControlPath=optarg;
+                break;
+
+             //Recorded session (STLog) or serial capture (.stwc) instead of a device
+             case 'r':
+                ReplayFile=optarg;
+                break;
+
+             //Replay speed: x real time, 0 for as fast as possible
+             case 's':
+                ReplaySpeed=atof(optarg);
+                break;
+
+             //Capture the serial bytes (.stwc)
+             case 'w':
+                CaptureFile=optarg;
+                break;
+
+             //Headless mode: pause when the input devices are not used (as the GUI with the mouse)
+             case 'a':
+                ActivityPause=true;
+                break;
+
              default:
                 fprintf(stderr, "Error: Please provide a valid mode (-m S: Static or -m D: Dynamic).\nUsage example:\t %s -m S\n\n", argv[0]);
                 exit(0);
          }
     }
-    if(argc<2 || (!mode_spec && !Plotting))
+    if(argc<2 || (!mode_spec && (!Plotting || HeadlessMode)))
     {
         fprintf(stderr, "Error: Please provide a valid mode (-m S: Static or -m D: Dynamic).\nUsage example:\t %s -m S\n\n", argv[0]);
         exit(0);
     }
 
-    HANDLE hThread;
-    DWORD dwThread;
-
-    hThread = CreateThread(NULL,NULL,(LPTHREAD_START_ROUTINE)
-        MyMouseLogger, (LPVOID) argv[0], NULL, &dwThread);
+    ReplaySource *Replay=NULL;
+    SerialCapture *Wire=NULL;
+    const char *ext=ReplayFile ? strrchr(ReplayFile, '.') : NULL;
+    if(ext && strcmp(ext, ".stwc")==0)
+    {
+        //Raw bytes, original timing
+        Wire=new SerialCapture();
+        if(!Wire->OpenReplay(ReplayFile))
+        {
+            fprintf(stderr, "Error: cannot replay %s.\n", ReplayFile);
+            delete Wire;
+            return 1;
+        }
+    }
+    else if(ReplayFile)
+    {
+        Replay=new ReplaySource();
+        if(!Replay->Open(ReplayFile, ReplaySpeed))
+        {
+            fprintf(stderr, "Error: cannot replay %s.\n", ReplayFile);
+            delete Replay;
+            return 1;
+        }
+    }
+    else if(CaptureFile)
+    {
+        Wire=new SerialCapture();
+        if(!Wire->OpenCapture(CaptureFile))
+        {
+            fprintf(stderr, "Error: cannot create %s.\n", CaptureFile);
+            delete Wire;
+            return 1;
+        }
+    }
 
+    //Acquisition only: no window, optional activity monitoring
+    if(HeadlessMode)
+    {
+        Headless *daemon=new Headless(InitMode, ControlPath, Replay, Wire);
+        if(ActivityPause && !daemon->EnableActivity())
+            printf("Error: no input device to monitor the activity (permissions?).\n");
+        int ret=daemon->Run();
+        delete daemon;
+        delete Replay;
+        delete Wire;
+        return ret;
+    }
 
-    MainWindow *mw=new MainWindow(InitMode, Plotting);
+#ifdef WINDOWS
+    //Mouse activity transitions are sent to the main loop (Fl::awake)
+    Fl::lock();
+    MainWindow *mw=new MainWindow(InitMode, Plotting, Replay, Wire);
     Fl::run();
 
     delete mw;
+    delete Replay;
+    delete Wire;
 
     return 0;
+#else
+    fprintf(stderr, "Error: the GUI is Windows only, use --headless.\nUsage example:\t %s --headless -m S --control /tmp/shouldertracker.sock\n\n", argv[0]);
+    return 1;
+#endif
 }
@@ -0,0 +1,123 @@
+//--------------------------------------------------------------------------
+//
+//    Copyright (C) 2020 Vincent Crocher
+//    The University of Melbourne
+//
+//	  This file is part of ShoulderTrackingIMU.
+//
+//
+//---------------------------------------------------------------------------
+//
+// Host benchmark (and equivalence check) of the ISB joint angles file loading
+// (see Data::LoadISBFile): fscanf loop (previous loader) vs LoadCsvFile (memory
+// mapped, parsed in parallel with std::from_chars).
+//
+// Build and run (from Software/tools):
+//   g++ -O2 -std=c++17 -pthread -I../src CsvLoaderBench.cpp ../src/CsvLoader.cpp -o CsvLoaderBench && ./CsvLoaderBench [nb_lines]
+//
+//---------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <string>
+
+#include "CsvLoader.h"
+
+typedef struct
+{
+    int t;
+    float q[5];
+    float weight;
+} LimbPosture;
+
+
+double Now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+static void SetISBPosture(LimbPosture &post, const double *v)
+{
+    post.t=(int)v[0];
+    post.weight=1.0;
+    for(int i=0; i<5; i++)
+        post.q[i]=v[1+i];
+}
+
+//Previous Data::LoadISBFile
+void LoadFscanf(const char *filename, std::vector<LimbPosture> &postures)
+{
+    FILE * dataFile=fopen(filename, "r");
+    if(dataFile)
+    {
+        float q[5];
+        int t;
+        char crap[1024];
+        while( fscanf(dataFile, "%d,%f,%f,%f,%f,%f", &t, &q[0], &q[1], &q[2], &q[3], &q[4]) !=6 )
+            fscanf(dataFile, "%s", crap);
+        while( fscanf(dataFile, "%d,%f,%f,%f,%f,%f", &t, &q[0], &q[1], &q[2], &q[3], &q[4]) == 6 )
+        {
+            LimbPosture post;
+            post.t=t;
+            post.weight=1.0;
+            for(int i=0; i<5; i++)
+                post.q[i]=q[i];
+            postures.push_back(post);
+        }
+        fclose(dataFile);
+    }
+}
+
+
+int main(int argc, char ** argv)
+{
+    int nb=5000000;
+    if(argc>1)
+        nb=atoi(argv[1]);
+
+    //ISB angles (rad) at 100Hz, with a header, in a file next to the binary (removed after)
+    std::string filename=std::string(argv[0])+".csv";
+    FILE *f=fopen(filename.c_str(), "w");
+    if(!f)
+        return 1;
+    fprintf(f, "Subject: bench\nt (ms), PlaneOfElevation, Elevation, IntExtRotation, ElbowFlexion, ProSupination\n");
+    srand(0);
+    for(int i=0; i<nb; i++)
+    {
+        fprintf(f, "%d", i*10);
+        for(int k=0; k<5; k++)
+            fprintf(f, ",%f", (rand()%62832-31416)/10000.);
+        fprintf(f, "\n");
+    }
+    long int size=ftell(f);
+    fclose(f);
+
+    std::vector<LimbPosture> ref, postures;
+    double t0=Now();
+    LoadFscanf(filename.c_str(), ref);
+    double t1=Now();
+    LoadCsvFile(filename.c_str(), 6, postures, SetISBPosture);
+    double t2=Now();
+    remove(filename.c_str());
+
+    //Equivalence: the previous loader skipped the first line of values (read by the header loop)
+    int nb_diff=(ref.size()+1==postures.size()) ? 0 : -1;
+    for(unsigned int i=0; nb_diff>=0 && i<ref.size(); i++)
+    {
+        bool same=(ref[i].t==postures[i+1].t);
+        for(int k=0; k<5; k++)
+            same=same && (ref[i].q[k]==postures[i+1].q[k]);
+        if(!same)
+            nb_diff++;
+    }
+
+    printf("%.0fMB, %d lines. fscanf: %.3fs  LoadCsvFile: %.3fs  (x%.1f)  ", size/1e6, nb, t1-t0, t2-t1, (t1-t0)/(t2-t1));
+    if(nb_diff<0)
+        printf("unexpected nb of lines (%d vs %d)\n", (int)ref.size(), (int)postures.size());
+    else
+        printf("%d different lines\n", nb_diff);
+
+    return nb_diff!=0;
+}
@@ -0,0 +1,129 @@
+//--------------------------------------------------------------------------
+//
+//    Copyright (C) 2020 Vincent Crocher
+//    The University of Melbourne
+//
+//	  This file is part of ShoulderTrackingIMU.
+//
+//
+//---------------------------------------------------------------------------
+//
+// Host benchmark (and equivalence check) of the CSV log lines formatting:
+// fprintf (previous logging path) vs CsvWriter (std::to_chars).
+//
+// Build and run (from Software/tools):
+//   g++ -O2 -std=c++17 -I../src CsvWriterBench.cpp ../src/CsvWriter.cpp -o CsvWriterBench && ./CsvWriterBench
+//
+//---------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "CsvWriter.h"
+
+#define LOG_FORMAT "%c,%c,%c,%f,%f,%f,%f,%f,%f,%f,%f,%d,%d\n"
+
+typedef struct
+{
+    char Type, Mode, State;
+    double Time;
+    float DeviceTime, Vals[4], Thresh[2];
+    int Mouse[2];
+} Line;
+
+
+double Now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+int Format(CsvWriter &csv, const Line &l)
+{
+    csv.Begin();
+    csv.Char(l.Type);
+    csv.Char(l.Mode);
+    csv.Char(l.State);
+    csv.Fixed(l.Time);
+    csv.Fixed(l.DeviceTime);
+    for(int k=0; k<4; k++)
+        csv.Fixed(l.Vals[k]);
+    csv.Fixed(l.Thresh[0]);
+    csv.Fixed(l.Thresh[1]);
+    csv.Int(l.Mouse[0]);
+    csv.Int(l.Mouse[1]);
+    return csv.End();
+}
+
+
+int main(int argc, char ** argv)
+{
+    int nb=1000000;
+    if(argc>1)
+        nb=atoi(argv[1]);
+
+    //Values as received from the device (see SerialWin.cpp) at 100Hz
+    Line *lines=new Line[nb];
+    srand(0);
+    for(int i=0; i<nb; i++)
+    {
+        Line &l=lines[i];
+        l.Type='G';
+        l.Mode=(i/10000)%2 ? 'D' : 'S';
+        l.State='R';
+        l.Time=1600000000+i/100+(i%100)*10000/(1000.0*1000.0);
+        l.DeviceTime=(float)((123456+i*10)/1000.);
+        l.Vals[0]=(signed char)(rand()%256);
+        l.Vals[1]=(signed char)(rand()%256);
+        l.Vals[2]=(float)((rand()%65536)/1000.);
+        l.Vals[3]=(float)((rand()%65536)/1000.);
+        l.Thresh[0]=(float)((rand()%65536)/100.);
+        l.Thresh[1]=(float)((rand()%65536)/100.);
+        l.Mouse[0]=rand()%1920;
+        l.Mouse[1]=rand()%1080;
+    }
+
+    //Equivalence
+    CsvWriter csv;
+    char ref[512];
+    int nb_diff=0;
+    for(int i=0; i<nb; i++)
+    {
+        const Line &l=lines[i];
+        sprintf(ref, LOG_FORMAT, l.Type, l.Mode, l.State, l.Time, l.DeviceTime, l.Vals[0], l.Vals[1], l.Vals[2], l.Vals[3], l.Thresh[0], l.Thresh[1], l.Mouse[0], l.Mouse[1]);
+        Format(csv, l);
+        if(strcmp(ref, csv.Line())!=0)
+        {
+            if(nb_diff==0)
+                printf("First difference:\n%s%s", ref, csv.Line());
+            nb_diff++;
+        }
+    }
+
+    //Timing: both to a (temporary) file through the same stdio buffer
+    FILE *f=tmpfile();
+    double t0=Now();
+    for(int i=0; i<nb; i++)
+    {
+        const Line &l=lines[i];
+        fprintf(f, LOG_FORMAT, l.Type, l.Mode, l.State, l.Time, l.DeviceTime, l.Vals[0], l.Vals[1], l.Vals[2], l.Vals[3], l.Thresh[0], l.Thresh[1], l.Mouse[0], l.Mouse[1]);
+    }
+    fflush(f);
+    double t1=Now();
+    for(int i=0; i<nb; i++)
+    {
+        int n=Format(csv, lines[i]);
+        fwrite(csv.Line(), 1, n, f);
+    }
+    fflush(f);
+    double t2=Now();
+    fclose(f);
+
+    printf("fprintf: %8.0f lines/s  CsvWriter: %8.0f lines/s  (x%.1f)  %d different lines out of %d\n",
+           nb/(t1-t0), nb/(t2-t1), (t1-t0)/(t2-t1), nb_diff, nb);
+
+    delete[] lines;
+    return nb_diff>0;
+}
@@ -0,0 +1,122 @@
+//--------------------------------------------------------------------------
+//
+//    Copyright (C) 2020 Vincent Crocher
+//    The University of Melbourne
+//
+//	  This file is part of ShoulderTrackingIMU.
+//
+//
+//---------------------------------------------------------------------------
+//
+// Equivalence check (and host timing) of the firmware IIR filters:
+// templated IirFilter vs the previous implementation (coefficients in RAM, division by a[0]).
+// Host timings say nothing of the AVR cost: use the firmware profiler (CDX) for that.
+//
+// Build and run (from Software/tools):
+//   g++ -O2 -I../../Firmware/ShoulderTrackerFirmware IirFilterBench.cpp -o IirFilterBench && ./IirFilterBench
+//
+//---------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#include "IirFilter.h"
+
+//Same coefficients as the firmware (Filter.h)
+constexpr IirCoeffs<1> VelocityLowPassCoeffs={{0.2452f, 0.2452f}, {1.0000f, -0.5095f}};
+//A higher order one (2nd order Butterworth low-pass, fc=5Hz at 100Hz) to check the shifting
+constexpr IirCoeffs<2> Butter2Coeffs={{0.0201f, 0.0402f, 0.0201f}, {1.0000f, -1.5610f, 0.6414f}};
+
+
+//Previous firmware implementation
+template<int N>
+class ShiftFilter
+{
+    public:
+        ShiftFilter(const float *bb, const float *aa)
+        {
+            for(int k=0; k<N+1; k++)
+            {
+                b[k]=bb[k];
+                a[k]=aa[k];
+                x[k]=0;
+                y[k]=0;
+            }
+        }
+
+        float filter(float xx)
+        {
+            for(int k=0; k<N; k++)
+            {
+                x[k]=x[k+1];
+                y[k]=y[k+1];
+            }
+            x[N]=xx;
+
+            y[N]=0;
+            for(int k=0; k<N+1; k++)
+                y[N]+=b[k]*x[N-k];
+            for(int k=1; k<N+1; k++)
+                y[N]-=a[k]*y[N-k];
+            y[N]/=a[0];
+
+            return y[N];
+        }
+
+    private:
+        float a[N+1], b[N+1];
+        float x[N+1], y[N+1];
+};
+
+
+double Now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+template<int N, const IirCoeffs<N> &C>
+void Bench(const char *name, const float *input, int nb)
+{
+    ShiftFilter<N> ref(C.b, C.a);
+    IirFilter<N, C> filt;
+
+    //Equivalence
+    double max_err=0;
+    for(int i=0; i<nb; i++)
+        max_err=fmax(max_err, fabs(ref.filter(input[i])-filt.Filter(input[i])));
+
+    //Timing (sum output so that nothing is optimised away)
+    float sink=0;
+    double t0=Now();
+    for(int i=0; i<nb; i++)
+        sink+=ref.filter(input[i]);
+    double t1=Now();
+    for(int i=0; i<nb; i++)
+        sink+=filt.Filter(input[i]);
+    double t2=Now();
+
+    printf("%-12s previous: %6.2f ns/sample  IirFilter: %6.2f ns/sample  (x%.1f)  max diff: %g  (%g)\n",
+           name, (t1-t0)/nb*1e9, (t2-t1)/nb*1e9, (t1-t0)/(t2-t1), max_err, sink);
+}
+
+
+int main(int argc, char ** argv)
+{
+    int nb=10000000;
+    if(argc>1)
+        nb=atoi(argv[1]);
+
+    float *input=new float[nb];
+    srand(0);
+    for(int i=0; i<nb; i++)
+        input[i]=sin(i/100.)+(rand()/(float)RAND_MAX-0.5f);
+
+    Bench<1, VelocityLowPassCoeffs>("Order 1 LP", input, nb);
+    Bench<2, Butter2Coeffs>("Order 2 LP", input, nb);
+
+    delete[] input;
+    return 0;
+}
@@ -0,0 +1,94 @@
+//--------------------------------------------------------------------------
+//
+//    Copyright (C) 2020 Vincent Crocher
+//    The University of Melbourne
+//
+//	  This file is part of ShoulderTrackingIMU.
+//
+//
+//---------------------------------------------------------------------------
+//
+// Convert binary session logs (STLog_*.stl or compressed .stlz, see src/SessionLog.h) to the CSV
+// format previously logged by ShoulderTrackingIMU (same text, line by line).
+//
+// Build and run (from Software/tools):
+//   g++ -O2 -std=c++17 -pthread -I../src StlToCsv.cpp ../src/SessionLog.cpp ../src/SessionLogReader.cpp ../src/CsvWriter.cpp -lz -o StlToCsv
+//   ./StlToCsv STLog_2020-01-01-10-00-00.stl [output.csv]
+// Output defaults to the input filename with a .csv extension.
+//
+//---------------------------------------------------------------------------
+#include <stdio.h>
+#include <string.h>
+
+#include "SessionLogReader.h"
+
+
+int main(int argc, char **argv)
+{
+    if(argc<2)
+    {
+        printf("Usage: %s log.stl [output.csv]\n", argv[0]);
+        return 1;
+    }
+
+    SessionLogReader reader;
+    if(!reader.Open(argv[1]))
+    {
+        printf("Error: %s is not a (version %d) binary session log.\n", argv[1], SESSION_LOG_VERSION);
+        return 1;
+    }
+    const SessionHeader &h=reader.GetHeader();
+    printf("%s: mode %c, %s, device %s, %s", argv[1], h.Mode, h.Intervention ? "intervention" : "baseline", h.DeviceId,
+           reader.IsComplete() ? "complete" : "interrupted session (no index)");
+    if(reader.IsCompressed())
+        printf(", %d compressed chunks", reader.GetNbChunks());
+    printf(".\n");
+
+    char out_name[1024];
+    if(argc>2)
+    {
+        strncpy(out_name, argv[2], 1023);
+        out_name[1023]='\0';
+    }
+    else
+    {
+        strncpy(out_name, argv[1], 1019);
+        out_name[1019]='\0';
+        char *ext=strrchr(out_name, '.');
+        if(ext && !strchr(ext, '/') && !strchr(ext, '\\'))
+            (*ext)='\0';
+        strcat(out_name, ".csv");
+    }
+    FILE *out=fopen(out_name, "w");
+    if(!out)
+    {
+        printf("Error: cannot create %s.\n", out_name);
+        return 1;
+    }
+
+    //Lines are gathered in a large buffer: one fwrite per 1MB
+    const int out_size=1024*1024;
+    char *out_buffer=new char[out_size];
+    int out_nb=0;
+    SessionRecord rec;
+    CsvWriter csv;
+    unsigned long int nb=0;
+    while(reader.Next(&rec))
+    {
+        int n=SessionRecordToCsv(&rec, csv);
+        if(out_nb+n>out_size)
+        {
+            fwrite(out_buffer, 1, out_nb, out);
+            out_nb=0;
+        }
+        memcpy(out_buffer+out_nb, csv.Line(), n);
+        out_nb+=n;
+        nb++;
+    }
+    fwrite(out_buffer, 1, out_nb, out);
+    fclose(out);
+    delete[] out_buffer;
+
+    printf("%lu lines written to %s.\n", nb, out_name);
+    return 0;
+}